@@ -4,9 +4,9 @@
 #include "cinder/CameraUi.h"
 
 // メモ
-// "loader/quad_loader.h"を"cinder/gl/gl.h"よりも前にincludeすると
+// "frame_source.h"を"cinder/gl/gl.h"よりも前にincludeすると
 // OpenCV内でdefineされるFARがcinderのコードを置換してエラーが発生してしまう
-#include "quad_loader.h"
+#include "frame_source.h"
 
 using namespace ci;
 using namespace ci::app;
@@ -254,7 +254,8 @@ public:
 
 class PreviewApp : public App {
 private:
-	qs::QuadLoader mLoader;
+	std::unique_ptr<qs::FrameSource> mSource;
+	qs::QuadFrame mQuadFrame;
 	PointCloud mPoints{};
 
 	bool mPlay = false;
@@ -264,7 +265,7 @@ private:
 
 public:
 	void setup() override {
-		// QuadLoaderの初期化
+		// FrameSourceの初期化
 
 		// コマンドライン引数の取得
 		// (cinderはコマンドライン引数を自動的にUTF8に変換する)
@@ -282,8 +283,8 @@ public:
 		}
 
 		std::filesystem::path recDir = std::filesystem::u8path(args.at(1));
-		mLoader.open(recDir);
-		if (!mLoader.isOpened()) {
+		mSource = qs::openFrameSource(recDir);
+		if (!mSource) {
 			std::cout << "failed to open forder" << std::endl;
 			quit();
 			return;
@@ -302,10 +303,8 @@ public:
 
 	void updatePoints() {
 		// 次のフレームを取得
-		auto quad = mLoader.next(false, false);
-		if (!quad.has_value()) { quit(); return; }
-		qs::QuadFrame& quadFrame = quad.value();
-		qs::Camera camera = quadFrame.camera;
+		if (!mSource->next(mQuadFrame, qs::FIELD_CAMERA)) { quit(); return; }
+		const qs::Camera& camera = mQuadFrame.camera;
 		if (camera.color.empty() || camera.depth.empty() || camera.confidence.empty()) { return; }
 
 		// 点群の更新
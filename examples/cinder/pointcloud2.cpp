@@ -4,9 +4,9 @@
 #include "cinder/CameraUi.h"
 
 // メモ
-// "loader/quad_loader.h"を"cinder/gl/gl.h"よりも前にincludeすると
+// "frame_source.h"を"cinder/gl/gl.h"よりも前にincludeすると
 // OpenCV内でdefineされるFARがcinderのコードを置換してエラーが発生してしまう
-#include "quad_loader.h"
+#include "frame_source.h"
 
 #include <list>
 #include <cstring>
@@ -296,7 +296,8 @@ public:
 
 class PreviewApp : public App {
 private:
-	qs::QuadLoader mLoader;
+	std::unique_ptr<qs::FrameSource> mSource;
+	qs::QuadFrame mQuadFrame;
 	PointCloud mPoints{ PointCloud::DrawType::MESH, 0, 0 };
 
 	bool mPlay = false;
@@ -310,7 +311,7 @@ private:
 
 public:
 	void setup() override {
-		// QuadLoaderの初期化
+		// FrameSourceの初期化
 
 		// コマンドライン引数の取得
 		// (cinderはコマンドライン引数を自動的にUTF8に変換する)
@@ -328,8 +329,8 @@ public:
 		}
 
 		std::filesystem::path recDir = std::filesystem::u8path(args.at(1));
-		mLoader.open(recDir);
-		if (!mLoader.isOpened()) {
+		mSource = qs::openFrameSource(recDir);
+		if (!mSource) {
 			std::cout << "failed to open forder" << std::endl;
 			quit();
 			return;
@@ -352,18 +353,19 @@ public:
 	mat3 intrinsics;
 	void updatePoints() {
 		// 次のフレームを取得
-		auto quad = mLoader.next(false, false);
-		if (!quad.has_value()) { quit(); return; }
-		qs::QuadFrame& quadFrame = quad.value();
-		qs::Camera camera = quadFrame.camera;
-		if (
-			camera.color.empty() || camera.depth.empty() || camera.confidence.empty() ||
-			camera.intrinsicsMatrix.empty() || camera.projectionMatrix.empty() || camera.viewMatrix.empty()
-		) { return; }
+		// 点群は30フレーム毎にしか更新しないので、それ以外のフレームでは姿勢のみを読み込む
+		// (動画のデコードとデプスの展開が省略される)
+		static int count = 0;
+		const qs::FieldMask fields = (count == 0) ? qs::FIELD_CAMERA : qs::FIELD_MATRICES;
+		if (!mSource->next(mQuadFrame, fields)) { quit(); return; }
+		const qs::Camera& camera = mQuadFrame.camera;
+		if (camera.intrinsicsMatrix.empty() || camera.projectionMatrix.empty() || camera.viewMatrix.empty()) { return; }
 
 		// 点群の更新
-		static int count = 0;
-		if (count == 0) mPoints.update(camera);
+		if (count == 0) {
+			if (camera.color.empty() || camera.depth.empty() || camera.confidence.empty()) { return; }
+			mPoints.update(camera);
+		}
 		count = (count + 1) % 30;
 
 		viewMatrix = toGlmMat4(camera.viewMatrix);
@@ -3,9 +3,9 @@
 #include "cinder/gl/gl.h"
 
 // メモ
-// "quad_loader.h"を"cinder/gl/gl.h"よりも前にincludeすると
+// "frame_source.h"を"cinder/gl/gl.h"よりも前にincludeすると
 // OpenCV内でdefineされるFARがcinderのコードを置換してエラーが発生してしまう
-#include "quad_loader.h"
+#include "frame_source.h"
 
 #include <chrono>
 
@@ -14,7 +14,8 @@ using namespace ci::app;
 
 class BasicApp : public App {
 private:
-	qs::QuadLoader loader;
+	std::unique_ptr<qs::FrameSource> source;
+	qs::QuadFrame quadFrame;
 	gl::GlslProgRef mGlsl;
 	gl::Texture2dRef mColorTex;
 	gl::Texture2dRef mDepthTex;
@@ -23,7 +24,7 @@ private:
 
 public:
 	void setup() override {
-		// Initialize QuadLoader ====================================================
+		// Initialize FrameSource ===================================================
 		std::vector<std::string> args = getCommandLineArgs();
 		if (2 != args.size()) {
 			std::cout
@@ -38,8 +39,8 @@ public:
 		}
 
 		std::filesystem::path recDir = std::filesystem::u8path(args.at(1));
-		loader.open(recDir);
-		if (!loader.isOpened()) {
+		source = qs::openFrameSource(recDir);
+		if (!source) {
 			std::cout << "failed to open forder" << std::endl;
 			quit();
 			return;
@@ -101,13 +102,11 @@ public:
 		timeForFps = std::chrono::system_clock::now();
 	}
 	void update() override {
-		auto quad = loader.next(false, false);
-		if (!quad.has_value()) {
+		if (!source->next(quadFrame, qs::FIELD_CAMERA)) {
 			quit();
 			return;
 		}
-		qs::QuadFrame& quadFrame = quad.value();
-		qs::Camera camera = quadFrame.camera;
+		qs::Camera& camera = quadFrame.camera;
 
 		if (camera.color.empty() || camera.depth.empty() || camera.confidence.empty()) {
 			return;
@@ -0,0 +1,77 @@
+#include <iostream>
+#include <cstdlib>
+#include "quad_loader.h"
+#include "allocation_counter.h"
+
+/*
+	QuadLoader::next(QuadFrame&)が定常状態でメモリを確保しないことを確認するためのプログラム
+
+	operator newの呼び出し回数を数え、ウォームアップ後のフレームで確保が発生した場合は失敗とする。
+	OpenCVの行列はoperator newを経由せずに確保されるため、データのアドレスが変化しないことで確認する。
+	ctestではquadslam_synthで合成した録画に対して実行される。
+*/
+
+int main(int argc, char* argv[]) {
+	if (2 != argc && 3 != argc) {
+		std::cout
+			<< "example_alloc_count version 0.0.1\n"
+			<< "\n"
+			<< "usage: example_alloc_count input_path [prefetch]\n"
+			<< "  input_path: Directory containing QuadDump recording files\n"
+			<< "  prefetch  : Prefetch depth (default: 0)"
+			<< "\n"
+			<< std::endl;
+		return 0;
+	}
+
+	std::string recDirPath = argv[1];
+	const size_t prefetch = (3 == argc) ? std::strtoull(argv[2], nullptr, 10) : 0;
+	qs::QuadLoader loader;
+	loader.setPrefetch(prefetch);
+	loader.open(recDirPath);
+	if (!loader.isOpened()) { std::cout << "failed to open forder" << std::endl; return 1; }
+
+	// IMUとGPSの配列は1フレーム当たりの最大数に達するまで伸長されるので、あらかじめ確保しておく
+	qs::QuadFrame quadFrame;
+	quadFrame.imu.reserve(1024);
+	quadFrame.gps.reserve(64);
+
+	// 最初の数フレームは領域の確保が行われるので計測しない
+	const size_t warmupFrames = 30;
+	size_t frames = 0, measuredFrames = 0, allocatedFrames = 0, allocations = 0, reallocatedMats = 0;
+	const void* colorData = nullptr;
+	const void* depthData = nullptr;
+	const void* confidenceData = nullptr;
+	while (true) {
+		const size_t before = qs::allocationCount.load();
+		if (!loader.next(quadFrame)) { break; }
+		const size_t after = qs::allocationCount.load();
+		const qs::Camera& camera = quadFrame.camera;
+
+		if (warmupFrames <= frames) {
+			measuredFrames++;
+			if (before != after) { allocatedFrames++; allocations += after - before; }
+
+			// 先読みが有効な場合は複数の領域を使い回すので、アドレスの比較は先読みが無効な場合のみ行う
+			if (0 == prefetch && (
+				colorData != camera.color.data ||
+				depthData != camera.depth.data ||
+				confidenceData != camera.confidence.data
+			)) { reallocatedMats++; }
+		}
+		colorData = camera.color.data;
+		depthData = camera.depth.data;
+		confidenceData = camera.confidence.data;
+		frames++;
+	}
+
+	std::cout
+		<< "frames              : " << frames                                        << "\n"
+		<< "measured frames     : " << measuredFrames                                << "\n"
+		<< "allocations         : " << allocations                                   << "\n"
+		<< "allocations / frame : " << (measuredFrames ? (double)allocations / measuredFrames : 0.0) << "\n"
+		<< "frames with alloc   : " << allocatedFrames                               << "\n"
+		<< "reallocated matrices: " << reallocatedMats                               << std::endl;
+
+	return (0 == allocations && 0 == reallocatedMats) ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+#include <iostream>
+#include <chrono>
+#include "event_stream.h"
+
+/*
+	カメラ、IMU、GPSのイベントをタイムスタンプ順に読み込むプログラム
+	各イベントの数と読み込みの速さを表示する。verboseを指定すると全てのイベントを表示する。
+*/
+
+int main(int argc, char* argv[]) {
+	if (2 != argc && 3 != argc) {
+		std::cout
+			<< "example_events version 0.0.1\n"
+			<< "\n"
+			<< "usage: example_events input_path [verbose]\n"
+			<< "  input_path: Directory containing QuadDump recording files\n"
+			<< "  verbose   : Print every event if 1 (default: 0)"
+			<< "\n"
+			<< std::endl;
+		return 0;
+	}
+
+	const bool verbose = (3 == argc) && 1 == std::atoi(argv[2]);
+	qs::EventStream stream;
+	stream.open(std::filesystem::u8path(argv[1]));
+	if (!stream.isOpened()) { std::cout << "failed to open forder" << std::endl; return 1; }
+
+	qs::SensorEvent event;
+	size_t cameraEvents = 0, imuEvents = 0, gpsEvents = 0;
+	const auto start = std::chrono::steady_clock::now();
+	while (stream.next(event)) {
+		switch (event.type) {
+			case qs::EventType::CAMERA:
+				cameraEvents++;
+				if (verbose) { std::cout << event.timestamp << " camera " << event.frameNumber << "\n"; }
+				break;
+			case qs::EventType::IMU:
+				imuEvents++;
+				if (verbose) { std::cout << event.timestamp << " imu    " << event.imu.cvRotationRate() << "\n"; }
+				break;
+			case qs::EventType::GPS:
+				gpsEvents++;
+				if (verbose) { std::cout << event.timestamp << " gps    " << event.gps.cvGps() << "\n"; }
+				break;
+		}
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const size_t events = cameraEvents + imuEvents + gpsEvents;
+
+	std::cout
+		<< "camera events: " << cameraEvents << "\n"
+		<< "imu events   : " << imuEvents    << "\n"
+		<< "gps events   : " << gpsEvents    << "\n"
+		<< "events / s   : " << (seconds > 0.0 ? events / seconds : 0.0) << "\n"
+		<< "failed       : " << (stream.failed() ? "yes" : "no") << std::endl;
+
+	return stream.failed() ? 1 : 0;
+}
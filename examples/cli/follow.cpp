@@ -0,0 +1,45 @@
+#include <iostream>
+#include <chrono>
+#include "follow_source.h"
+
+/*
+	書き込み中の録画を追いかけて読み込むプログラム
+	quadslam_livewriteで書き出している録画を指定すると、フレームが書き込まれる度に表示する。
+*/
+
+int main(int argc, char* argv[]) {
+	if (2 != argc && 3 != argc) {
+		std::cout
+			<< "example_follow version 0.0.1\n"
+			<< "\n"
+			<< "usage: example_follow input_path [idle_timeout]\n"
+			<< "  input_path  : Directory containing QuadDump recording files being written\n"
+			<< "  idle_timeout: Seconds without updates before stopping (default: 10)"
+			<< "\n"
+			<< std::endl;
+		return 0;
+	}
+
+	qs::FollowOptions options;
+	if (3 == argc) { options.idleTimeout = std::strtod(argv[2], nullptr); }
+	qs::FollowSource source;
+	source.open(std::filesystem::u8path(argv[1]), options);
+
+	qs::QuadFrame quadFrame;
+	size_t frames = 0;
+	auto previous = std::chrono::steady_clock::now();
+	while (source.next(quadFrame, qs::FIELD_CAMERA | qs::FIELD_IMU)) {
+		const auto now = std::chrono::steady_clock::now();
+		const double interval = std::chrono::duration<double>(now - previous).count();
+		previous = now;
+		std::cout
+			<< "frame " << quadFrame.camera.frameNumber
+			<< "  timestamp " << quadFrame.camera.timestamp
+			<< "  imu " << quadFrame.imu.size()
+			<< "  interval " << interval << " s" << std::endl;
+		frames++;
+	}
+
+	std::cout << "frames: " << frames << std::endl;
+	return 0;
+}
@@ -0,0 +1,46 @@
+#include <iostream>
+#include "quad_loader.h"
+
+/*
+	カメラのフレームに揃えたGPSの軌跡をCSVで出力するプログラム
+	位置は最初の有効な測位を原点とするENU座標 (m) で、付近に測位の無いフレームは出力しない。
+*/
+
+int main(int argc, char* argv[]) {
+	if (2 != argc && 3 != argc) {
+		std::cout
+			<< "example_gps_trajectory version 0.0.1\n"
+			<< "\n"
+			<< "usage: example_gps_trajectory input_path [smoothing_time]\n"
+			<< "  input_path    : Directory containing QuadDump recording files\n"
+			<< "  smoothing_time: Standard deviation of the smoothing window in seconds (default: 1)"
+			<< "\n"
+			<< std::endl;
+		return 0;
+	}
+
+	std::string recDirPath = argv[1];
+	qs::QuadLoader loader;
+	loader.open(recDirPath);
+	if (!loader.isOpened()) { std::cout << "failed to open forder" << std::endl; return 1; }
+
+	qs::GpsTrajectoryOptions options;
+	if (3 == argc) { options.smoothingTime = std::strtod(argv[2], nullptr); }
+	qs::GpsTrajectory trajectory;
+	if (!loader.gpsTrajectory(trajectory, options)) { std::cout << "no valid gps fix" << std::endl; return 1; }
+
+	std::cout
+		<< "# origin: " << trajectory.origin.getLatitude() << ", "
+		<< trajectory.origin.getLongitude() << ", " << trajectory.origin.getAltitude() << "\n"
+		<< "frame,timestamp,east,north,up,horizontal_accuracy,vertical_accuracy\n";
+	for (size_t i = 0; i < trajectory.size(); i++) {
+		if (!trajectory.valid[i]) { continue; }
+		std::cout
+			<< trajectory.frameNumber[i] << "," << trajectory.timestamp[i] << ","
+			<< trajectory.position.x[i] << "," << trajectory.position.y[i] << "," << trajectory.position.z[i] << ","
+			<< trajectory.horizontalAccuracy[i] << "," << trajectory.verticalAccuracy[i] << "\n";
+	}
+	std::cout << std::flush;
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include "parallel_reader.h"
+
+/*
+	ParallelReaderで録画全体を読み込み、読み込み速度を表示するプログラム
+	順序通りに読み込むnext()と、順不同で読み込むforEach()の両方を計測する。
+*/
+
+int main(int argc, char* argv[]) {
+	if (2 != argc && 3 != argc) {
+		std::cout
+			<< "example_parallel version 0.0.1\n"
+			<< "\n"
+			<< "usage: example_parallel input_path [workers]\n"
+			<< "  input_path: Directory containing QuadDump recording files\n"
+			<< "  workers   : Number of worker threads (default: number of cores)"
+			<< "\n"
+			<< std::endl;
+		return 0;
+	}
+
+	std::string recDirPath = argv[1];
+	qs::ParallelReader::Options options;
+	options.workers = (3 == argc) ? std::strtoull(argv[2], nullptr, 10) : 0;
+	qs::ParallelReader reader;
+	reader.open(recDirPath, options);
+	if (!reader.isOpened()) { std::cout << "failed to open forder" << std::endl; return 1; }
+
+	using Clock = std::chrono::steady_clock;
+	auto seconds = [](Clock::time_point begin) {
+		return std::chrono::duration<double>(Clock::now() - begin).count();
+	};
+
+	// フレーム番号順
+	Clock::time_point begin = Clock::now();
+	qs::QuadFrame quadFrame;
+	size_t orderedFrames = 0;
+	bool ordered = true;
+	uint64_t preFrameNumber = 0;
+	while (reader.next(quadFrame)) {
+		if (0 < orderedFrames && quadFrame.camera.frameNumber <= preFrameNumber) { ordered = false; }
+		preFrameNumber = quadFrame.camera.frameNumber;
+		orderedFrames++;
+	}
+	const double orderedSeconds = seconds(begin);
+
+	// 順不同
+	begin = Clock::now();
+	std::atomic<size_t> unorderedFrames{0};
+	reader.forEach([&unorderedFrames](qs::QuadFrame&) { unorderedFrames++; });
+	const double unorderedSeconds = seconds(begin);
+
+	std::cout
+		<< "workers         : " << reader.getWorkers()                             << "\n"
+		<< "frame count     : " << reader.getFrameCount()                          << "\n"
+		<< "ordered frames  : " << orderedFrames << (ordered ? "" : " (out of order)") << "\n"
+		<< "ordered fps     : " << orderedFrames / orderedSeconds                  << "\n"
+		<< "unordered frames: " << unorderedFrames.load()                          << "\n"
+		<< "unordered fps   : " << unorderedFrames.load() / unorderedSeconds       << std::endl;
+
+	return ordered ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include "quad_loader.h"
+#include "imu_preintegration.h"
+
+/*
+	フレーム間のIMUを事前積分し、処理速度を表示するプログラム
+	IMUのみを読み込んで全ての区間を登録した後、バイアスを変えて積分し直す時間も計測する。
+*/
+
+int main(int argc, char* argv[]) {
+	if (2 != argc) {
+		std::cout
+			<< "example_preintegration version 0.0.1\n"
+			<< "\n"
+			<< "usage: example_preintegration input_path\n"
+			<< "  input_path: Directory containing QuadDump recording files"
+			<< "\n"
+			<< std::endl;
+		return 0;
+	}
+
+	std::string recDirPath = argv[1];
+	qs::QuadLoader loader;
+	loader.open(recDirPath);
+	if (!loader.isOpened()) { std::cout << "failed to open forder" << std::endl; return 1; }
+
+	// カメラの画像は使用しないので、IMUのみを列ごとの配列で読み込む
+	qs::ImuPreintegrator preintegrator;
+	qs::QuadFrame quadFrame;
+	const qs::FieldMask fields = qs::FIELD_IMU_BATCH;
+	while (loader.next(quadFrame, fields)) { preintegrator.addFrame(quadFrame); }
+
+	auto measure = [&](const cv::Vec3d& accelBias, const cv::Vec3d& gyroBias) {
+		const auto start = std::chrono::steady_clock::now();
+		preintegrator.integrate(accelBias, gyroBias);
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	};
+	const double first = measure(cv::Vec3d(0.0, 0.0, 0.0), cv::Vec3d(0.0, 0.0, 0.0));
+	const double relinearize = measure(cv::Vec3d(0.01, 0.01, 0.01), cv::Vec3d(0.001, 0.001, 0.001));
+
+	for (size_t i = 0; i < preintegrator.size(); i += std::max<size_t>(preintegrator.size() / 10, 1)) {
+		const qs::PreintegratedImu& result = preintegrator.at(i);
+		std::cout
+			<< "================================\n"
+			<< "window       : " << i                    << "\n"
+			<< "time         : " << result.startTime << " - " << result.endTime << "\n"
+			<< "samples      : " << result.sampleCount  << "\n"
+			<< "deltaVelocity: " << result.deltaVelocity << "\n"
+			<< "deltaPosition: " << result.deltaPosition << std::endl;
+	}
+
+	const double windows = static_cast<double>(preintegrator.size());
+	std::cout
+		<< "================================\n"
+		<< "windows    : " << preintegrator.size() << "\n"
+		<< "integrate  : " << (first > 0.0 ? windows / first : 0.0) << " windows/s\n"
+		<< "relinearize: " << (relinearize > 0.0 ? windows / relinearize : 0.0) << " windows/s" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/*
+	operator newの呼び出し回数を数えるための置き換え (計測用のプログラムで使用する)
+
+	置き換えたoperator newはプログラム全体で使用されるので、計測用のプログラムのmain()があるファイルで1度だけincludeすること。
+	src/以下のファイルからincludeすると、全てのプログラムで確保の度にカウンタを更新するようになる。
+*/
+namespace qs {
+	inline std::atomic<size_t> allocationCount{0};
+}
+
+void* operator new(size_t size) {
+	qs::allocationCount++;
+	if (void* ptr = std::malloc(size == 0 ? 1 : size)) { return ptr; }
+	throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
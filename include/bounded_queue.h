@@ -0,0 +1,86 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include <optional>
+#include <condition_variable>
+
+namespace qs {
+	/*
+		スレッド間で値を受け渡すための容量制限付きキュー
+
+		push()はキューが満杯の間ブロックし、pop()はキューが空の間ブロックする。
+		close()を呼ぶと待機中のスレッドは全て起こされ、以降のpush()は失敗する。
+		pop()はキューに残っている値を全て取り出した後にnulloptを返す。
+	*/
+	template<typename T>
+	struct BoundedQueue {
+		explicit BoundedQueue(size_t capacity = 1) : slots(capacity < 1 ? 1 : capacity) {}
+
+		bool push(T value) {
+			std::unique_lock<std::mutex> lock(mutex);
+			notFull.wait(lock, [this]() { return closed || count < slots.size(); });
+			if (closed) { return false; }
+			slots[(head + count) % slots.size()] = std::move(value);
+			count++;
+			notEmpty.notify_one();
+			return true;
+		}
+
+		// キューが満杯または閉じている場合は待機せずにfalseを返す
+		bool tryPush(T value) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (closed || slots.size() <= count) { return false; }
+			slots[(head + count) % slots.size()] = std::move(value);
+			count++;
+			notEmpty.notify_one();
+			return true;
+		}
+
+		std::optional<T> pop() {
+			std::unique_lock<std::mutex> lock(mutex);
+			notEmpty.wait(lock, [this]() { return closed || 0 < count; });
+			return take();
+		}
+
+		// 値を取り出せなければ待機せずにnulloptを返す
+		std::optional<T> tryPop() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return take();
+		}
+
+		void close() {
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			notEmpty.notify_all();
+			notFull.notify_all();
+		}
+
+		// キューを空にして再び使用できる状態に戻す
+		void reset(size_t newCapacity) {
+			std::lock_guard<std::mutex> lock(mutex);
+			slots.clear();
+			slots.resize(newCapacity < 1 ? 1 : newCapacity);
+			head = count = 0;
+			closed = false;
+		}
+
+	private:
+		// 定常状態でメモリの確保が発生しないよう、固定長のリングバッファで値を保持する
+		std::mutex mutex;
+		std::condition_variable notEmpty, notFull;
+		std::vector<std::optional<T>> slots;
+		size_t head = 0, count = 0;
+		bool closed = false;
+
+		// mutexをロックした状態で呼ぶこと
+		std::optional<T> take() {
+			if (0 == count) { return std::nullopt; }
+			std::optional<T> value = std::move(slots[head]);
+			slots[head].reset();
+			head = (head + 1) % slots.size();
+			count--;
+			notFull.notify_one();
+			return value;
+		}
+	};
+}
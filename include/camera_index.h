@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include "types.h"
+#include "sqlite_statement.h"
+
+namespace qs {
+	struct RecordingIndex;
+
+	/*
+		cameraテーブルをフレーム番号で検索するための索引
+
+		open()でフレーム番号からrowidへの対応表を作成し (RecordingIndexを渡した場合はその対応表を使用し)、
+		行の取得には準備済みのSQLをrowid指定で実行するため、1回の検索はキーの参照とほぼ同じコストになる。
+	*/
+	struct CameraIndex {
+		// connectionはcloseするまで有効である必要がある
+		bool open(const SqliteConnection& connection);
+		// 対応表を作成せずにindexのものを使用する (indexもcloseするまで有効である必要がある)
+		bool open(const SqliteConnection& connection, const RecordingIndex& index);
+		void close();
+		bool isOpened() const;
+
+		// フレーム番号に対応する行をrowに読み込む
+		// row内のBLOBは確保済みの領域を再利用して上書きされる
+		// fieldsで要求されなかったBLOBはコピーせず、以前の値が残る
+		bool fetch(uint64_t colorFrame, CameraForOrm& row, FieldMask fields = FIELD_ALL);
+
+		// フレーム番号に対応する行のrowidを返す
+		std::optional<int64_t> rowid(uint64_t colorFrame) const;
+
+	private:
+		SqliteStatement rowStatement;
+		const RecordingIndex* recordingIndex = nullptr;
+
+		// フレーム番号をインデックスとするrowidの配列 (行が存在しない場合は-1)
+		std::vector<int64_t> rowids;
+
+		// NULLだったBLOBの領域 (depth、confidence、3つの行列の順)
+		std::vector<char> spareBlobs[5];
+
+		bool prepareRowStatement(const SqliteConnection& connection);
+	};
+}
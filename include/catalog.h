@@ -0,0 +1,136 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <filesystem>
+#include "types.h"
+
+namespace qs {
+	// 緯度経度の範囲 (度単位、両端を含む)
+	struct GeoBox {
+		double minLatitude, maxLatitude;
+		double minLongitude, maxLongitude;
+	};
+
+	// カタログに登録された1つの録画の情報
+	struct CatalogEntry {
+		// 録画ディレクトリの絶対パス (UTF-8)
+		std::string path;
+
+		// descriptionテーブルの値
+		std::string date;
+		uint64_t colorWidth, colorHeight;
+		std::optional<uint64_t> depthWidth, depthHeight;
+		std::optional<uint64_t> confidenceWidth, confidenceHeight;
+
+		// フレーム数 (データベースに記録された最大のフレーム番号 + 1)
+		uint64_t frameCount;
+		// 最初と最後のフレームのタイムスタンプと、その差 (秒)
+		double startTimestamp, endTimestamp, duration;
+
+		// GPSの値が記録されている範囲 (hasGpsがfalseの場合は使用しない)
+		bool hasGps;
+		double minLatitude, maxLatitude;
+		double minLongitude, maxLongitude;
+
+		// 検査したときのdb.sqlite3のサイズと更新日時
+		int64_t dbSize, dbModified;
+		// 検査したときの録画のRecordingKey (-walにのみ書き込まれた行も反映される)
+		// dbSize、dbModifiedとともに変更されていなければ再度検査しない
+		std::vector<char> recordingKey;
+	};
+
+	// カタログの検索条件 (指定しなかった条件では絞り込まない)
+	struct CatalogQuery {
+		// GPSの範囲がこの範囲と交差する録画を返す (経度180度をまたぐ範囲には対応していない)
+		std::optional<GeoBox> area;
+
+		/*
+			録画の日付の範囲
+			QuadDumpの日付 ("2021-06-14_08-06-54") と文字列として比較し、dateToは前方一致で含める。
+			例えばdateFromに"2021-06"、dateToに"2021-07"を指定すると6月と7月の録画を返す。
+		*/
+		std::optional<std::string> dateFrom, dateTo;
+	};
+
+	// Catalog::scan()の結果
+	struct CatalogScanResult {
+		// 見つかった録画ディレクトリの数
+		size_t found = 0;
+		// 新たに検査して登録した数
+		size_t updated = 0;
+		// 前回から変更されていないため検査しなかった数
+		size_t unchanged = 0;
+		// descriptionが不正などの理由で登録しなかった数
+		size_t invalid = 0;
+		// ディレクトリが無くなったため登録を削除した数
+		size_t removed = 0;
+	};
+
+	inline auto makeCatalogStorage(const std::string& filepath) {
+		using namespace sqlite_orm;
+		return make_storage(filepath,
+			make_table("recording",
+				make_column("path", &CatalogEntry::path, primary_key()),
+				make_column("date", &CatalogEntry::date),
+				make_column("color_width", &CatalogEntry::colorWidth),
+				make_column("color_height", &CatalogEntry::colorHeight),
+				make_column("depth_width", &CatalogEntry::depthWidth),
+				make_column("depth_height", &CatalogEntry::depthHeight),
+				make_column("confidence_width", &CatalogEntry::confidenceWidth),
+				make_column("confidence_height", &CatalogEntry::confidenceHeight),
+				make_column("frame_count", &CatalogEntry::frameCount),
+				make_column("start_timestamp", &CatalogEntry::startTimestamp),
+				make_column("end_timestamp", &CatalogEntry::endTimestamp),
+				make_column("duration", &CatalogEntry::duration),
+				make_column("has_gps", &CatalogEntry::hasGps),
+				make_column("min_latitude", &CatalogEntry::minLatitude),
+				make_column("max_latitude", &CatalogEntry::maxLatitude),
+				make_column("min_longitude", &CatalogEntry::minLongitude),
+				make_column("max_longitude", &CatalogEntry::maxLongitude),
+				make_column("db_size", &CatalogEntry::dbSize),
+				make_column("db_modified", &CatalogEntry::dbModified),
+				make_column("recording_key", &CatalogEntry::recordingKey)
+			),
+			make_index("idx_recording_date", &CatalogEntry::date)
+		);
+	}
+	using CatalogStorage = decltype(makeCatalogStorage(std::declval<std::string>()));
+
+	/*
+		1つの録画ディレクトリを検査して情報を読み込む
+		データベースは読み込み専用で開き、索引を利用できる問い合わせのみを行うため、録画の長さによらず短時間で終わる。
+		descriptionの行が1行でない場合や、値が不正な場合はnulloptを返す。
+	*/
+	std::optional<CatalogEntry> inspectRecording(const std::filesystem::path& recDir);
+
+	/*
+		複数の録画の情報をまとめたデータベース
+
+		scan()で録画ディレクトリを探して登録し、find()で各録画を開かずに条件に合う録画を検索する。
+	*/
+	struct Catalog {
+		Catalog();
+		virtual ~Catalog();
+		void open(const std::filesystem::path& catalogPath);
+		void close();
+		bool isOpened() const;
+
+		/*
+			root以下を再帰的に探し、db.sqlite3とcamera.mp4を含むディレクトリを録画として登録する
+			録画の検査はworkers個のスレッドで並列に行う (0の場合はハードウェアのスレッド数)。
+			db.sqlite3と録画の内容 (RecordingKey) が前回の検査から変更されていない録画は検査しない。
+			root以下に登録されていたが見つからなくなった録画は登録を削除する。
+		*/
+		CatalogScanResult scan(const std::filesystem::path& root, size_t workers = 0);
+
+		// 条件に合う録画を日付順に返す
+		std::vector<CatalogEntry> find(const CatalogQuery& query = CatalogQuery());
+
+		const std::unique_ptr<CatalogStorage>& getStorage() const;
+
+	private:
+		std::unique_ptr<CatalogStorage> storagePtr;
+	};
+}
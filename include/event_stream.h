@@ -0,0 +1,103 @@
+#pragma once
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include "types.h"
+#include "sqlite_statement.h"
+
+namespace qs {
+	// EventStreamが返すイベントの種類
+	enum class EventType { CAMERA, IMU, GPS };
+
+	/*
+		カメラ、IMU、GPSのいずれか1つのイベント
+		typeに対応するフィールドのみが有効で、それ以外のフィールドの値は不定。
+		カメラのイベントは画像を含まないので、必要な場合はframeNumberをQuadLoader::frame()に渡して読み込むこと。
+	*/
+	struct SensorEvent {
+		EventType type;
+		double timestamp;
+		// CAMERA: 動画のフレーム番号
+		uint64_t frameNumber;
+		// IMU
+		Imu imu;
+		// GPS
+		Gps gps;
+	};
+
+	struct EventStreamOptions {
+		// 返すイベントの種類 (FIELD_CAMERAのいずれか、FIELD_IMU、FIELD_GPSの論理和)
+		FieldMask fields = FIELD_CAMERA | FIELD_IMU | FIELD_GPS;
+		// 各テーブルから一度に読み込む行数 (保持する行は最大でこの3倍になる)
+		size_t chunkRows = 4096;
+		// from <= timestamp <= to のイベントのみを返す (nulloptの場合は制限しない)
+		std::optional<double> from, to;
+	};
+
+	/*
+		カメラ、IMU、GPSのテーブルをタイムスタンプ順に1つの列として読み込む
+
+		各テーブルを前方にのみ進むカーソルでchunkRows行ずつ読み込み、各カーソルの先頭を比較して最も早いイベントを返す。
+		読み込みは直前に読んだ行の続きから索引を使って再開するので (OFFSETを使わない)、
+		録画の長さによらず1チャンクの読み込み時間とメモリ使用量は一定になる。
+		IMUとGPSは(timestamp, id)、カメラはcolor_frameの順に読む (カメラのタイムスタンプはフレーム番号順に増加する)。
+		IMUとGPSはidでも区切るので、同じタイムスタンプの行がチャンクの境界をまたいでも読み飛ばさない。
+		color_frameがNULLの行は返さない。
+		同じタイムスタンプのイベントはIMU、GPS、カメラの順に返す (カメラのフレームまでのセンサーの値を先に処理できるように)。
+	*/
+	struct EventStream {
+		EventStream();
+		virtual ~EventStream();
+		EventStream(const EventStream&) = delete;
+		EventStream& operator=(const EventStream&) = delete;
+
+		// データベースを読み込み専用で開く
+		void open(const std::filesystem::path& recDir, const EventStreamOptions& options = EventStreamOptions());
+		void close();
+		bool isOpened() const;
+
+		// 次のイベントをintoに書き込む。イベントが無いか、読み込みに失敗した場合はfalseを返す
+		bool next(SensorEvent& into);
+
+		// timestamp以降 (options.fromより前には戻らない) のイベントから読み込みを再開する
+		void seek(double timestamp);
+
+		// 読み込みに失敗したかどうか
+		bool failed() const;
+
+		// IMUとGPSのカーソルの位置 (この値より大きい(timestamp, id)の行を読む)
+		struct SensorKey {
+			double timestamp;
+			int64_t id;
+		};
+
+	private:
+		struct CameraRow {
+			uint64_t frameNumber;
+			double timestamp;
+		};
+
+		// 1つのテーブルを前方に読み進めるカーソル
+		template<typename T>
+		struct Cursor {
+			SqliteStatement statement;
+			std::vector<T> rows;
+			size_t position = 0;
+			bool enabled = false, exhausted = true;
+		};
+
+		SqliteConnection connection;
+		EventStreamOptions options;
+		Cursor<CameraRow> camera;
+		Cursor<Imu> imu;
+		Cursor<Gps> gps;
+		// 各カーソルが次に読み込む行の位置 (この値より大きいキーの行を読む)
+		int64_t cameraKey = -1;
+		SensorKey imuKey{}, gpsKey{};
+		bool error = false;
+
+		bool fillCamera();
+		bool fillImu();
+		bool fillGps();
+	};
+}
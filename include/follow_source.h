@@ -0,0 +1,97 @@
+#pragma once
+#include <mutex>
+#include <chrono>
+#include <filesystem>
+#include <condition_variable>
+#include "frame_source.h"
+#include "quad_loader.h"
+#include "recording_index.h"
+
+namespace qs {
+	// FollowSourceの設定
+	struct FollowOptions {
+		// ファイルが更新されたかを確認する間隔 (秒)
+		// 新しいフレームが書き込まれてからnext()が返すまでの遅延は、おおよそこの間隔と追記された行を読み込む時間の和になる
+		double pollInterval = 0.05;
+
+		// この時間 (秒) ファイルが更新されなければ録画が終了したとみなし、next()はfalseを返す
+		// 0以下の場合はstop()が呼ばれるまで待ち続ける
+		double idleTimeout = 10.0;
+
+		// フレームのタイムスタンプまでのIMUが書き込まれるのを待つ最大の時間 (秒)
+		// IMUはカメラの行と別に書き込まれるため、待たずに返すとそのフレームのIMUが欠ける場合がある
+		double imuWait = 0.5;
+
+		// IMUとGPSの索引が使用するメモリの上限 (バイト単位)
+		// 書き込み中の録画は全ての行を読み込まないよう、小さな値にしてチャンク単位で読み込む
+		size_t sensorMemoryLimit = 4 * 1024 * 1024;
+	};
+
+	/*
+		書き込み中の録画を追いかけて読み込むFrameSource
+
+		next()は書き込み済みのフレームを返し終えると、動画とデータベース(-walを含む)のサイズと更新日時を
+		pollInterval毎に確認しながら、新しいフレームが書き込まれるまで条件変数で待機する。
+		ファイルが更新されるとQuadLoader::refresh()で追記された行のみを索引に加え (動画は更新された場合のみ開き直す)、
+		次のフレームから読み込みを再開する。録画を開き直さないので、1回の更新にかかる時間は録画の長さによらない。
+
+		フレームはcameraテーブルの行と動画のフレームの両方が揃った時点で返す。
+		行が先に書き込まれた場合は動画が書き込まれるまで、動画が先の場合は行が書き込まれるまで待つ。
+		行の無いフレームは、それより後のフレームの行が書き込まれた時点で読み飛ばす。
+		GPSは待たずに、その時点で書き込まれている値を返す。
+
+		動画は書き込み中でも読み込める形式 (fragmented MP4や、書き込む度に置き換えられるファイル) である必要がある。
+		moovボックスが最後に書き込まれる通常のMP4の場合、録画が終了するまでフレームを返せない。
+	*/
+	struct FollowSource : FrameSource {
+		FollowSource();
+		virtual ~FollowSource();
+		FollowSource(const FollowSource&) = delete;
+		FollowSource& operator=(const FollowSource&) = delete;
+
+		// recDirにまだ録画が書き込まれていなくても開くことができる
+		void open(const std::filesystem::path& recDir, const FollowOptions& options = FollowOptions());
+		void close();
+		bool isOpened() const override;
+
+		// 次のフレームが書き込まれるまで待機する
+		// stop()が呼ばれた場合と、idleTimeoutの間ファイルが更新されなかった場合はfalseを返す
+		bool next(QuadFrame& into, FieldMask fields = FIELD_ALL) override;
+		void seek(uint64_t frameNumber) override;
+
+		// 現在までに書き込まれたフレーム数
+		uint64_t getFrameCount() const override;
+		// 録画を開けていない間は空の値を返す
+		const Description& getDescription() const override;
+
+		// 待機中のnext()を直ちに終了させる (他のスレッドから呼ぶことができる)
+		// 再び読み込む場合はopen()し直す
+		void stop();
+
+	private:
+		std::filesystem::path recDir;
+		FollowOptions options;
+		bool opened = false;
+		QuadLoader loader;
+		Description emptyDescription{};
+
+		// 次にnext()で返すフレーム番号
+		uint64_t nextFrame = 0;
+		// 開いている録画では次のフレームの動画を読み込めなかった
+		bool videoPending = false;
+
+		// 最後に確認したファイルの状態と、それが変化した時刻
+		RecordingStamp stamp{};
+		std::chrono::steady_clock::time_point lastChange;
+
+		std::mutex mutex;
+		std::condition_variable stopCondition;
+		bool stopped = false;
+
+		enum class WaitResult { CHANGED, UNCHANGED, STOPPED };
+		// pollIntervalだけ待機し、その間にファイルが更新されたかを返す
+		WaitResult wait();
+		// 追記された行を読み込む (まだ開けていない場合や、追記では表せない場合は開き直す)
+		void update();
+	};
+}
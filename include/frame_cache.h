@@ -0,0 +1,63 @@
+#pragma once
+#include <list>
+#include <unordered_map>
+#include "types.h"
+
+namespace qs {
+	/*
+		デコード済みのCameraをフレーム番号で保持するLRUキャッシュ
+
+		容量はエントリ数ではなく行列のバイト数で制限し、溢れた場合は最も長く使われていないエントリから破棄する。
+		cachedFieldsで保持するデータを限定できる (例えばFIELD_DEPTH | FIELD_MATRICESとするとデプスと姿勢のみを保持する)。
+		キャッシュは登録されたCameraの深いコピーを保持し、get()は呼び出し元の領域にコピーして返すため、
+		呼び出し元が取得した行列を書き換えてもキャッシュの内容は変化しない。
+		ただし展開を遅延している行列 (Camera::lazyDepthなど) は展開後に変更されないので共有する。
+		複数のスレッドから同時に使用しないこと。
+	*/
+	struct FrameCache {
+		FrameCache(size_t capacityBytes = 0, FieldMask cachedFields = FIELD_CAMERA);
+
+		// 容量を0にするとキャッシュは無効になる
+		void setCapacity(size_t capacityBytes);
+		void setCachedFields(FieldMask cachedFields);
+		size_t getCapacity() const;
+		FieldMask getCachedFields() const;
+		bool isEnabled() const;
+
+		/*
+			フレームがfieldsのデータを全て保持していればintoにコピーしてtrueを返す
+			intoのうちfieldsで要求されなかったデータは空になる
+		*/
+		bool get(uint64_t frameNumber, FieldMask fields, Camera& into);
+
+		// cameraのうちfieldsとcachedFieldsの両方に含まれるデータを登録する
+		void put(const Camera& camera, FieldMask fields);
+
+		void clear();
+
+		// 統計
+		uint64_t hits() const;
+		uint64_t misses() const;
+		size_t sizeBytes() const;
+		size_t entryCount() const;
+		void resetCounters();
+
+	private:
+		struct Entry {
+			uint64_t frameNumber;
+			Camera camera;
+			FieldMask fields;
+			size_t bytes;
+		};
+		std::list<Entry> entries;
+		std::unordered_map<uint64_t, std::list<Entry>::iterator> lookup;
+
+		size_t capacityBytes;
+		FieldMask cachedFields;
+		size_t usedBytes = 0;
+		uint64_t hitCount = 0, missCount = 0;
+
+		// 容量を超えている間、古いエントリを破棄する
+		void evict();
+	};
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <memory>
+#include <filesystem>
+#include "types.h"
+
+namespace qs {
+	/*
+		フレームを順に読み込むための共通のインターフェース
+
+		後段の処理はこのインターフェースに対して書き、録画の保存形式に依存しないようにする。
+		実装はQuadLoader (QuadDumpの録画)、PackedLoader (packed形式)、
+		ImageSequenceSource (画像の連番)、MemorySource (メモリ上のフレーム)、
+		FollowSource (書き込み中の録画) がある。
+	*/
+	struct FrameSource {
+		virtual ~FrameSource() {}
+
+		virtual bool isOpened() const = 0;
+
+		/*
+			intoが確保済みの領域を再利用して次のフレームを読み込む
+			fieldsで指定しなかったデータは空になる。次のフレームが存在しない場合はfalseを返す。
+
+			注意: PackedLoaderはカメラの行列にファイルを読み込み専用でマップした領域を直接指させる。
+			この行列に書き込むとセグメンテーション違反で終了するので、値を加工する場合は必ず別の行列に書き出すこと
+			(例えば cv::Mat depth = camera.depth * 0.1; とし、camera.depth *= 0.1; とはしない)。
+			他の実装はnext()の最初にこのような行列を解放するので (releaseBorrowedMats())、
+			PackedLoaderから受け取ったQuadFrameを他の実装のnext()に渡して再利用してもよい。
+		*/
+		virtual bool next(QuadFrame& into, FieldMask fields = FIELD_ALL) = 0;
+
+		// 指定したフレームから読み込みを再開する
+		virtual void seek(uint64_t frameNumber) = 0;
+
+		// 指定したフレームを読み込む (既定の実装はseek()とnext()を続けて呼ぶ)
+		virtual bool frame(uint64_t frameNumber, QuadFrame& into, FieldMask fields = FIELD_ALL);
+
+		virtual uint64_t getFrameCount() const = 0;
+		virtual const Description& getDescription() const = 0;
+	};
+
+	/*
+		参照カウントを持たない外部の領域を指す行列 (PackedLoaderがマップした読み込み専用の領域など) を解放する
+		行列を再利用するFrameSourceの実装はnext()の最初に呼び、
+		cv::Mat::create()が同じ大きさの外部の領域をそのまま使って書き込まないようにする。
+	*/
+	void releaseBorrowedMats(Camera& camera);
+
+	/*
+		録画の保存形式
+		AUTO          : ディレクトリの中身から判別する
+		                (packed.qspがあればPACKED、db.sqlite3があればQUADDUMP、それ以外はIMAGE_SEQUENCE)
+		QUADDUMP      : camera.mp4とdb.sqlite3
+		PACKED        : packed.qspとcamera.mp4
+		IMAGE_SEQUENCE: 画像の連番
+		FOLLOW        : 書き込み中のQuadDumpの録画 (FollowSourceで新しいフレームを待ちながら読み込む)
+	*/
+	enum class SourceType { AUTO, QUADDUMP, PACKED, IMAGE_SEQUENCE, FOLLOW };
+
+	// pathの録画を開く。開けなかった場合はnullptrを返す
+	std::unique_ptr<FrameSource> openFrameSource(const std::filesystem::path& path, SourceType type = SourceType::AUTO);
+}
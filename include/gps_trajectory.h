@@ -0,0 +1,118 @@
+#pragma once
+#include <vector>
+#include <optional>
+#include "types.h"
+
+namespace qs {
+	/*
+		GPSの値を列ごとの連続した配列で保持するコンテナ (ImuBatchのGPS版)
+		緯度と経度は度、高度はm、精度はm (負の値は無効な測位を表す)。
+	*/
+	struct GpsBatch {
+		std::vector<double> timestamp;
+		std::vector<double> latitude, longitude, altitude;
+		std::vector<double> horizontalAccuracy, verticalAccuracy;
+
+		size_t size() const;
+		bool empty() const;
+		void reserve(size_t capacity);
+		void resize(size_t size);
+		// 要素を削除する (確保済みの領域は解放しない)
+		void clear();
+
+		// Gpsの配列から変換する (確保済みの領域に収まる場合は再確保しない)
+		void assign(const Gps* first, const Gps* last);
+		void append(const Gps* first, const Gps* last);
+		void push_back(const Gps& gps);
+
+		// index番目の値をGpsとして返す (idは0になる)
+		Gps at(size_t index) const;
+	};
+
+	// WGS84楕円体
+	struct Wgs84 {
+		// 長半径 (m)
+		static constexpr double semiMajorAxis = 6378137.0;
+		// 扁平率
+		static constexpr double flattening = 1.0 / 298.257223563;
+		// 第一離心率の2乗
+		static constexpr double eccentricity2 = flattening * (2.0 - flattening);
+	};
+
+	// 緯度経度 (度) と楕円体高 (m) を地球中心地球固定座標 (ECEF、m) に変換する
+	cv::Vec3d geodeticToEcef(double latitude, double longitude, double altitude);
+	// GPSの列をまとめてECEFに変換する (三角関数以外はOpenCVのuniversal intrinsicsで一括処理する)
+	void geodeticToEcef(const GpsBatch& gps, Vec3Batch& ecef);
+
+	/*
+		ある地点を原点とする東-北-上 (ENU) の局所座標系
+
+		x軸が東、y軸が北、z軸が楕円体の法線方向の上向きで、単位はm。
+		原点から数十km以内では平面の地図として扱える。
+	*/
+	struct EnuFrame {
+		// 原点を緯度0度、経度0度、高度0mとする
+		EnuFrame();
+		EnuFrame(double latitude, double longitude, double altitude);
+
+		// 原点の緯度経度 (度) と高度 (m)
+		double getLatitude() const;
+		double getLongitude() const;
+		double getAltitude() const;
+
+		cv::Vec3d ecefToEnu(const cv::Vec3d& ecef) const;
+		cv::Vec3d geodeticToEnu(double latitude, double longitude, double altitude) const;
+
+		// 列をまとめて変換する (OpenCVのuniversal intrinsicsで一括処理する)
+		void ecefToEnu(const Vec3Batch& ecef, Vec3Batch& enu) const;
+		void geodeticToEnu(const GpsBatch& gps, Vec3Batch& enu) const;
+
+	private:
+		double latitude = 0.0, longitude = 0.0, altitude = 0.0;
+		// 原点のECEF座標と、ECEFからENUへの回転行列 (行優先)
+		double origin[3];
+		double rotation[9];
+	};
+
+	struct GpsTrajectoryOptions {
+		// ENUの原点の緯度、経度、高度 (nulloptの場合は最初の有効な測位を原点とする)
+		std::optional<cv::Vec3d> origin;
+		// 平滑化に使用するガウス窓の標準偏差 (秒)。前後3倍の時間に含まれる測位を使用する
+		double smoothingTime = 1.0;
+		// 精度の下限 (m)。精度が0に近い測位の重みが極端に大きくならないようにする
+		double minAccuracy = 0.5;
+	};
+
+	/*
+		カメラのフレームに揃えたGPSの軌跡
+
+		各配列はフレームと同じ長さで、i番目の値はtimestamp[i]の時刻の位置を表す。
+		positionはoriginを原点とするENU座標 (m) で、付近に有効な測位が無いフレームはvalidが0になる。
+		高度の測位が無い場合はz (上) を0とし、verticalAccuracyを負の値とする。
+	*/
+	struct GpsTrajectory {
+		EnuFrame origin;
+		std::vector<uint64_t> frameNumber;
+		std::vector<double> timestamp;
+		Vec3Batch position;
+		std::vector<double> horizontalAccuracy, verticalAccuracy;
+		std::vector<uint8_t> valid;
+
+		size_t size() const;
+		void clear();
+	};
+
+	/*
+		GPSの列から、昇順に並んだ各時刻の位置を精度で重み付けして平滑化したGPSの軌跡を作成する
+
+		各時刻の位置は、前後の有効な測位をENUに変換し、時間差のガウス関数と精度の2乗の逆数を掛けた重みで平均した値。
+		水平方向はhorizontalAccuracy、高さはverticalAccuracyで重み付けする。
+		平均した位置の精度は、各測位の誤差が独立であると仮定した値になる。
+		into.frameNumberは変更しないので、必要であれば呼び出し側で設定すること。
+		有効な測位が1つも無い場合はfalseを返す。
+	*/
+	bool buildGpsTrajectory(
+		const GpsBatch& gps, const std::vector<double>& timestamps,
+		const GpsTrajectoryOptions& options, GpsTrajectory& into
+	);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <filesystem>
+#include "frame_source.h"
+
+namespace qs {
+	/*
+		画像の連番を読み込むFrameSource
+
+		ディレクトリの構成
+		color/      カラー画像 (無い場合はディレクトリ直下の画像をカラー画像とする)
+		depth/      デプス (32bit浮動小数点のEXRかTIFFはメートル単位、16bitのPNGはミリメートル単位)
+		confidence/ 信頼度 (8bitのPNG)
+		timestamps.txt  1行に1フレームずつタイムスタンプを記述する (無い場合はフレーム番号 / fps)
+
+		フレームはカラー画像のファイル名の順に並べ、デプスと信頼度は拡張子を除いたファイル名で対応付ける。
+		行列、IMU、GPSは常に空になる。
+	*/
+	struct ImageSequenceSource : FrameSource {
+		ImageSequenceSource();
+		virtual ~ImageSequenceSource();
+		void open(const std::filesystem::path& dir, double fps = 30.0);
+		void close();
+		bool isOpened() const override;
+
+		bool next(QuadFrame& into, FieldMask fields = FIELD_ALL) override;
+		void seek(uint64_t frameNumber) override;
+		uint64_t getFrameCount() const override;
+		const Description& getDescription() const override;
+
+	private:
+		struct Entry {
+			std::filesystem::path color, depth, confidence;
+			double timestamp;
+		};
+		std::vector<Entry> entries;
+		Description description;
+		uint64_t nextFrameNumber = 0;
+	};
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <vector>
+#include <optional>
+#include "types.h"
+
+namespace qs {
+	/*
+		IMUのノイズ密度 (連続時間)
+		既定値はスマートフォンに搭載される程度のMEMS IMUを想定した値。
+	*/
+	struct ImuNoise {
+		// 角速度のノイズ密度 (rad/s/√Hz)
+		double gyroNoiseDensity = 1.7e-4;
+		// 加速度のノイズ密度 (m/s^2/√Hz)
+		double accelNoiseDensity = 2.0e-3;
+	};
+
+	/*
+		1つの区間のIMUを事前積分した結果
+
+		区間の始点のデバイス座標系で表した回転、速度、位置の変化量で、始点の状態によらない。
+		終点の状態は、始点の状態 (R_i, v_i, p_i) と世界座標系の重力加速度 g から次のように求まる。
+			R_j = R_i * deltaRotation
+			v_j = v_i + g * deltaTime + R_i * deltaVelocity
+			p_j = p_i + v_i * deltaTime + 0.5 * g * deltaTime^2 + R_i * deltaPosition
+		covarianceは [回転 (接空間), 速度, 位置] の順に並べた9x9の共分散行列。
+		各Jacobianは積分に使用したバイアス (accelBias, gyroBias) の周りでの変化量の偏微分。
+	*/
+	struct PreintegratedImu {
+		// 区間の始点と終点のタイムスタンプ、その差 (秒)
+		double startTime = 0.0, endTime = 0.0, deltaTime = 0.0;
+		// 積分に使用したIMUの値の数
+		size_t sampleCount = 0;
+
+		cv::Matx33d deltaRotation = cv::Matx33d::eye();
+		cv::Vec3d deltaVelocity = cv::Vec3d(0.0, 0.0, 0.0);
+		cv::Vec3d deltaPosition = cv::Vec3d(0.0, 0.0, 0.0);
+		cv::Matx99d covariance = cv::Matx99d::zeros();
+
+		cv::Matx33d rotationByGyroBias = cv::Matx33d::zeros();
+		cv::Matx33d velocityByAccelBias = cv::Matx33d::zeros();
+		cv::Matx33d velocityByGyroBias = cv::Matx33d::zeros();
+		cv::Matx33d positionByAccelBias = cv::Matx33d::zeros();
+		cv::Matx33d positionByGyroBias = cv::Matx33d::zeros();
+
+		// 積分に使用したバイアス (加速度はm/s^2、角速度はrad/s)
+		cv::Vec3d accelBias = cv::Vec3d(0.0, 0.0, 0.0);
+		cv::Vec3d gyroBias = cv::Vec3d(0.0, 0.0, 0.0);
+
+		/*
+			バイアスを変更した場合の変化量をJacobianによる1次近似で返す
+			バイアスの変化が小さい間は積分し直すより十分に速い。
+			変化が大きくなった場合はImuPreintegrator::integrate()で積分し直すこと。
+		*/
+		cv::Matx33d correctedRotation(const cv::Vec3d& newGyroBias) const;
+		cv::Vec3d correctedVelocity(const cv::Vec3d& newAccelBias, const cv::Vec3d& newGyroBias) const;
+		cv::Vec3d correctedPosition(const cv::Vec3d& newAccelBias, const cv::Vec3d& newGyroBias) const;
+	};
+
+	/*
+		カメラのフレーム間のIMUをまとめて事前積分する
+
+		addWindow()やaddFrame()で区間とIMUの値を登録し、integrate()で全ての区間を一度に積分する。
+		IMUの値は列ごとの配列 (ImuBatch) にまとめて保持するので、バイアスが変化した場合は
+		録画を読み直さずにintegrate()を再度呼ぶだけで全ての区間を積分し直せる。
+		積分は固定サイズの行列演算のみで行い、区間ごとのメモリの確保は発生しない。
+
+		加速度計の値 (比力) は (userAccleration - gravity) * 標準重力加速度 とする。
+		Core Motionのgravityは重力の向きを表すので、静止している場合は鉛直上向きに1Gとなる。
+		各IMUの値は次の値のタイムスタンプまで一定とし、区間の始点から最初の値までは最初の値、
+		最後の値から区間の終点までは最後の値を使用する。
+	*/
+	struct ImuPreintegrator {
+		ImuPreintegrator();
+		explicit ImuPreintegrator(const ImuNoise& noise);
+
+		void setNoise(const ImuNoise& noise);
+		const ImuNoise& getNoise() const;
+
+		// 区間とIMUの値を全て削除する (確保済みの領域は解放しない)
+		void clear();
+		void reserve(size_t windows, size_t samples);
+
+		/*
+			from < timestamp <= to の区間を登録し、区間の番号を返す
+			first, lastには区間に含まれるIMUの値をタイムスタンプ順に指定する。
+		*/
+		size_t addWindow(double from, double to, const Imu* first, const Imu* last);
+		size_t addWindow(double from, double to, const ImuBatch& samples);
+
+		/*
+			前回addFrame()に渡したフレームから、このフレームまでの区間を登録する
+			QuadFrame::imuBatchが空でなければimuBatchを、空ならimuを使用する。
+			最初のフレームの区間は最初のIMUの値から始まる。seekした場合はclear()を呼ぶこと。
+		*/
+		size_t addFrame(const QuadFrame& frame);
+
+		size_t size() const;
+
+		/*
+			全ての区間を指定したバイアスで積分する
+			バイアスは加速度がm/s^2、角速度がrad/sで、デバイス座標系で表す。
+		*/
+		void integrate(
+			const cv::Vec3d& accelBias = cv::Vec3d(0.0, 0.0, 0.0),
+			const cv::Vec3d& gyroBias = cv::Vec3d(0.0, 0.0, 0.0)
+		);
+
+		// index番目の区間の積分結果 (integrate()を呼ぶまでは単位元になる)
+		const PreintegratedImu& at(size_t index) const;
+		const std::vector<PreintegratedImu>& results() const;
+
+	private:
+		struct Window {
+			double from, to;
+			// samplesの中の範囲 [begin, end)
+			size_t begin, end;
+		};
+
+		ImuNoise noise;
+		ImuBatch samples;
+		std::vector<Window> windows;
+		std::vector<PreintegratedImu> preintegrated;
+		std::optional<double> lastFrameTimestamp;
+	};
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include <optional>
+#include "types.h"
+
+namespace qs {
+	// ローダーがある時刻のIMUを補間するときに、その前後の値を探す範囲 (秒)
+	constexpr double imuLookaround = 1.0;
+
+	/*
+		IMUの値を任意の時刻で補間する
+
+		gravity, userAccleration, rotationRateは前後の値を線形補間し、
+		attitudeは四元数に変換して球面線形補間 (slerp) した後、オイラー角 (ImuBatchと同じ定義) に戻す。
+		timestampsは昇順に並んでいること。最初の値より前と最後の値より後の時刻は、端の値をそのまま返す。
+		線形補間はOpenCVのuniversal intrinsicsで一括処理する。
+		intoの各列はtimestampsと同じ長さになり、intoのtimestampはtimestampsと同じ値になる。
+		samplesが空の場合、intoは空になる。
+	*/
+	void resampleImu(const ImuBatch& samples, const double* timestamps, size_t count, ImuBatch& into);
+	void resampleImu(const ImuBatch& samples, const std::vector<double>& timestamps, ImuBatch& into);
+
+	// before.timestamp <= timestamp <= after.timestamp の時刻の値を補間する (idは0になる)
+	Imu interpolateImu(const Imu& before, const Imu& after, double timestamp);
+
+	// beforeとafterの両方があれば補間し、片方しか無ければその値を時刻timestampの値として返す
+	std::optional<Imu> interpolateImu(const std::optional<Imu>& before, const std::optional<Imu>& after, double timestamp);
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <optional>
+#include <condition_variable>
+#include "types.h"
+
+namespace qs {
+	/*
+		zlib(raw deflate)で圧縮された行列を展開するクラス
+
+		z_streamを初回のみ初期化し、以降はinflateResetで使い回すため、
+		フレーム毎にinflateInit2とinflateEndを呼ぶ必要がない。
+	*/
+	struct Inflater {
+		Inflater();
+		~Inflater();
+		Inflater(const Inflater&) = delete;
+		Inflater& operator=(const Inflater&) = delete;
+
+		// srcを展開してdstに書き込む
+		// dstは解像度と型が一致する場合は再確保されない。OK以外を返した場合、dstは空になる
+		InflateStatus inflate(
+			const std::optional<std::vector<char>>& src,
+			const std::optional<uint64_t>& width, const std::optional<uint64_t>& height,
+			int type, cv::Mat& dst
+		);
+
+	private:
+		z_stream stream;
+		bool initialized = false;
+	};
+
+	/*
+		圧縮されたまま保持し、初めて参照したときに展開する行列
+
+		get()は最初の呼び出しでのみ展開し、以降は展開済みの行列を返す。
+		展開はスレッド毎に常駐するInflaterで行い、複数のスレッドから同時に呼んでもよい。
+		一度も参照されなかった場合は展開を行わない。
+	*/
+	struct LazyInflate {
+		// srcの内容をコピーして保持する (確保済みの領域は再利用される)
+		// 他のスレッドがget()を呼んでいる間に呼ばないこと
+		void assign(
+			const std::optional<std::vector<char>>& src,
+			const std::optional<uint64_t>& width, const std::optional<uint64_t>& height,
+			int type
+		);
+
+		const cv::Mat& get() const;
+		// 展開結果 (まだ展開していない場合は展開してから返す)
+		InflateStatus status() const;
+		bool isInflated() const;
+
+		// 圧縮されたデータと、展開後の行列を合わせたバイト数
+		size_t bytes() const;
+
+	private:
+		std::optional<std::vector<char>> src;
+		std::optional<uint64_t> width, height;
+		int type = 0;
+
+		mutable std::mutex mutex;
+		mutable std::atomic<bool> inflated{false};
+		mutable cv::Mat mat;
+		mutable InflateStatus inflateStatus = InflateStatus::DEFERRED;
+		void inflate() const;
+	};
+
+	/*
+		デプスと信頼度を並列に展開するクラス
+
+		デプスは呼び出し元のスレッドで、信頼度は常駐するワーカースレッドで同時に展開する。
+		1つのInflateEngineを複数のスレッドから同時に使用しないこと。
+	*/
+	struct InflateEngine {
+		InflateEngine();
+		~InflateEngine();
+		InflateEngine(const InflateEngine&) = delete;
+		InflateEngine& operator=(const InflateEngine&) = delete;
+
+		// rowのデプスと信頼度を展開してintoに書き込み、展開結果をinto.depthStatusとinto.confidenceStatusに設定する
+		// fieldsで要求されなかった方は展開せずに空にする (両方を要求した場合のみ並列に展開する)
+		void inflate(const CameraForOrm& row, const Description& description, Camera& into, FieldMask fields = FIELD_ALL);
+
+		// inflate()と同様だが、展開せずにinto.lazyDepthとinto.lazyConfidenceに圧縮されたまま保持する
+		// intoのLazyInflateを他に共有している者がいなければ、その領域を再利用する
+		void defer(const CameraForOrm& row, const Description& description, Camera& into, FieldMask fields = FIELD_ALL);
+
+		// falseを指定すると、ワーカースレッドを使わずに両方を呼び出し元のスレッドで展開する
+		// (呼び出し元が既に並列に動いている場合に、スレッドが余分に増えないようにする)
+		void setParallel(bool parallel);
+		bool getParallel() const;
+
+	private:
+		Inflater depthInflater, confidenceInflater;
+		bool parallel = true;
+
+		// ワーカースレッドに渡す処理
+		struct Job {
+			const std::optional<std::vector<char>>* src;
+			const std::optional<uint64_t>* width;
+			const std::optional<uint64_t>* height;
+			cv::Mat* dst;
+			InflateStatus* status;
+		};
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable jobReady, jobDone;
+		std::optional<Job> job;
+		bool quit = false;
+		void run();
+	};
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace qs {
+	/*
+		ファイル全体をメモリにマップするクラス
+
+		POSIXではmmap、WindowsではCreateFileMappingを使用する。
+		マップした領域はcloseするかデストラクタが呼ばれるまで有効である。
+		読み込み専用でマップするため、領域に書き込むとセグメンテーション違反になる
+		(書き込んだページが匿名メモリとして複製されたり、以降の読み込みで書き換えた値が返されたりしないようにする)。
+	*/
+	struct MappedFile {
+		MappedFile();
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::filesystem::path& path);
+		void close();
+		bool isOpened() const;
+
+		const uint8_t* data() const;
+		size_t size() const;
+
+		// offsetからsizeバイトがファイルに収まっていればその先頭を返し、収まらなければnullptrを返す
+		const uint8_t* at(uint64_t offset, uint64_t size) const;
+
+	private:
+		const uint8_t* mapped = nullptr;
+		size_t mappedSize = 0;
+#ifdef _WIN32
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#endif
+	};
+}
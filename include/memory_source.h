@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include "frame_source.h"
+
+namespace qs {
+	/*
+		メモリ上のフレームを返すFrameSource
+
+		push()で追加したフレームを追加した順に返す。後段の処理を録画ファイル無しで動作確認するために使用する。
+		next()はフレームの内容をintoにコピーするので、返したフレームを書き換えても保持している内容は変化しない。
+	*/
+	struct MemorySource : FrameSource {
+		MemorySource();
+		explicit MemorySource(const Description& description);
+		virtual ~MemorySource();
+
+		void setDescription(const Description& description);
+		void push(QuadFrame frame);
+		void clear();
+
+		// 常にtrueを返す
+		bool isOpened() const override;
+
+		bool next(QuadFrame& into, FieldMask fields = FIELD_ALL) override;
+		void seek(uint64_t frameNumber) override;
+		uint64_t getFrameCount() const override;
+		const Description& getDescription() const override;
+
+	private:
+		Description description;
+		std::vector<QuadFrame> frames;
+		uint64_t nextFrameNumber = 0;
+	};
+}
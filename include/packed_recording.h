@@ -0,0 +1,136 @@
+#pragma once
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <type_traits>
+#include "types.h"
+#include "frame_source.h"
+#include "mapped_file.h"
+#include "sensor_index.h"
+#include "gps_trajectory.h"
+
+namespace qs {
+	/*
+		メモリにマップしてそのまま読み込むための録画形式 (packed.qsp)
+
+		SQLiteとzlibを経由せずに繰り返し読み込めるよう、デプスと信頼度を展開済みの配列として保持する。
+		カラー画像は容量が大きいため含めず、これまで通り同じディレクトリのcamera.mp4から読み込む。
+
+		ファイルの構成 (数値は全て実行環境のバイトオーダーとレイアウト、各区画の先頭は64バイト境界)
+		PackedHeader
+		キーフレームのフレーム番号 (u64 * keyframeCount)
+		フレーム表 (PackedFrame * frameCount、フレーム番号順で行が無いフレームも含む)
+		デプスと信頼度の配列 (フレーム毎に連続)
+		IMU (Imu * imuCount、タイムスタンプ順)
+		GPS (Gps * gpsCount、タイムスタンプ順)
+	*/
+	struct PackedHeader {
+		char magic[4];
+		uint32_t version;
+		// 各構造体の大きさ (コンパイラやバージョンの異なる環境で作成されたファイルを検出する)
+		uint32_t headerSize, frameSize, imuSize, gpsSize;
+		char date[64];
+		uint64_t colorWidth, colorHeight;
+		// 0の場合はデプスまたは信頼度が記録されていない
+		uint64_t depthWidth, depthHeight;
+		uint64_t confidenceWidth, confidenceHeight;
+		uint64_t keyframeCount, keyframeOffset;
+		uint64_t frameCount, frameOffset;
+		uint64_t imuCount, imuOffset;
+		uint64_t gpsCount, gpsOffset;
+		// 変換元のcamera.mp4のファイルサイズ (別の動画と組み合わせていないかを確認する)
+		uint64_t videoSize;
+	};
+
+	struct PackedFrame {
+		double timestamp;
+		// デプスと信頼度の配列のファイル先頭からの位置 (0の場合は無い)
+		uint64_t depthOffset;
+		uint64_t confidenceOffset;
+		// データベースに行が存在するかどうか
+		uint8_t present;
+		// 変換時の展開結果 (InflateStatus)
+		uint8_t depthStatus;
+		uint8_t confidenceStatus;
+		uint8_t hasMatrices;
+		uint32_t reserved;
+		float intrinsics[9];
+		float projection[16];
+		float view[16];
+	};
+
+	static_assert(std::is_trivially_copyable<PackedFrame>::value, "PackedFrame must be trivially copyable");
+	static_assert(std::is_trivially_copyable<Imu>::value && std::is_trivially_copyable<Gps>::value, "Imu and Gps must be trivially copyable");
+
+	/*
+		QuadDumpの録画をpacked形式に変換する
+		outputPathを省略した場合はrecDir/packed.qspに書き出す。
+	*/
+	bool convertToPacked(const std::filesystem::path& recDir, const std::filesystem::path& outputPath = {});
+
+	/*
+		packed形式の録画を読み込むクラス
+
+		デプス、信頼度、行列はマップした領域を直接指すcv::Matとして返すため、コピーと展開が発生しない。
+		これらの行列はcloseするまで有効で、読み込み専用でマップした領域を指すので書き換えてはならない
+		(書き換えるとセグメンテーション違反になる)。加工する場合はconvertTo()などで別の行列に書き出すこと。
+		IMUとGPSはimuSlice()とgpsSlice()で取得するとコピーせずにマップした領域を参照できる。
+		QuadLoaderと異なり、データベースに行が無いフレームはnext()で読み飛ばす。
+	*/
+	struct PackedLoader : FrameSource {
+		PackedLoader();
+		virtual ~PackedLoader();
+
+		// recDir/packed.qspとrecDir/camera.mp4を開く
+		void open(const std::filesystem::path& recDir);
+		void open(const std::filesystem::path& recDir, const std::filesystem::path& packedPath);
+		void close();
+		bool isOpened() const override;
+
+		std::optional<QuadFrame> next(FieldMask fields = FIELD_ALL);
+		bool next(QuadFrame& into, FieldMask fields = FIELD_ALL) override;
+		void seek(uint64_t frameNumber) override;
+		std::optional<QuadFrame> frame(uint64_t frameNumber, FieldMask fields = FIELD_ALL);
+		bool frame(uint64_t frameNumber, QuadFrame& into, FieldMask fields = FIELD_ALL) override;
+
+		uint64_t getFrameCount() const override;
+		const Description& getDescription() const override;
+
+		// from < timestamp <= to を満たすIMUとGPSの値を返す (マップした領域を指す)
+		SensorSpan<Imu> imuSlice(double from, double to) const;
+		SensorSpan<Gps> gpsSlice(double from, double to) const;
+
+		// from < timestamp <= to を満たすIMUの値をintoに列ごとの配列として書き込む
+		void imuBatch(double from, double to, ImuBatch& into) const;
+
+		// 昇順に並んだ各時刻にIMUの値を補間してintoに書き込む (QuadLoader::resampleImu()と同じ)
+		void resampleImu(const std::vector<double>& timestamps, ImuBatch& into) const;
+
+		// from < timestamp <= to を満たすGPSの値をintoに列ごとの配列として書き込む
+		void gpsBatch(double from, double to, GpsBatch& into) const;
+
+		// カメラのタイムスタンプに揃えたGPSの軌跡を作成する (QuadLoader::gpsTrajectory()と同じ)
+		bool gpsTrajectory(GpsTrajectory& into, const GpsTrajectoryOptions& options = GpsTrajectoryOptions()) const;
+
+	private:
+		MappedFile file;
+		Description description;
+		const PackedHeader* header = nullptr;
+		const uint64_t* keyframes = nullptr;
+		const PackedFrame* frames = nullptr;
+		const Imu* imu = nullptr;
+		const Gps* gps = nullptr;
+
+		cv::VideoCapture video;
+		// 次にnext()で返すフレーム番号
+		uint64_t nextFrameNumber = 0;
+		// 動画が次にデコードするフレーム番号
+		uint64_t videoFrame = 0;
+		double preTimestamp = 0.0;
+
+		bool readColor(uint64_t colorFrame, cv::Mat& color);
+		void decode(uint64_t frameNumber, QuadFrame& into, FieldMask fields);
+		// timestampの時刻に補間したIMUの値
+		std::optional<Imu> imuAt(double timestamp) const;
+	};
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <filesystem>
+#include <condition_variable>
+#include "types.h"
+#include "bounded_queue.h"
+#include "quad_loader.h"
+
+namespace qs {
+	/*
+		録画全体を複数のスレッドで並列に読み込むためのクラス
+
+		録画をchunkFramesフレーム毎の区間に分割し、各ワーカーは自身のQuadLoader
+		(VideoCaptureとSQLiteの接続をそれぞれ独立に持つ) で区間の先頭へシークしてから順に読み込む。
+		区間は空いたワーカーから順に割り当てるため、区間毎の処理時間に差があっても偏りが生じにくい。
+		ワーカー自体が並列に動くので、各ワーカーはデプスと信頼度を自身のスレッドのみで展開し、
+		IMUとGPSの索引にはsensorMemoryLimitをワーカー数で割った上限を設定する。
+
+		next()はフレームをフレーム番号順に返す。ワーカーは区間毎のキューにフレームを書き込み、
+		呼び出し元はまだ返していない最も若い区間のキューから取り出す (並べ替えバッファ)。
+		各キューの容量はqueueDepthなので、保持されるフレームは最大でworkers * queueDepth程度になる。
+		順序が不要な場合はforEach()を使用すると、ワーカーのスレッドから直接コールバックが呼ばれる。
+
+		データベースから読み込めないフレームは読み飛ばされる。
+	*/
+	struct ParallelReader {
+		struct Options {
+			// ワーカーのスレッド数 (0の場合はCPUのコア数)
+			size_t workers = 0;
+			// 1つのワーカーが連続して読み込むフレーム数
+			// (区間の先頭ではキーフレームからデコードし直すため、GOPより十分長くすること)
+			uint64_t chunkFrames = 256;
+			// 区間毎のキューの容量
+			size_t queueDepth = 4;
+			// 読み込むデータ
+			FieldMask fields = FIELD_ALL;
+			// 最初のワーカーがファイルを開く方法 (他のワーカーは常にREAD_ONLYで開く)
+			// READ_WRITEの場合は最初のワーカーが作成したキーフレームの索引を他のワーカーが共有できる
+			OpenMode mode = OpenMode::READ_WRITE;
+			// 全てのワーカーのIMUとGPSの索引が使用するメモリの上限 (ワーカー数で等分する)
+			size_t sensorMemoryLimit = SensorIndex::defaultMemoryLimit;
+		};
+
+		ParallelReader();
+		virtual ~ParallelReader();
+		void open(const std::filesystem::path& recDir, const Options& options);
+		void open(const std::filesystem::path& recDir);
+		void close();
+		bool isOpened() const;
+
+		// フレーム数 (データベースに記録された最大のフレーム番号 + 1)
+		uint64_t getFrameCount() const;
+		size_t getWorkers() const;
+
+		/*
+			次のフレームをフレーム番号順に読み込む
+			intoが確保済みの領域はワーカーで再利用される。
+			全てのフレームを返した場合はfalseを返す。
+		*/
+		bool next(QuadFrame& into);
+
+		/*
+			全てのフレームを順不同で読み込み、ワーカーのスレッドからcallbackを呼ぶ
+			callbackは複数のスレッドから同時に呼ばれるので、スレッドセーフにすること。
+			callbackに渡したフレームの領域は、そのワーカーの次のフレームで再利用される。
+			全てのフレームを処理し終えるまでブロックする。next()で読み込み中の場合は中断して最初から読み込む。
+		*/
+		bool forEach(const std::function<void(QuadFrame&)>& callback);
+
+		// next()による読み込みを中断し、次のnext()で先頭から読み込み直す
+		void rewind();
+
+	private:
+		Options options;
+		std::vector<std::unique_ptr<QuadLoader>> loaders;
+		uint64_t frameCount = 0;
+		uint64_t chunkCount = 0;
+
+		// 区間の割り当て
+		std::mutex mutex;
+		std::condition_variable chunkAdded;
+		uint64_t nextChunk = 0;
+		std::atomic<bool> stopping{false};
+
+		// next()で使用する並べ替えバッファ (区間の番号 -> その区間のフレームを受け渡すキュー)
+		std::map<uint64_t, std::shared_ptr<BoundedQueue<QuadFrame>>> chunkQueues;
+		uint64_t consumeChunk = 0;
+		bool running = false;
+		// 使い終わった領域をワーカーに返すためのキュー
+		BoundedQueue<QuadFrame> freeFrames;
+		std::vector<std::thread> threads;
+
+		// 次に読み込む区間を割り当てる (全て割り当て済みの場合はfalse)
+		bool takeChunk(uint64_t& chunk, uint64_t& first, uint64_t& last);
+		void startOrdered();
+		void stopWorkers();
+	};
+}
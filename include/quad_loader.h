@@ -1,27 +1,248 @@
 #pragma once
 #include <optional>
 #include <filesystem>
+#include <thread>
 #include "types.h"
+#include "frame_source.h"
+#include "bounded_queue.h"
+#include "sensor_index.h"
+#include "camera_index.h"
+#include "inflate_engine.h"
+#include "recording_index.h"
+#include "frame_cache.h"
+#include "imu_resampler.h"
+#include "gps_trajectory.h"
 #include "opencv2/opencv.hpp"
 #include "opencv2/videoio.hpp"
 #include "qs_zlib/zlib.h"
 
 namespace qs {
-	struct QuadLoader {
+	/*
+		ファイルを開く方法
+		READ_WRITE: スキーマを同期する (古い録画のデータベースは書き換えられる場合がある)
+		READ_ONLY : データベースに一切書き込まない。スキーマは同期せずに検査のみ行い、
+		            mmapとページキャッシュを有効にして読み込む。アーカイブされた録画を開く場合に使用する。
+		            IMUとGPSは開く時点では読み込まず、要求された区間を含むチャンクのみを読み込む。
+		            読み込み専用のネットワークドライブなど-shmファイルを作成できない場所にあるWALモードのデータベースは
+		            immutableで開く (SqliteConnection::openReadOnly()を参照)。この場合-walファイルの内容は読まない。
+	*/
+	enum class OpenMode { READ_WRITE, READ_ONLY };
+
+	// QuadDumpの録画 (camera.mp4とdb.sqlite3) を読み込むFrameSource
+	struct QuadLoader : FrameSource {
 		QuadLoader();
 		virtual ~QuadLoader();
-		void open(const std::filesystem::path& recDir);
+
+		/*
+			録画を開く
+			READ_WRITEの場合は索引をdb.sqlite3.qsidxに保存し、次回以降はそれを読み込むことで開く処理を短縮する。
+			索引が古いか壊れている場合は自動的に作成し直す。
+		*/
+		void open(const std::filesystem::path& recDir, OpenMode mode = OpenMode::READ_WRITE);
 		void close();
-		bool isOpened() const;
+		bool isOpened() const override;
 		std::optional<QuadFrame> next(bool withImu = true, bool withGps = true);
-		void seek(const uint64_t frameNumber);
+
+		/*
+			intoが確保済みの領域を再利用して次のフレームを読み込む
+			解像度が変わらない限り、定常状態ではフレーム毎のメモリの確保が発生しない。
+			intoの行列を浅いコピーで保持していた場合、その内容は上書きされるので注意すること。
+			次のフレームが存在しない場合はfalseを返す。
+		*/
+		bool next(QuadFrame& into, bool withImu = true, bool withGps = true);
+
+		/*
+			fieldsで指定したデータのみを読み込む
+			例えばFIELD_MATRICESのみを指定した場合、動画のデコードとzlibの展開を行わずに姿勢だけを取得できる。
+			指定しなかったデータは空になる。
+		*/
+		std::optional<QuadFrame> next(FieldMask fields);
+		bool next(QuadFrame& into, FieldMask fields) override;
+
+		/*
+			指定したフレームから読み込みを再開する
+			動画は目的のフレームの直前にあるキーフレームへシークし、そこから目的のフレームまでデコードする。
+		*/
+		void seek(const uint64_t frameNumber) override;
+
+		/*
+			指定したフレームを読み込む (seek()とnext()を続けて呼ぶのと同じ)
+			IMUとGPSは1つ前のフレームからframeNumberまでの値が返される。
+		*/
+		std::optional<QuadFrame> frame(uint64_t frameNumber, FieldMask fields = FIELD_ALL);
+		bool frame(uint64_t frameNumber, QuadFrame& into, FieldMask fields = FIELD_ALL) override;
+
+		// フレーム数 (データベースに記録された最大のフレーム番号 + 1)
+		uint64_t getFrameCount() const override;
+		const Description& getDescription() const override;
+
+		// sqlite_ormのストレージ (READ_ONLYで開いた場合はデータベースに書き込まないようにnullptrになる)
 		const std::unique_ptr<QSStorage>& getStorage() const;
 
+		// open()で読み込んだ索引 (フレーム毎のタイムスタンプやIMUとGPSの範囲を参照できる)
+		const RecordingIndex& getRecordingIndex() const;
+
+		/*
+			書き込み中の録画に追記されたフレームとIMU、GPSを読み込めるようにする
+			開き直す場合と異なり、索引には追記された行のみを加え、動画は更新されている場合にのみ開き直す。
+			処理時間は追記された行数に比例し、録画の長さによらない。
+			失敗した場合はfalseを返す (ローダーは閉じられている場合がある)。
+		*/
+		bool refresh();
+
+		/*
+			間引き再生の設定
+			strideに2以上を指定すると、next()はstrideフレーム毎にしかフレームを返さなくなる。
+			読み飛ばしたフレームは動画をgrab()で進めるのみで、BLOBの読み込みとzlibの展開は行わない。
+			IMUとGPSは前回返したフレームからの全ての値が返されるので、読み飛ばした区間の値も失われない。
+			変更は次に返すフレームの、さらに次のフレームから反映される。
+		*/
+		void setStride(uint64_t stride);
+		uint64_t getStride() const;
+
+		/*
+			先読みの設定
+			depthに1以上を指定すると、バックグラウンドスレッドが最大depthフレーム先までデコードしておく。
+			動画のデコードとデータベースの読み込み(zlibの展開を含む)は別々のスレッドで行われるため、
+			next()の処理時間は各段の合計ではなく、最も遅い段の処理時間で律速される。
+			0を指定すると先読みを無効にする。
+			先読み中はgetStorage()で取得したストレージを他のスレッドから同時に使用しないこと。
+		*/
+		void setPrefetch(size_t depth);
+		size_t getPrefetch() const;
+
+		/*
+			IMUとGPSの索引が使用するメモリの上限 (バイト単位、IMUとGPSそれぞれに適用)
+			open()の前に設定する。上限に収まらない長い録画ではチャンク単位で読み込む。
+		*/
+		void setSensorMemoryLimit(size_t bytes);
+
+		/*
+			デプスと信頼度の展開を遅延させる設定
+			trueを指定すると、next()はデプスと信頼度を圧縮されたまま返し、
+			Camera::getDepth()とCamera::getConfidence()で初めて参照したときに展開する。
+			このときcamera.depthとcamera.confidenceは空になるので、必ずgetDepth()などを使用すること。
+			参照せずに捨てたフレームは展開の処理時間がかからない。
+		*/
+		void setLazyInflate(bool lazy);
+		bool getLazyInflate() const;
+
+		/*
+			デプスと信頼度を並列に展開する設定 (既定はtrue)
+			trueの場合は信頼度を常駐するワーカースレッドで展開する。
+			複数のローダーを別々のスレッドで動かす場合は、falseを指定してスレッドが増えないようにするとよい。
+		*/
+		void setParallelInflate(bool parallel);
+		bool getParallelInflate() const;
+
+		/*
+			from < timestamp <= to を満たすIMUとGPSの値を返す
+			返り値はローダー内部の配列を指しており、メモリの確保は発生しない。
+			チャンク単位で読み込んでいる場合、返り値は次の呼び出しまでしか有効でない。
+			先読み中は使用しないこと。
+		*/
+		SensorSpan<Imu> imuSlice(double from, double to);
+		SensorSpan<Gps> gpsSlice(double from, double to);
+
+		/*
+			from < timestamp <= to を満たすIMUの値をintoに列ごとの配列として書き込む
+			imuSlice()と異なり、チャンク単位で読み込んでいる場合も範囲全体を返す。
+			intoの領域は再利用されるので、同じintoを使い回せばメモリの確保は最初の数回のみとなる。
+			先読み中に呼ぶと先読みを止め、次のnext()でまだ返していないフレームから読み込みをやり直す。
+		*/
+		void imuBatch(double from, double to, ImuBatch& into);
+
+		/*
+			昇順に並んだ各時刻にIMUの値を補間してintoに書き込む (補間の方法はresampleImu()を参照)
+			最初と最後の時刻の前後imuLookaround秒を含む範囲のIMUをまとめて読み込んでから補間するので、
+			カメラの全てのフレームのタイムスタンプのように録画全体にわたる時刻を一度に指定できる。
+			この範囲にIMUが無い場合、intoは空になる。先読み中に呼んだ場合はimuBatch()と同様に先読みを止める。
+		*/
+		void resampleImu(const std::vector<double>& timestamps, ImuBatch& into);
+
+		/*
+			from < timestamp <= to を満たすGPSの値をintoに列ごとの配列として書き込む (範囲全体を返す)
+			imuBatch()と同様に、先読み中に呼ぶと先読みを止める。
+		*/
+		void gpsBatch(double from, double to, GpsBatch& into);
+
+		/*
+			行の存在する全てのフレームについて、カメラのタイムスタンプに揃えたGPSの軌跡を作成する
+			into.frameNumberには各値のフレーム番号が入る。有効な測位が無い場合はfalseを返す。
+			GPSはgpsBatch()で読み込むので、先読み中に呼ぶと先読みを止める。
+		*/
+		bool gpsTrajectory(GpsTrajectory& into, const GpsTrajectoryOptions& options = GpsTrajectoryOptions());
+
+		/*
+			デコード済みフレームのキャッシュの設定
+			bytesに1以上を指定すると、next()とframe()でデコードしたフレームのうちcachedFieldsのデータを
+			合計bytesバイトまで保持し、同じフレームを再び要求されたときに動画のデコードとzlibの展開を省略する。
+			メモリが限られる場合はFIELD_DEPTH | FIELD_MATRICESのようにデプスと姿勢のみを保持するとよい。
+			キャッシュは先読みが無効な場合にのみ使用され、open()とclose()で破棄される。
+		*/
+		void setFrameCache(size_t bytes, FieldMask cachedFields = FIELD_CAMERA);
+		const FrameCache& getFrameCache() const;
+
 	private:
+		std::filesystem::path recDir;
 		Description description;
 		cv::VideoCapture video;
 		std::unique_ptr<QSStorage> storagePtr;
+		SqliteConnection connection;
+		SensorIndex sensorIndex;
+		CameraIndex cameraIndex;
+		RecordingIndex recordingIndex;
+
+		// データベースから読み込んだ行 (BLOBの領域をフレーム間で再利用する)
+		CameraForOrm cameraRow;
+		InflateEngine inflateEngine;
+		bool lazyInflate = false;
+		size_t sensorMemoryLimit = SensorIndex::defaultMemoryLimit;
+
+		FrameCache frameCache;
 
+		// 次にデコードするフレームのIMUとGPSを取得する区間の始点 (先読み中は先読みしたフレームまで進む)
 		double preTimestamp;
+		// next()で最後に返したフレームのタイムスタンプ (先読みをやり直すときにpreTimestampをこの値に戻す)
+		double returnedTimestamp = 0.0;
+
+		// 次にnext()で返すフレーム番号
+		uint64_t nextFrameNumber = 0;
+		uint64_t stride = 1;
+		// 動画が次にデコードするフレーム番号
+		uint64_t videoFrame = 0;
+		// キーフレームの情報が無い動画で、位置をこのフレーム数以内で進める場合はシークせずにgrab()で読み飛ばす
+		static constexpr uint64_t maxGrabFrames = 64;
+
+		// 動画から指定したフレームを読み込む
+		bool readColor(uint64_t colorFrame, cv::Mat& color);
+		// 指定したフレームに対応するデータをデータベースから取得してintoに書き込む
+		// FIELD_COLORを指定した場合、into.camera.colorには読み込み済みのフレームが入っている必要がある
+		bool decode(uint64_t colorFrame, QuadFrame& into, FieldMask fields);
+		// 前回のフレームからinto.camera.timestampまでのIMUとGPSをintoに書き込む
+		void decodeSensors(QuadFrame& into, FieldMask fields);
+		// timestampの時刻に補間したIMUの値
+		std::optional<Imu> imuAt(double timestamp);
+
+		// 先読み
+		struct ColorFrame {
+			uint64_t colorFrame;
+			cv::Mat color;
+		};
+		size_t prefetchDepth = 0;
+		bool prefetching = false;
+		FieldMask prefetchFields = FIELD_ALL;
+		uint64_t prefetchStride = 1;
+		BoundedQueue<ColorFrame> colorQueue;
+		BoundedQueue<QuadFrame> frameQueue;
+		// 使い終わった領域を先読みスレッドに返すためのキュー
+		BoundedQueue<cv::Mat> freeColors;
+		BoundedQueue<QuadFrame> freeFrames;
+		std::thread videoThread, decodeThread;
+		void startPrefetch(FieldMask fields);
+		void stopPrefetch();
+		// 先読み中のフレームを破棄し、まだnext()で返していないフレームから読み込みをやり直す
+		// (seek()と異なり、IMUとGPSは最後に返したフレームからの値が返される)
+		void restartPrefetch();
 	};
 }
@@ -0,0 +1,132 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <stdint.h>
+#include "types.h"
+#include "mapped_file.h"
+#include "sensor_index.h"
+#include "sqlite_statement.h"
+
+namespace qs {
+	/*
+		MP4ファイルの映像トラックからキーフレーム(同期サンプル)のフレーム番号を読み込む
+
+		moov/trak/mdia/minf/stbl/stssを解析する。stssが存在しない場合は全てのフレームがキーフレームである。
+		フレーム番号は0から始まる。解析に失敗した場合はfalseを返す。
+	*/
+	bool readMp4Keyframes(const std::filesystem::path& videoPath, std::vector<uint64_t>& keyframes);
+
+	/*
+		動画、データベース、-walファイルのサイズと更新日時 (ファイルが無い場合は-1)
+		録画が更新されたかどうかを確認するために使用する。
+		-walファイルは接続を開くと空のファイルが作成され、最後の接続を閉じると削除されるので、
+		無い場合と空の場合はどちらもサイズと更新日時を0とする。
+	*/
+	using RecordingStamp = std::array<int64_t, 6>;
+	RecordingStamp readRecordingStamp(const std::filesystem::path& recDir);
+
+	/*
+		索引が録画の内容と一致するかどうかを確認するための値
+		動画のサイズと更新日時、データベースのスキーマのバージョン、camera、imu、gpsテーブルの最大のrowid。
+		データベースはファイルの状態ではなく内容から求めるため、チェックポイントでWALの内容が
+		データベースのファイルに移されても値は変わらない (録画は行を追記するのみなので、行が増えれば最大のrowidが変わる)。
+		問い合わせは全てrowidとスキーマの参照なので、行数によらずほぼ一定の時間で終わる。
+	*/
+	using RecordingKey = std::array<int64_t, 6>;
+	bool readRecordingKey(const std::filesystem::path& recDir, const SqliteConnection& connection, RecordingKey& key);
+
+	/*
+		録画を開くために必要な情報をまとめた索引 (db.sqlite3.qsidx)
+
+		録画の説明、フレーム番号からrowidとタイムスタンプへの対応表、動画のキーフレームの一覧、
+		IMUとGPSの行数とタイムスタンプの範囲を保持する。
+		データベースの隣に保存しておき、次回以降はファイル全体を1回mmapするだけで読み込むため、
+		スキーマの同期、説明の取得、テーブルの全件走査を省略できる。
+		RecordingKeyが保存時と異なる場合や、チェックサムが一致しない場合、load()は失敗するので、build()で作成し直すこと。
+	*/
+	struct RecordingIndex {
+		RecordingIndex() = default;
+		RecordingIndex(const RecordingIndex&) = delete;
+		RecordingIndex& operator=(const RecordingIndex&) = delete;
+
+		// 索引ファイルの名前 (データベースと同じディレクトリに置く)
+		static constexpr const char* fileName = "db.sqlite3.qsidx";
+
+		// 保存された索引を読み込む。存在しないか古い、または壊れている場合はfalseを返す
+		// (connectionは録画が更新されたかどうかの確認にのみ使用する)
+		bool load(const std::filesystem::path& recDir, const SqliteConnection& connection);
+
+		// 動画とデータベースから索引を作成する
+		// スキーマを同期する場合は、同期した後に呼ぶこと (同期による更新で索引が古くならないように)
+		bool build(const std::filesystem::path& recDir, const SqliteConnection& connection, const Description& description);
+
+		/*
+			書き込み中の録画に追記された行を索引に加える
+			前回までに読み込んだ行より大きいrowidの行のみを問い合わせるので、処理時間は追記された行数に比例し、録画の長さによらない。
+			動画が更新された場合はキーフレームを読み直し、videoChangedをtrueにする。
+			スキーマが変わったなど追記では表せない場合はbuild()で作成し直す (このときもvideoChangedはtrueになる)。
+		*/
+		bool extend(const std::filesystem::path& recDir, const SqliteConnection& connection, bool& videoChanged);
+
+		// 作成した索引を保存する (保存に失敗しても索引は使用できる)
+		bool save(const std::filesystem::path& recDir) const;
+
+		void close();
+		bool isOpened() const;
+
+		// 索引ファイルから読み込んだかどうか (falseの場合はbuild()で作成したか、extend()で追記した)
+		bool isLoaded() const;
+
+		const Description& description() const;
+
+		// フレーム数 (データベースに記録された最大のフレーム番号 + 1)
+		uint64_t frameCount() const;
+
+		// フレーム番号に対応する行のrowid
+		std::optional<int64_t> rowid(uint64_t frameNumber) const;
+
+		// フレーム番号に対応するタイムスタンプ
+		std::optional<double> timestamp(uint64_t frameNumber) const;
+
+		// frameNumberより前に存在する最後のフレームのタイムスタンプ
+		std::optional<double> previousTimestamp(uint64_t frameNumber) const;
+
+		// frameNumber以前で最も近いキーフレーム (キーフレームの情報が無い場合はnullopt)
+		std::optional<uint64_t> keyframeBefore(uint64_t frameNumber) const;
+
+		// IMUとGPSの行数とタイムスタンプの範囲
+		const SensorBounds& imuBounds() const;
+		const SensorBounds& gpsBounds() const;
+
+		// フレーム表の1行 (索引ファイルと同じ形式)
+		struct IndexFrame {
+			// 行が存在しない場合は-1
+			int64_t rowid;
+			// 行が存在しない場合はNaN
+			double timestamp;
+		};
+
+	private:
+		// フレーム表とキーフレームの一覧 (load()ではマップした領域、build()とextend()ではframeListとkeyframeListを指す)
+		MappedFile file;
+		std::vector<IndexFrame> frameList;
+		std::vector<uint64_t> keyframeList;
+		const IndexFrame* frameTable = nullptr;
+		const uint64_t* keyframeTable = nullptr;
+		uint64_t frames = 0, keyframes = 0;
+		bool opened = false;
+		bool loaded = false;
+
+		// 索引を作成したときの録画の状態
+		RecordingKey key{};
+		Description desc{};
+		SensorBounds imu, gps;
+
+		// マップした索引ファイルの内容を検査し、各区画を参照する
+		bool attach(const uint8_t* data, size_t size);
+		// frameListとkeyframeListを参照する
+		void attachLists();
+	};
+}
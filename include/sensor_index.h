@@ -0,0 +1,272 @@
+#pragma once
+#include <limits>
+#include <optional>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "types.h"
+#include "sqlite_statement.h"
+
+namespace qs {
+	// 連続した配列の一部を指す参照 (C++17にはstd::spanが無いため)
+	template<typename T>
+	struct SensorSpan {
+		const T* first = nullptr;
+		const T* last = nullptr;
+
+		const T* begin() const { return first; }
+		const T* end() const { return last; }
+		size_t size() const { return static_cast<size_t>(last - first); }
+		bool empty() const { return first == last; }
+		const T& operator[](size_t index) const { return first[index]; }
+	};
+
+	// テーブルの行数とタイムスタンプの範囲 (行が無い場合はcountが0)
+	struct SensorBounds {
+		uint64_t count = 0;
+		double first = 0.0, last = 0.0;
+	};
+
+	/*
+		センサーのテーブル名と列名、および問い合わせ結果の行の変換 (sensor_index.cppで定義)
+		columnsはreadが読み込む順に並んでいる。
+	*/
+	template<typename T>
+	struct SensorTable;
+
+	template<>
+	struct SensorTable<Imu> {
+		static const char* const name;
+		static const char* const columns;
+		static void read(const SqliteStatement& statement, Imu& row);
+	};
+
+	template<>
+	struct SensorTable<Gps> {
+		static const char* const name;
+		static const char* const columns;
+		static void read(const SqliteStatement& statement, Gps& row);
+	};
+
+	/*
+		タイムスタンプ順に並べたセンサーの値を保持する配列
+
+		全ての行がメモリ上限に収まる場合はopen()で全て読み込む。
+		収まらない場合や、lazyを指定した場合はslice()で要求された区間を含むチャンクのみを読み込み、
+		要求が読み込み済みの範囲を外れたときに次のチャンクへ読み替える。
+		チャンクを読み替えると、それ以前にslice()で取得したSensorSpanは無効になる。
+		boundsを指定した場合は行数を数えるための全件走査を省略し、範囲外の要求ではデータベースを読まない。
+		読み込みは準備済みのSQLで行うので、connectionは読み込み専用で開いたものでもよい。
+	*/
+	template<typename T>
+	struct SensorColumn {
+		// lazyを指定した場合に1回に読み込む行数の上限 (開く処理で全件を読み込まないように小さくする)
+		static constexpr size_t lazyChunkRows = 65536;
+
+		bool open(
+			const SqliteConnection& connection, size_t memoryLimit,
+			const std::optional<SensorBounds>& bounds = std::nullopt, bool lazy = false
+		) {
+			close();
+			chunkRows = std::max<size_t>(memoryLimit / sizeof(T), 1);
+			if (lazy) { chunkRows = std::min(chunkRows, lazyChunkRows); }
+			this->bounds = bounds;
+			const std::string select = std::string("SELECT ") + SensorTable<T>::columns + " FROM " + SensorTable<T>::name;
+			if (
+				!windowStatement.prepare(connection, (select + " WHERE ? < timestamp ORDER BY timestamp ASC LIMIT ?").c_str()) ||
+				!rangeStatement.prepare(connection, (select + " WHERE ? < timestamp AND timestamp <= ? ORDER BY timestamp ASC").c_str())
+			) { close(); return false; }
+
+			size_t rows = 0;
+			if (bounds.has_value()) { rows = static_cast<size_t>(bounds->count); }
+			else if (!lazy) {
+				SqliteStatement countStatement;
+				if (!countStatement.prepare(connection, (std::string("SELECT COUNT(*) FROM ") + SensorTable<T>::name).c_str())) { close(); return false; }
+				if (SQLITE_ROW != countStatement.step()) { close(); return false; }
+				rows = static_cast<size_t>(countStatement.getInt64(0));
+			}
+			if (!lazy && rows <= chunkRows) {
+				SqliteStatement allStatement;
+				if (!allStatement.prepare(connection, (select + " ORDER BY timestamp ASC").c_str())) { close(); return false; }
+				if (!readRows(allStatement, rowsData)) { close(); return false; }
+				loadedFrom = -std::numeric_limits<double>::infinity();
+				loadedTo = std::numeric_limits<double>::infinity();
+				windowed = false;
+			}
+			else {
+				windowed = true;
+			}
+			return true;
+		}
+
+		void close() {
+			windowStatement.finalize();
+			rangeStatement.finalize();
+			rowsData.clear();
+			rowsData.shrink_to_fit();
+			loadedFrom = loadedTo = 0.0;
+			windowed = false;
+			bounds.reset();
+		}
+
+		// from < timestamp <= to を満たす値を返す
+		SensorSpan<T> slice(double from, double to) {
+			if (to <= from || !windowStatement.isPrepared()) { return SensorSpan<T>{}; }
+			if (bounds.has_value() && (0 == bounds->count || to < bounds->first || bounds->last <= from)) {
+				return SensorSpan<T>{};
+			}
+			if (windowed && !(loadedFrom <= from && to <= loadedTo)) { load(from, to); }
+			auto compare = [](double lhs, const T& rhs) { return lhs < rhs.timestamp; };
+			const T* data = rowsData.data();
+			const T* first = std::upper_bound(data, data + rowsData.size(), from, compare);
+			const T* last = std::upper_bound(first, data + rowsData.size(), to, compare);
+			return SensorSpan<T>{ first, last };
+		}
+
+		/*
+			from < timestamp <= to を満たす値のうち、1つのチャンクに収まる先頭の部分を返し、fromを返した区間の終端に進める
+			全て読み込んでいる場合は区間全体を返す。fromがtoに達するまで繰り返し呼ぶと、
+			slice()と異なり1フレーム分の上限を超えて読み込まずに、チャンクより長い区間を順に取得できる。
+		*/
+		SensorSpan<T> chunk(double& from, double to) {
+			if (to <= from || !windowStatement.isPrepared()) { from = to; return SensorSpan<T>{}; }
+			if (bounds.has_value() && (0 == bounds->count || to < bounds->first || bounds->last <= from)) {
+				from = to;
+				return SensorSpan<T>{};
+			}
+			if (windowed && !(loadedFrom <= from && from < loadedTo)) { loadChunk(from); }
+			const double until = std::min(to, loadedTo);
+			auto compare = [](double lhs, const T& rhs) { return lhs < rhs.timestamp; };
+			const T* data = rowsData.data();
+			const T* first = std::upper_bound(data, data + rowsData.size(), from, compare);
+			const T* last = std::upper_bound(first, data + rowsData.size(), until, compare);
+			from = until;
+			return SensorSpan<T>{ first, last };
+		}
+
+		bool isWindowed() const { return windowed; }
+
+		/*
+			テーブルに行が追記された後に呼び、boundsを更新して追記された行を読めるようにする
+			全て読み込んでいる場合は最後の値より後の行のみを追加で読み込み、
+			チャンク単位の場合は読み込み済みの範囲の終端を最後の値に戻す (次のslice()で続きを読み込む)。
+			以前にslice()で取得したSensorSpanは無効になる。
+		*/
+		bool refresh(const std::optional<SensorBounds>& bounds) {
+			if (!windowStatement.isPrepared()) { return false; }
+			this->bounds = bounds;
+			const double last = rowsData.empty() ? loadedFrom : rowsData.back().timestamp;
+			if (windowed) {
+				loadedTo = std::min(loadedTo, last);
+				return true;
+			}
+			std::vector<T> appended;
+			rangeStatement.reset();
+			rangeStatement.bind(1, last);
+			rangeStatement.bind(2, std::numeric_limits<double>::infinity());
+			if (!readRows(rangeStatement, appended)) { return false; }
+			rowsData.insert(rowsData.end(), appended.begin(), appended.end());
+			return true;
+		}
+
+	private:
+		SqliteStatement windowStatement, rangeStatement;
+		std::vector<T> rowsData;
+		size_t chunkRows = 1;
+		bool windowed = false;
+		std::optional<SensorBounds> bounds;
+
+		// rowsDataが保持しているタイムスタンプの範囲 (loadedFrom, loadedTo]
+		double loadedFrom = 0.0, loadedTo = 0.0;
+
+		// 実行結果の全ての行をintoに読み込む (確保済みの領域は再利用する)
+		static bool readRows(SqliteStatement& statement, std::vector<T>& into) {
+			into.clear();
+			int result;
+			while (SQLITE_ROW == (result = statement.step())) {
+				into.emplace_back();
+				SensorTable<T>::read(statement, into.back());
+			}
+			// 読み込み用のロックを保持し続けないように結果を破棄しておく
+			statement.reset();
+			return SQLITE_DONE == result;
+		}
+
+		// fromより後の行を1チャンク分読み込む
+		void loadChunk(double from) {
+			windowStatement.reset();
+			windowStatement.bind(1, from);
+			windowStatement.bind(2, static_cast<int64_t>(chunkRows));
+			if (!readRows(windowStatement, rowsData)) { rowsData.clear(); }
+			loadedFrom = from;
+			if (rowsData.size() < chunkRows) {
+				loadedTo = std::numeric_limits<double>::infinity();
+				return;
+			}
+
+			// 最後のタイムスタンプの行はチャンクに収まりきっていない可能性があるので除く
+			const double last = rowsData.back().timestamp;
+			while (!rowsData.empty() && last <= rowsData.back().timestamp) { rowsData.pop_back(); }
+			if (!rowsData.empty()) {
+				loadedTo = rowsData.back().timestamp;
+				return;
+			}
+
+			// チャンクの全ての行が同じタイムスタンプの場合は、そのタイムスタンプの行だけ上限を超えて読み込む
+			rangeStatement.reset();
+			rangeStatement.bind(1, from);
+			rangeStatement.bind(2, last);
+			if (!readRows(rangeStatement, rowsData)) { rowsData.clear(); }
+			loadedTo = last;
+		}
+
+		void load(double from, double to) {
+			loadChunk(from);
+
+			// 1フレーム分の区間がチャンクに収まらない場合は、その区間だけ上限を超えて読み込む
+			if (loadedTo < to) {
+				rangeStatement.reset();
+				rangeStatement.bind(1, from);
+				rangeStatement.bind(2, to);
+				if (!readRows(rangeStatement, rowsData)) { rowsData.clear(); }
+				loadedTo = to;
+			}
+		}
+	};
+
+	// IMUとGPSの値をタイムスタンプで検索するための索引
+	struct SensorIndex {
+		// 既定のメモリ上限 (IMUとGPSそれぞれに適用される)
+		static constexpr size_t defaultMemoryLimit = 256 * 1024 * 1024;
+
+		/*
+			行数とタイムスタンプの範囲が分かっている場合はimuBoundsとgpsBoundsに指定する
+			lazyを指定すると開く時点では何も読み込まず、要求された区間をチャンク単位で読み込む。
+			connectionはcloseするまで有効である必要がある。
+		*/
+		bool open(
+			const SqliteConnection& connection, size_t memoryLimit = defaultMemoryLimit,
+			const std::optional<SensorBounds>& imuBounds = std::nullopt,
+			const std::optional<SensorBounds>& gpsBounds = std::nullopt,
+			bool lazy = false
+		);
+		void close();
+
+		// from < timestamp <= to を満たすIMUの値を返す
+		SensorSpan<Imu> imu(double from, double to);
+		// from < timestamp <= to を満たすGPSの値を返す
+		SensorSpan<Gps> gps(double from, double to);
+
+		// from < timestamp <= to を満たすIMUの値を1チャンク分返し、fromを返した区間の終端に進める (SensorColumn::chunk()を参照)
+		SensorSpan<Imu> imuChunk(double& from, double to);
+		// from < timestamp <= to を満たすGPSの値を1チャンク分返し、fromを返した区間の終端に進める
+		SensorSpan<Gps> gpsChunk(double& from, double to);
+
+		// テーブルに行が追記された後に呼び、追記された行を読めるようにする (SensorColumn::refresh()を参照)
+		bool refresh(const std::optional<SensorBounds>& imuBounds, const std::optional<SensorBounds>& gpsBounds);
+
+	private:
+		SensorColumn<Imu> imuColumn;
+		SensorColumn<Gps> gpsColumn;
+	};
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <stdint.h>
+#include <sqlite3.h>
+
+namespace qs {
+	/*
+		sqlite3の接続を保持するクラス
+		sqlite_ormは問い合わせの度にSQLを組み立てて準備し直すため、
+		毎フレーム実行するような問い合わせはこのクラスとSqliteStatementを用いて直接実行する。
+	*/
+	struct SqliteConnection {
+		SqliteConnection() = default;
+		~SqliteConnection();
+		SqliteConnection(const SqliteConnection&) = delete;
+		SqliteConnection& operator=(const SqliteConnection&) = delete;
+
+		bool open(const std::string& filepathUTF8, int flags = SQLITE_OPEN_READWRITE);
+		/*
+			読み込み専用で開く
+			WALモードのデータベースは-shmファイルを作成できないと読めないので、読み込み専用のネットワークドライブなどに
+			置かれていて通常の方法で読めない場合は、immutable=1を指定したURIで開き直す。
+			immutableで開いた場合は-walファイルにのみ書き込まれている行は読めず、開いている間の変更も検出しない。
+		*/
+		bool openReadOnly(const std::string& filepathUTF8);
+		// openReadOnly()がimmutableで開いたかどうか
+		bool isImmutable() const;
+		void close();
+		bool isOpened() const;
+		bool exec(const char* sql);
+		sqlite3* get() const;
+
+	private:
+		sqlite3* db = nullptr;
+		bool immutable = false;
+	};
+
+	// 一度準備したSQLを繰り返し実行するためのクラス
+	struct SqliteStatement {
+		SqliteStatement() = default;
+		~SqliteStatement();
+		SqliteStatement(const SqliteStatement&) = delete;
+		SqliteStatement& operator=(const SqliteStatement&) = delete;
+
+		bool prepare(const SqliteConnection& connection, const char* sql);
+		void finalize();
+		bool isPrepared() const;
+
+		// 実行結果とバインドした値を破棄し、再び実行できる状態に戻す
+		void reset();
+
+		// indexは1から始まる
+		bool bind(int index, int64_t value);
+		bool bind(int index, double value);
+
+		// SQLITE_ROW, SQLITE_DONE またはエラーコードを返す
+		int step();
+
+		// columnは0から始まる
+		bool isNull(int column) const;
+		int64_t getInt64(int column) const;
+		double getDouble(int column) const;
+		// NULLの場合は空文字列を返す
+		std::string getText(int column) const;
+		// BLOBをoutにコピーする (outが確保済みの領域は再利用される)
+		// NULLの場合はoutを空にしてfalseを返す (確保済みの領域は解放しない)
+		bool getBlob(int column, std::vector<char>& out) const;
+
+	private:
+		sqlite3_stmt* stmt = nullptr;
+	};
+}
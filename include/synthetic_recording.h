@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <filesystem>
+#include "types.h"
+
+namespace qs {
+	/*
+		合成した録画を書き出すための設定
+		同じ設定であれば、常に同じ内容の録画が生成される (動画のエンコード結果はエンコーダに依存する)。
+	*/
+	struct SyntheticOptions {
+		uint64_t colorWidth = 1920, colorHeight = 1440;
+		uint64_t depthWidth = 256, depthHeight = 192;
+		uint64_t frames = 300;
+		// カメラのフレームレート
+		double fps = 60.0;
+		// IMUとGPSのサンプリング周波数 (0の場合は行を書き込まない)
+		double imuRate = 100.0;
+		double gpsRate = 1.0;
+		// 乱数のシード
+		uint64_t seed = 0;
+		// 最初のフレームのタイムスタンプ
+		double startTimestamp = 1000.0;
+		std::string date = "2021-06-14_08-06-54";
+		// 動画のコーデック
+		std::string fourcc = "mp4v";
+	};
+
+	/*
+		QuadDumpと同じ形式の録画 (camera.mp4とdb.sqlite3) をrecDirに書き出す
+
+		動画は平行移動する格子模様に乱数のノイズを加えたもので、デプスと信頼度はzlib(raw deflate)で圧縮される。
+		カメラは円を描くように移動し、IMUとGPSはその軌跡に沿った値になる。
+		recDirに既に録画が存在する場合は上書きする。失敗した場合はfalseを返す。
+	*/
+	bool writeSyntheticRecording(const std::filesystem::path& recDir, const SyntheticOptions& options = SyntheticOptions());
+}
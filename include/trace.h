@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <filesystem>
+
+namespace qs {
+	/*
+		処理区間の計測 (Chrome/Perfettoのトレース形式で書き出す)
+
+		QS_TRACE_SCOPE("name")を置いたスコープの開始と終了の時刻を、スレッド毎のバッファに記録する。
+		記録はスレッド毎に独立しているため、ロックを取らずに行われる。
+		無効な場合は1回のアトミック変数の読み込みのみで終わる。
+
+		環境変数QS_TRACEに出力先のパスを設定すると、起動時に有効になり、終了時にそのパスへ書き出す。
+		プログラムから使用する場合はTrace::enable()で有効にし、Trace::dump()で任意の時点の記録を書き出す。
+		書き出したファイルはchrome://tracingやhttps://ui.perfetto.devで開ける。
+
+		区間の名前には文字列リテラルを渡すこと (ポインタのみを保持するため)。
+	*/
+	struct Trace {
+		static void enable();
+		static void disable();
+		static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+		// 全てのスレッドの記録をJSONで書き出す
+		static bool dump(const std::filesystem::path& path);
+
+		// 記録を全て破棄する (計測中の区間が無いときに呼ぶこと)
+		static void clear();
+
+		// 現在のスレッドの名前 (トレース上の表示名) を設定する
+		static void setThreadName(const char* name);
+
+		// 1スレッド当たりに記録できる区間の数 (超えた分は記録されない)
+		static constexpr size_t eventsPerThread = 1 << 16;
+
+	private:
+		friend struct TraceScope;
+		static std::atomic<bool> enabled;
+		static uint64_t now();
+		static void record(const char* name, uint64_t begin, uint64_t end);
+	};
+
+	// コンストラクタからデストラクタまでの区間を記録する
+	struct TraceScope {
+		explicit TraceScope(const char* name) : name(Trace::isEnabled() ? name : nullptr) {
+			if (this->name) { begin = Trace::now(); }
+		}
+		~TraceScope() {
+			if (name) { Trace::record(name, begin, Trace::now()); }
+		}
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+	private:
+		const char* name;
+		uint64_t begin = 0;
+	};
+}
+
+#define QS_TRACE_CONCAT_(a, b) a##b
+#define QS_TRACE_CONCAT(a, b) QS_TRACE_CONCAT_(a, b)
+#define QS_TRACE_SCOPE(name) ::qs::TraceScope QS_TRACE_CONCAT(qsTraceScope, __LINE__)(name)
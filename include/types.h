@@ -1,5 +1,7 @@
 #pragma once
 #include <stdint.h>
+#include <memory>
+#include <vector>
 #include <optional>
 #include "opencv2/opencv.hpp"
 #define SQLITE_ORM_OPTIONAL_SUPPORTED
@@ -15,6 +17,43 @@ namespace qs {
 		std::optional<uint64_t> confidenceWidth, confidenceHeight;
 	};
 
+	/*
+		QuadLoader::next()などで取得するデータの種類
+		ビットの論理和で指定し、指定しなかったデータは読み込みと展開を省略する。
+	*/
+	enum Field : uint32_t {
+		FIELD_COLOR      = 1 << 0,
+		FIELD_DEPTH      = 1 << 1,
+		FIELD_CONFIDENCE = 1 << 2,
+		FIELD_MATRICES   = 1 << 3,
+		FIELD_IMU        = 1 << 4,
+		FIELD_GPS        = 1 << 5,
+		// IMUをQuadFrame::imuBatchに列ごとの配列として書き込む
+		// imuと同じ値を別の形式で持つものなので、FIELD_ALLには含まれない
+		FIELD_IMU_BATCH  = 1 << 6,
+		// カメラのタイムスタンプの時刻に補間したIMUをQuadFrame::interpolatedImuに書き込む
+		// 次のフレームの区間のIMUも読み込むので、FIELD_ALLには含まれない
+		FIELD_IMU_INTERPOLATED = 1 << 7,
+		FIELD_CAMERA     = FIELD_COLOR | FIELD_DEPTH | FIELD_CONFIDENCE | FIELD_MATRICES,
+		FIELD_ALL        = FIELD_CAMERA | FIELD_IMU | FIELD_GPS,
+	};
+	using FieldMask = uint32_t;
+
+	/*
+		デプスと信頼度の展開結果
+		OK       : 正常に展開された
+		MISSING  : データベースにデータまたは解像度が記録されていない
+		CORRUPTED: zlibのデータが壊れている
+		TRUNCATED: 展開したデータの大きさが解像度と一致しない
+		SKIPPED  : FieldMaskで要求されなかったため展開していない
+		DEFERRED : 展開を遅延している (Camera::getDepth()などで初めて参照したときに展開される)
+		OK以外の場合、対応する行列は空になる
+	*/
+	enum class InflateStatus { OK, MISSING, CORRUPTED, TRUNCATED, SKIPPED, DEFERRED };
+
+	// 圧縮されたまま保持し、初めて参照したときに展開する行列 (inflate_engine.hで定義)
+	struct LazyInflate;
+
 	struct Camera {
 		/*
 			メモ
@@ -32,8 +71,24 @@ namespace qs {
 		cv::Mat intrinsicsMatrix;
 		cv::Mat projectionMatrix;
 		cv::Mat viewMatrix;
+		InflateStatus depthStatus = InflateStatus::MISSING;
+		InflateStatus confidenceStatus = InflateStatus::MISSING;
+
+		// 展開を遅延している場合のデプスと信頼度 (depthStatusとconfidenceStatusはDEFERREDになる)
+		std::shared_ptr<LazyInflate> lazyDepth;
+		std::shared_ptr<LazyInflate> lazyConfidence;
 
 		Camera clone() const;
+
+		/*
+			デプスと信頼度を返す
+			展開を遅延している場合は初めて呼んだときに展開し、以降は展開済みの行列を返す。
+			複数のスレッドから同時に呼んでもよい。遅延していない場合はdepthとconfidenceをそのまま返す。
+		*/
+		const cv::Mat& getDepth() const;
+		const cv::Mat& getConfidence() const;
+		InflateStatus getDepthStatus() const;
+		InflateStatus getConfidenceStatus() const;
 	};
 
 	struct Imu {
@@ -58,6 +113,79 @@ namespace qs {
 		cv::Vec3d cvAttitude() const;
 	};
 
+	// 3次元ベクトルの配列を軸ごとの配列で保持する
+	struct Vec3Batch {
+		std::vector<double> x, y, z;
+
+		size_t size() const;
+		void resize(size_t size);
+		void clear();
+		cv::Vec3d at(size_t index) const;
+	};
+
+	/*
+		IMUの値を列ごとの連続した配列で保持するコンテナ (Structure of Arrays)
+
+		Imuの配列 (Array of Structures) と異なり、同じ軸の値がメモリ上で連続するため、
+		録画全体のような大量の値に対する一括処理をSIMD命令でメモリ帯域に近い速さで行える。
+		一括処理はOpenCVのuniversal intrinsicsで実装しており、SIMD命令が使えない環境では同じ計算を1要素ずつ行う。
+
+		単位はImuと同じ (gravityとuserAcclerationはG、rotationRateはrad/s、attitudeはrad)。
+		attitudeX, attitudeY, attitudeZはデバイスのX, Y, Z軸周りの回転角 (Core Motionのpitch, roll, yaw) で、
+		デバイス座標系から世界座標系への回転は Rz(attitudeZ) * Rx(attitudeX) * Ry(attitudeY) とする。
+	*/
+	struct ImuBatch {
+		// 標準重力加速度 (m/s^2)
+		static constexpr double standardGravity = 9.80665;
+
+		std::vector<double> timestamp;
+		std::vector<double> gravityX, gravityY, gravityZ;
+		std::vector<double> userAcclerationX, userAcclerationY, userAcclerationZ;
+		std::vector<double> rotationRateX, rotationRateY, rotationRateZ;
+		std::vector<double> attitudeX, attitudeY, attitudeZ;
+
+		size_t size() const;
+		bool empty() const;
+		void reserve(size_t capacity);
+		void resize(size_t size);
+		// 要素を削除する (確保済みの領域は解放しない)
+		void clear();
+
+		// Imuの配列から変換する (確保済みの領域に収まる場合は再確保しない)
+		void assign(const Imu* first, const Imu* last);
+		void append(const Imu* first, const Imu* last);
+		void push_back(const Imu& imu);
+		// otherの[first, last)番目の値を末尾に追加する
+		void append(const ImuBatch& other, size_t first, size_t last);
+
+		// index番目の値をImuとして返す (idは0になる)
+		Imu at(size_t index) const;
+		cv::Vec3d gravity(size_t index) const;
+		cv::Vec3d userAccleration(size_t index) const;
+		cv::Vec3d rotationRate(size_t index) const;
+		cv::Vec3d attitude(size_t index) const;
+
+		// 各値の大きさをoutに書き込む
+		void gravityNorm(std::vector<double>& out) const;
+		void userAcclerationNorm(std::vector<double>& out) const;
+		void rotationRateNorm(std::vector<double>& out) const;
+
+		// userAcclerationとrotationRateからバイアスを引く
+		void subtractBias(const cv::Vec3d& acclerationBias, const cv::Vec3d& rotationRateBias);
+
+		// userAcclerationを世界座標系に回転し、m/s^2単位でoutに書き込む
+		void userAcclerationInWorld(Vec3Batch& out) const;
+
+		/*
+			世界座標系のuserAcclerationを台形則で積分し、各時刻の速度 (m/s) と位置 (m) を求める
+			velocityとpositionの先頭は初期値 (initialVelocity, initialPosition) になる。
+		*/
+		void integrate(
+			const cv::Vec3d& initialVelocity, const cv::Vec3d& initialPosition,
+			Vec3Batch& velocity, Vec3Batch& position
+		) const;
+	};
+
 	struct Gps {
 		uint64_t id;
 		double timestamp;
@@ -74,6 +202,10 @@ namespace qs {
 		Camera camera;
 		std::vector<Imu> imu;
 		std::vector<Gps> gps;
+		// FIELD_IMU_BATCHを指定した場合に、imuと同じ値を列ごとの配列で保持する
+		ImuBatch imuBatch;
+		// FIELD_IMU_INTERPOLATEDを指定した場合に、camera.timestampの時刻に補間したIMUの値 (IMUが無い場合はnullopt)
+		std::optional<Imu> interpolatedImu;
 
 		QuadFrame clone() const;
 	};
@@ -88,7 +220,15 @@ namespace qs {
 		std::optional<std::vector<char>> projectionMatrix;
 		std::optional<std::vector<char>> viewMatrix;
 
-		Camera toCamera(Description description, cv::Mat color) const;
+		Camera toCamera(const Description& description, cv::Mat color) const;
+
+		// intoが確保済みの領域を再利用してcolor以外の値を書き込む
+		// 解像度と型が一致する場合、intoの行列は再確保されない
+		void toCamera(const Description& description, Camera& into) const;
+
+		// デプスと信頼度以外の値をintoに書き込む
+		// withMatricesがfalseの場合、intoの行列は空になる
+		void toCameraWithoutBlobs(Camera& into, bool withMatrices = true) const;
 	};
 
 	inline auto makeQSStorage(const std::string& filepath) {
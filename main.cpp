@@ -1,5 +1,5 @@
 #include <iostream>
-#include "quad_loader.h"
+#include "frame_source.h"
 
 int main(int argc, char* argv[]) {
 	if (2 != argc) {
@@ -7,34 +7,33 @@ int main(int argc, char* argv[]) {
 			<< "QuadSLAM version 0.0.1\n"
 			<< "\n"
 			<< "usage: quadslam input_path\n"
-			<< "  input_path: Directory containing QuadDump recording files"
+			<< "  input_path: Directory containing QuadDump recording files, a packed recording or an image sequence"
 			<< "\n"
 			<< std::endl;
 		return 0;
 	}
 
 	std::string recDirPath = argv[1];
-	qs::QuadLoader loader;
-	loader.open(recDirPath);
-	if (!loader.isOpened()) { std::cout << "failed to open forder" << std::endl; return 1; }
-
-	while(true) {
-		auto quad = loader.next();
-		if (!quad) break;
-		qs::QuadFrame quadFrame = std::move(*quad);
-		qs::Camera& camera = quadFrame.camera;
+	std::unique_ptr<qs::FrameSource> source = qs::openFrameSource(std::filesystem::u8path(recDirPath));
+	if (!source) { std::cout << "failed to open forder" << std::endl; return 1; }
 
-		camera.depth *= 0.1;
-		camera.confidence *= 255 / 2;
+	// フレーム間で領域を再利用するため、ループの外で確保しておく
+	qs::QuadFrame quadFrame;
+	cv::Mat colorView, depthView, confidenceView;
+	while(source->next(quadFrame)) {
+		qs::Camera& camera = quadFrame.camera;
 
+		// ソースの行列は読み込み専用の領域を指す場合があるので、縮尺の変更は表示用の行列に対して行う
 		auto resolution = camera.depth.size() * 2;
-		cv::resize(camera.color     , camera.color     , resolution);
-		cv::resize(camera.depth     , camera.depth     , resolution);
-		cv::resize(camera.confidence, camera.confidence, resolution);
-
-		cv::imshow("camera"    , camera.color     );
-		cv::imshow("depth"     , camera.depth     );
-		cv::imshow("confidence", camera.confidence);
+		cv::resize(camera.color     , colorView     , resolution);
+		cv::resize(camera.depth     , depthView     , resolution);
+		cv::resize(camera.confidence, confidenceView, resolution);
+		depthView *= 0.1;
+		confidenceView *= 255 / 2;
+
+		cv::imshow("camera"    , colorView     );
+		cv::imshow("depth"     , depthView     );
+		cv::imshow("confidence", confidenceView);
 
 
 		std::cout << "================================\n";
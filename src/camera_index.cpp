@@ -0,0 +1,96 @@
+#include "camera_index.h"
+#include "recording_index.h"
+#include "trace.h"
+
+using namespace qs;
+
+bool CameraIndex::open(const SqliteConnection& connection) {
+	close();
+
+	// フレーム番号からrowidへの対応表を作成
+	SqliteStatement indexStatement;
+	if (!indexStatement.prepare(connection,
+		"SELECT color_frame, id FROM camera WHERE color_frame IS NOT NULL ORDER BY color_frame"
+	)) { close(); return false; }
+	int result;
+	while (SQLITE_ROW == (result = indexStatement.step())) {
+		const int64_t colorFrame = indexStatement.getInt64(0);
+		if (colorFrame < 0) { continue; }
+		const size_t index = static_cast<size_t>(colorFrame);
+		if (rowids.size() <= index) { rowids.resize(index + 1, -1); }
+		rowids[index] = indexStatement.getInt64(1);
+	}
+	if (SQLITE_DONE != result) { close(); return false; }
+
+	if (!prepareRowStatement(connection)) { close(); return false; }
+	return true;
+}
+
+bool CameraIndex::open(const SqliteConnection& connection, const RecordingIndex& index) {
+	close();
+	recordingIndex = &index;
+	if (!prepareRowStatement(connection)) { close(); return false; }
+	return true;
+}
+
+bool CameraIndex::prepareRowStatement(const SqliteConnection& connection) {
+	// 毎フレーム実行するSQLを準備
+	return rowStatement.prepare(connection,
+		"SELECT id, timestamp, color_frame, depth_zlib, confidence_zlib, "
+		"intrinsics_matrix_3x3, projection_matrix_4x4, view_matrix_4x4 "
+		"FROM camera WHERE id = ?"
+	);
+}
+
+void CameraIndex::close() {
+	rowStatement.finalize();
+	rowids.clear();
+	recordingIndex = nullptr;
+}
+
+bool CameraIndex::isOpened() const {
+	return rowStatement.isPrepared();
+}
+
+/*
+	BLOBをoutに読み込む
+	NULLの場合はoutをnulloptにするが、確保済みの領域はspareに退避しておき、次に値がある行を読むときに再利用する
+	(NULLの行が散発的に含まれていても毎回確保し直さないように)
+*/
+static void readBlob(const SqliteStatement& statement, int column, std::optional<std::vector<char>>& out, std::vector<char>& spare) {
+	if (!out.has_value()) { out.emplace(std::move(spare)); }
+	if (!statement.getBlob(column, out.value())) {
+		spare = std::move(out.value());
+		out.reset();
+	}
+}
+
+bool CameraIndex::fetch(uint64_t colorFrame, CameraForOrm& row, FieldMask fields) {
+	QS_TRACE_SCOPE("CameraIndex::fetch");
+	std::optional<int64_t> id = rowid(colorFrame);
+	if (!id.has_value()) { return false; }
+
+	rowStatement.reset();
+	rowStatement.bind(1, id.value());
+	if (SQLITE_ROW != rowStatement.step()) { rowStatement.reset(); return false; }
+	row.id = static_cast<uint64_t>(rowStatement.getInt64(0));
+	row.timestamp = rowStatement.getDouble(1);
+	row.colorFrame = static_cast<uint64_t>(rowStatement.getInt64(2));
+	if (fields & FIELD_DEPTH) { readBlob(rowStatement, 3, row.depthZlib, spareBlobs[0]); }
+	if (fields & FIELD_CONFIDENCE) { readBlob(rowStatement, 4, row.confidenceZlib, spareBlobs[1]); }
+	if (fields & FIELD_MATRICES) {
+		readBlob(rowStatement, 5, row.intrinsicsMatrix, spareBlobs[2]);
+		readBlob(rowStatement, 6, row.projectionMatrix, spareBlobs[3]);
+		readBlob(rowStatement, 7, row.viewMatrix, spareBlobs[4]);
+	}
+
+	// 読み込み用のロックを保持し続けないように結果を破棄しておく
+	rowStatement.reset();
+	return true;
+}
+
+std::optional<int64_t> CameraIndex::rowid(uint64_t colorFrame) const {
+	if (recordingIndex) { return recordingIndex->rowid(colorFrame); }
+	if (rowids.size() <= colorFrame || rowids[colorFrame] < 0) { return std::nullopt; }
+	return rowids[colorFrame];
+}
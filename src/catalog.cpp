@@ -0,0 +1,326 @@
+#include "catalog.h"
+#include "sqlite_statement.h"
+#include "recording_index.h"
+#include "trace.h"
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace qs;
+
+namespace {
+	// db.sqlite3のサイズと更新日時 (取得できない場合は-1)
+	void readStamp(const std::filesystem::path& dbPath, int64_t& size, int64_t& modified) {
+		std::error_code error;
+		const uintmax_t fileSize = std::filesystem::file_size(dbPath, error);
+		size = error ? -1 : static_cast<int64_t>(fileSize);
+		const auto time = std::filesystem::last_write_time(dbPath, error);
+		modified = error ? -1 : static_cast<int64_t>(time.time_since_epoch().count());
+	}
+
+	// 録画の内容のキーをバイト列として読み込む (読み込めない場合は空)
+	std::vector<char> readKeyBytes(const std::filesystem::path& recDir, const SqliteConnection& connection) {
+		RecordingKey key;
+		if (!readRecordingKey(recDir, connection, key)) { return {}; }
+		const char* bytes = reinterpret_cast<const char*>(key.data());
+		return std::vector<char>(bytes, bytes + sizeof(key));
+	}
+
+	// 0より大きい値か、NULLであることを確認して読み込む
+	bool readOptionalSize(const SqliteStatement& statement, int column, std::optional<uint64_t>& out) {
+		if (statement.isNull(column)) { out.reset(); return true; }
+		const int64_t value = statement.getInt64(column);
+		if (value <= 0) { return false; }
+		out = static_cast<uint64_t>(value);
+		return true;
+	}
+
+	// 幅と高さは両方とも記録されているか、両方とも記録されていないかのどちらかである
+	bool isConsistent(const std::optional<uint64_t>& width, const std::optional<uint64_t>& height) {
+		return width.has_value() == height.has_value();
+	}
+
+	bool isRecordingDirectory(const std::filesystem::path& dir) {
+		std::error_code error;
+		return
+			std::filesystem::is_regular_file(dir / "db.sqlite3", error) &&
+			std::filesystem::is_regular_file(dir / "camera.mp4", error);
+	}
+
+	// rootの絶対パスを比較に使用する形に正規化する
+	std::string normalizedPath(const std::filesystem::path& path) {
+		std::error_code error;
+		std::filesystem::path absolute = std::filesystem::absolute(path, error);
+		if (error) { absolute = path; }
+		return absolute.lexically_normal().u8string();
+	}
+
+	// pathがroot以下にあるかどうか
+	bool isUnder(const std::string& path, const std::string& root) {
+		if (path.size() < root.size() || 0 != path.compare(0, root.size(), root)) { return false; }
+		if (path.size() == root.size()) { return true; }
+		const char separator = static_cast<char>(std::filesystem::path::preferred_separator);
+		return separator == root.back() || separator == path[root.size()];
+	}
+}
+
+std::optional<CatalogEntry> qs::inspectRecording(const std::filesystem::path& recDir) {
+	QS_TRACE_SCOPE("inspectRecording");
+	const std::filesystem::path dbPath = recDir / "db.sqlite3";
+	CatalogEntry entry{};
+	entry.path = normalizedPath(recDir);
+	readStamp(dbPath, entry.dbSize, entry.dbModified);
+	if (entry.dbSize <= 0) { return std::nullopt; }
+
+	SqliteConnection connection;
+	if (!connection.openReadOnly(dbPath.u8string())) { return std::nullopt; }
+
+	// 検査中に追記された場合は次回の検査で検出されるよう、検査する前の状態を記録する
+	entry.recordingKey = readKeyBytes(recDir, connection);
+	if (entry.recordingKey.empty()) { return std::nullopt; }
+
+	// description
+	{
+		SqliteStatement statement;
+		if (!statement.prepare(connection,
+			"SELECT date, color_width, color_height, depth_width, depth_height, "
+			"confidence_width, confidence_height FROM description LIMIT 2"
+		)) { return std::nullopt; }
+		if (SQLITE_ROW != statement.step()) { return std::nullopt; }
+		entry.date = statement.getText(0);
+		const int64_t colorWidth = statement.getInt64(1);
+		const int64_t colorHeight = statement.getInt64(2);
+		if (
+			entry.date.empty() || statement.isNull(1) || statement.isNull(2) ||
+			colorWidth <= 0 || colorHeight <= 0 ||
+			!readOptionalSize(statement, 3, entry.depthWidth) ||
+			!readOptionalSize(statement, 4, entry.depthHeight) ||
+			!readOptionalSize(statement, 5, entry.confidenceWidth) ||
+			!readOptionalSize(statement, 6, entry.confidenceHeight) ||
+			!isConsistent(entry.depthWidth, entry.depthHeight) ||
+			!isConsistent(entry.confidenceWidth, entry.confidenceHeight)
+		) { return std::nullopt; }
+		entry.colorWidth = static_cast<uint64_t>(colorWidth);
+		entry.colorHeight = static_cast<uint64_t>(colorHeight);
+
+		// descriptionは1行のみのはず
+		if (SQLITE_DONE != statement.step()) { return std::nullopt; }
+	}
+
+	// 最初と最後のフレーム (color_frameの索引を使用するので全件走査しない)
+	{
+		SqliteStatement first, last;
+		if (
+			!first.prepare(connection,
+				"SELECT color_frame, timestamp FROM camera WHERE color_frame IS NOT NULL ORDER BY color_frame ASC LIMIT 1") ||
+			!last.prepare(connection,
+				"SELECT color_frame, timestamp FROM camera WHERE color_frame IS NOT NULL ORDER BY color_frame DESC LIMIT 1")
+		) { return std::nullopt; }
+		const int firstResult = first.step();
+		const int lastResult = last.step();
+		if (SQLITE_ROW == firstResult && SQLITE_ROW == lastResult) {
+			const int64_t lastFrame = last.getInt64(0);
+			entry.frameCount = (lastFrame < 0) ? 0 : static_cast<uint64_t>(lastFrame) + 1;
+			entry.startTimestamp = first.getDouble(1);
+			entry.endTimestamp = last.getDouble(1);
+			entry.duration = entry.endTimestamp - entry.startTimestamp;
+		}
+		else if (SQLITE_DONE != firstResult || SQLITE_DONE != lastResult) { return std::nullopt; }
+	}
+
+	// GPSの範囲 (精度が負の値は無効な測位なので除く)
+	{
+		SqliteStatement statement;
+		if (!statement.prepare(connection,
+			"SELECT COUNT(*), MIN(latitude), MAX(latitude), MIN(longitude), MAX(longitude) "
+			"FROM gps WHERE 0 <= horizontal_accuracy"
+		)) { return std::nullopt; }
+		if (SQLITE_ROW != statement.step()) { return std::nullopt; }
+		entry.hasGps = 0 < statement.getInt64(0);
+		if (entry.hasGps) {
+			entry.minLatitude = statement.getDouble(1);
+			entry.maxLatitude = statement.getDouble(2);
+			entry.minLongitude = statement.getDouble(3);
+			entry.maxLongitude = statement.getDouble(4);
+		}
+	}
+
+	return entry;
+}
+
+Catalog::Catalog() {}
+
+Catalog::~Catalog() { close(); }
+
+void Catalog::open(const std::filesystem::path& catalogPath) {
+	close();
+	try {
+		storagePtr = std::make_unique<CatalogStorage>(makeCatalogStorage(catalogPath.u8string()));
+		storagePtr->sync_schema();
+	}
+	catch(const std::system_error&) { close(); return; }
+}
+
+void Catalog::close() {
+	storagePtr.reset();
+}
+
+bool Catalog::isOpened() const {
+	return static_cast<bool>(storagePtr);
+}
+
+CatalogScanResult Catalog::scan(const std::filesystem::path& root, size_t workers) {
+	QS_TRACE_SCOPE("Catalog::scan");
+	CatalogScanResult result;
+	if (!isOpened()) { return result; }
+	CatalogStorage& storage = *storagePtr;
+
+	// 録画ディレクトリを探す (録画ディレクトリの中は探さない)
+	std::vector<std::filesystem::path> dirs;
+	{
+		QS_TRACE_SCOPE("find recordings");
+		std::error_code error;
+		if (isRecordingDirectory(root)) { dirs.push_back(root); }
+		else {
+			auto it = std::filesystem::recursive_directory_iterator(
+				root, std::filesystem::directory_options::skip_permission_denied, error
+			);
+			for (; !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+				if (!it->is_directory(error) || error) { error.clear(); continue; }
+				if (isRecordingDirectory(it->path())) {
+					dirs.push_back(it->path());
+					it.disable_recursion_pending();
+				}
+			}
+		}
+	}
+	result.found = dirs.size();
+
+	// 登録済みの録画のデータベースの状態
+	struct Stamp {
+		int64_t dbSize, dbModified;
+		std::vector<char> recordingKey;
+	};
+	std::unordered_map<std::string, Stamp> stamps;
+	try {
+		for (auto& entry : storage.iterate<CatalogEntry>()) {
+			stamps.emplace(entry.path, Stamp{ entry.dbSize, entry.dbModified, std::move(entry.recordingKey) });
+		}
+	}
+	catch(const std::system_error&) { return result; }
+
+	// 各録画を並列に検査する
+	// (sqliteへの書き込みは1つの接続で行う必要があるので、結果はこのスレッドでまとめて書き込む)
+	enum class Status { UPDATED, UNCHANGED, INVALID };
+	std::vector<Status> statuses(dirs.size(), Status::INVALID);
+	std::vector<std::optional<CatalogEntry>> entries(dirs.size());
+	std::vector<std::string> paths(dirs.size());
+	std::atomic<size_t> nextDir{0};
+	auto worker = [&]() {
+		while (true) {
+			const size_t i = nextDir.fetch_add(1);
+			if (dirs.size() <= i) { break; }
+			paths[i] = normalizedPath(dirs[i]);
+			auto stamp = stamps.find(paths[i]);
+			if (stamp != stamps.end()) {
+				// -walにのみ書き込まれた行はdb.sqlite3のサイズと更新日時を変えないので、録画の内容のキーも比較する
+				// (キーは索引を使う問い合わせのみで読めるので、録画の長さによらず短時間で終わる)
+				int64_t size, modified;
+				const std::filesystem::path dbPath = dirs[i] / "db.sqlite3";
+				readStamp(dbPath, size, modified);
+				if (stamp->second.dbSize == size && stamp->second.dbModified == modified) {
+					SqliteConnection connection;
+					if (
+						connection.openReadOnly(dbPath.u8string()) &&
+						readKeyBytes(dirs[i], connection) == stamp->second.recordingKey
+					) { statuses[i] = Status::UNCHANGED; continue; }
+				}
+			}
+			entries[i] = inspectRecording(dirs[i]);
+			statuses[i] = entries[i].has_value() ? Status::UPDATED : Status::INVALID;
+		}
+	};
+	if (0 == workers) { workers = std::max<size_t>(std::thread::hardware_concurrency(), 1); }
+	workers = std::min<size_t>(workers, std::max<size_t>(dirs.size(), 1));
+	{
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < workers; i++) {
+			threads.emplace_back([&worker]() { Trace::setThreadName("Catalog worker"); worker(); });
+		}
+		worker();
+		for (auto& thread : threads) { thread.join(); }
+	}
+
+	// 結果を1つのトランザクションで書き込む
+	const std::string rootPath = normalizedPath(root);
+	try {
+		storage.transaction([&]() {
+			std::unordered_set<std::string> seen;
+			for (size_t i = 0; i < dirs.size(); i++) {
+				switch (statuses[i]) {
+					case Status::UPDATED:
+						storage.replace(entries[i].value());
+						seen.insert(paths[i]);
+						result.updated++;
+						break;
+					case Status::UNCHANGED:
+						seen.insert(paths[i]);
+						result.unchanged++;
+						break;
+					case Status::INVALID:
+						result.invalid++;
+						break;
+				}
+			}
+
+			// root以下で見つからなくなった録画と、不正になった録画の登録を削除する
+			for (const auto& stamp : stamps) {
+				if (!isUnder(stamp.first, rootPath) || 0 < seen.count(stamp.first)) { continue; }
+				storage.remove<CatalogEntry>(stamp.first);
+				result.removed++;
+			}
+			return true;
+		});
+	}
+	catch(const std::system_error&) {
+		result.updated = result.removed = 0;
+	}
+	return result;
+}
+
+std::vector<CatalogEntry> Catalog::find(const CatalogQuery& query) {
+	using namespace sqlite_orm;
+	QS_TRACE_SCOPE("Catalog::find");
+	if (!isOpened()) { return {}; }
+	CatalogStorage& storage = *storagePtr;
+
+	// dateToは前方一致で含めるので、dateToで始まるどの文字列よりも大きい文字列と比較する
+	const std::string dateFrom = query.dateFrom.value_or("");
+	const std::string dateUntil = query.dateTo.value_or("") + "\x7f";
+	try {
+		if (query.area.has_value()) {
+			const GeoBox& area = query.area.value();
+			return storage.get_all<CatalogEntry>(
+				where(
+					c(&CatalogEntry::date) >= dateFrom and c(&CatalogEntry::date) < dateUntil and
+					c(&CatalogEntry::hasGps) == true and
+					c(&CatalogEntry::maxLatitude) >= area.minLatitude and
+					c(&CatalogEntry::minLatitude) <= area.maxLatitude and
+					c(&CatalogEntry::maxLongitude) >= area.minLongitude and
+					c(&CatalogEntry::minLongitude) <= area.maxLongitude
+				),
+				order_by(&CatalogEntry::date).asc()
+			);
+		}
+		return storage.get_all<CatalogEntry>(
+			where(c(&CatalogEntry::date) >= dateFrom and c(&CatalogEntry::date) < dateUntil),
+			order_by(&CatalogEntry::date).asc()
+		);
+	}
+	catch(const std::system_error&) { return {}; }
+}
+
+const std::unique_ptr<CatalogStorage>& Catalog::getStorage() const {
+	return storagePtr;
+}
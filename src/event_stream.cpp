@@ -0,0 +1,225 @@
+#include "event_stream.h"
+#include "trace.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace qs;
+
+namespace {
+	// キーを文の先頭のパラメーターに設定し、次のパラメーターの番号を返す
+	int bindKey(SqliteStatement& statement, int64_t key) {
+		statement.bind(1, key);
+		return 2;
+	}
+
+	int bindKey(SqliteStatement& statement, const EventStream::SensorKey& key) {
+		statement.bind(1, key.timestamp);
+		statement.bind(2, key.id);
+		return 3;
+	}
+
+	/*
+		カーソルの行を使い切っていれば、keyより大きいキーの行を次のchunkRows行読み込む
+		読み込んだ最後の行のキーをkeyに書き込む。読める行が無い場合はfalseを返す。
+	*/
+	template<typename T, typename Key, typename Read, typename KeyOf>
+	bool fillRows(
+		SqliteStatement& statement, std::vector<T>& rows, size_t& position, bool& exhausted, bool& error,
+		size_t chunkRows, Key& key, Read read, KeyOf keyOf
+	) {
+		if (position < rows.size()) { return true; }
+		if (exhausted) { return false; }
+
+		// rowsは確保済みの領域を再利用する
+		rows.clear();
+		position = 0;
+		statement.reset();
+		statement.bind(bindKey(statement, key), static_cast<int64_t>(chunkRows));
+		int result;
+		while (SQLITE_ROW == (result = statement.step())) {
+			rows.emplace_back();
+			read(statement, rows.back());
+		}
+		if (SQLITE_DONE != result) {
+			error = exhausted = true;
+			rows.clear();
+			return false;
+		}
+		if (rows.size() < chunkRows) { exhausted = true; }
+		if (rows.empty()) { return false; }
+		key = keyOf(rows.back());
+		return true;
+	}
+}
+
+EventStream::EventStream() {}
+
+EventStream::~EventStream() { close(); }
+
+void EventStream::open(const std::filesystem::path& recDir, const EventStreamOptions& options) {
+	QS_TRACE_SCOPE("EventStream::open");
+	close();
+	this->options = options;
+	this->options.chunkRows = std::max<size_t>(options.chunkRows, 1);
+	if (!connection.openReadOnly((recDir / "db.sqlite3").u8string())) { close(); return; }
+
+	camera.enabled = 0 != (options.fields & FIELD_CAMERA);
+	imu.enabled = 0 != (options.fields & FIELD_IMU);
+	gps.enabled = 0 != (options.fields & FIELD_GPS);
+	if (
+		(camera.enabled && !camera.statement.prepare(connection,
+			"SELECT color_frame, timestamp FROM camera "
+			"WHERE color_frame IS NOT NULL AND ? < color_frame ORDER BY color_frame ASC LIMIT ?")) ||
+		(imu.enabled && !imu.statement.prepare(connection,
+			"SELECT id, timestamp, gravity_x, gravity_y, gravity_z, "
+			"user_accleration_x, user_accleration_y, user_accleration_z, "
+			"rotation_rate_x, rotation_rate_y, rotation_rate_z, attitude_x, attitude_y, attitude_z "
+			"FROM imu WHERE (?, ?) < (timestamp, id) ORDER BY timestamp ASC, id ASC LIMIT ?")) ||
+		(gps.enabled && !gps.statement.prepare(connection,
+			"SELECT id, timestamp, latitude, longitude, altitude, horizontal_accuracy, vertical_accuracy "
+			"FROM gps WHERE (?, ?) < (timestamp, id) ORDER BY timestamp ASC, id ASC LIMIT ?"))
+	) { close(); return; }
+
+	seek(options.from.value_or(-std::numeric_limits<double>::infinity()));
+}
+
+void EventStream::close() {
+	// 文は接続を閉じる前に破棄する
+	camera.statement.finalize();
+	imu.statement.finalize();
+	gps.statement.finalize();
+	camera.rows.clear();
+	imu.rows.clear();
+	gps.rows.clear();
+	camera.enabled = imu.enabled = gps.enabled = false;
+	camera.exhausted = imu.exhausted = gps.exhausted = true;
+	connection.close();
+	error = false;
+}
+
+bool EventStream::isOpened() const {
+	return connection.isOpened();
+}
+
+void EventStream::seek(double timestamp) {
+	QS_TRACE_SCOPE("EventStream::seek");
+	if (!isOpened()) { return; }
+	if (options.from.has_value()) { timestamp = std::max(timestamp, options.from.value()); }
+
+	// timestamp以上の行を読むので、キーはtimestampの行のどのidよりも前にする
+	imuKey = gpsKey = SensorKey{ timestamp, std::numeric_limits<int64_t>::min() };
+	imu.rows.clear();
+	gps.rows.clear();
+	imu.position = gps.position = 0;
+	imu.exhausted = !imu.enabled;
+	gps.exhausted = !gps.enabled;
+
+	// カメラはcolor_frameの順に読むので、timestamp以降の最初のフレームを探す
+	camera.rows.clear();
+	camera.position = 0;
+	camera.exhausted = !camera.enabled;
+	cameraKey = -1;
+	if (camera.enabled && std::isfinite(timestamp)) {
+		SqliteStatement statement;
+		if (!statement.prepare(connection, "SELECT MIN(color_frame) FROM camera WHERE ? <= timestamp")) {
+			error = camera.exhausted = true;
+			return;
+		}
+		statement.bind(1, timestamp);
+		if (SQLITE_ROW != statement.step()) { error = camera.exhausted = true; return; }
+		if (statement.isNull(0)) { camera.exhausted = true; }
+		else { cameraKey = statement.getInt64(0) - 1; }
+	}
+}
+
+bool EventStream::failed() const {
+	return error;
+}
+
+bool EventStream::fillCamera() {
+	return fillRows(
+		camera.statement, camera.rows, camera.position, camera.exhausted, error, options.chunkRows, cameraKey,
+		[](const SqliteStatement& statement, CameraRow& row) {
+			row.frameNumber = static_cast<uint64_t>(statement.getInt64(0));
+			row.timestamp = statement.getDouble(1);
+		},
+		[](const CameraRow& row) { return static_cast<int64_t>(row.frameNumber); }
+	);
+}
+
+bool EventStream::fillImu() {
+	return fillRows(
+		imu.statement, imu.rows, imu.position, imu.exhausted, error, options.chunkRows, imuKey,
+		[](const SqliteStatement& statement, Imu& row) {
+			row.id = static_cast<uint64_t>(statement.getInt64(0));
+			row.timestamp = statement.getDouble(1);
+			row.gravityX = statement.getDouble(2);
+			row.gravityY = statement.getDouble(3);
+			row.gravityZ = statement.getDouble(4);
+			row.userAcclerationX = statement.getDouble(5);
+			row.userAcclerationY = statement.getDouble(6);
+			row.userAcclerationZ = statement.getDouble(7);
+			row.rotationRateX = statement.getDouble(8);
+			row.rotationRateY = statement.getDouble(9);
+			row.rotationRateZ = statement.getDouble(10);
+			row.attitudeX = statement.getDouble(11);
+			row.attitudeY = statement.getDouble(12);
+			row.attitudeZ = statement.getDouble(13);
+		},
+		[](const Imu& row) { return EventStream::SensorKey{ row.timestamp, static_cast<int64_t>(row.id) }; }
+	);
+}
+
+bool EventStream::fillGps() {
+	return fillRows(
+		gps.statement, gps.rows, gps.position, gps.exhausted, error, options.chunkRows, gpsKey,
+		[](const SqliteStatement& statement, Gps& row) {
+			row.id = static_cast<uint64_t>(statement.getInt64(0));
+			row.timestamp = statement.getDouble(1);
+			row.latitude = statement.getDouble(2);
+			row.longitude = statement.getDouble(3);
+			row.altitude = statement.getDouble(4);
+			row.horizontalAccuracy = statement.getDouble(5);
+			row.verticalAccuracy = statement.getDouble(6);
+		},
+		[](const Gps& row) { return EventStream::SensorKey{ row.timestamp, static_cast<int64_t>(row.id) }; }
+	);
+}
+
+bool EventStream::next(SensorEvent& into) {
+	if (!isOpened()) { return false; }
+	const double to = options.to.value_or(std::numeric_limits<double>::infinity());
+
+	// 各カーソルの先頭のタイムスタンプ (toより後のイベントは無いものとする)
+	const double none = std::numeric_limits<double>::infinity();
+	const double imuHead = fillImu() ? imu.rows[imu.position].timestamp : none;
+	const double gpsHead = fillGps() ? gps.rows[gps.position].timestamp : none;
+	const double cameraHead = fillCamera() ? camera.rows[camera.position].timestamp : none;
+
+	// 同じタイムスタンプの場合はIMU、GPS、カメラの順にする
+	std::optional<EventType> type;
+	double timestamp = none;
+	if (imuHead <= to && imuHead < none) { type = EventType::IMU; timestamp = imuHead; }
+	if (gpsHead <= to && gpsHead < timestamp) { type = EventType::GPS; timestamp = gpsHead; }
+	if (cameraHead <= to && cameraHead < timestamp) { type = EventType::CAMERA; timestamp = cameraHead; }
+	if (!type.has_value()) { return false; }
+
+	into.type = type.value();
+	into.timestamp = timestamp;
+	switch (into.type) {
+		case EventType::CAMERA:
+			into.frameNumber = camera.rows[camera.position].frameNumber;
+			camera.position++;
+			break;
+		case EventType::IMU:
+			into.imu = imu.rows[imu.position];
+			imu.position++;
+			break;
+		case EventType::GPS:
+			into.gps = gps.rows[gps.position];
+			gps.position++;
+			break;
+	}
+	return true;
+}
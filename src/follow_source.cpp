@@ -0,0 +1,142 @@
+#include "follow_source.h"
+#include "trace.h"
+#include <algorithm>
+
+using namespace qs;
+
+FollowSource::FollowSource() {}
+
+FollowSource::~FollowSource() { close(); }
+
+void FollowSource::open(const std::filesystem::path& recDir, const FollowOptions& options) {
+	close();
+	this->recDir = recDir;
+	this->options = options;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopped = false;
+	}
+	opened = true;
+	lastChange = std::chrono::steady_clock::now();
+
+	// まだ録画が書き込まれていなければ、next()で書き込まれるのを待つ
+	update();
+}
+
+void FollowSource::close() {
+	loader.close();
+	opened = false;
+	nextFrame = 0;
+	videoPending = false;
+	stamp = RecordingStamp{};
+}
+
+bool FollowSource::isOpened() const {
+	return opened;
+}
+
+bool FollowSource::next(QuadFrame& into, FieldMask fields) {
+	QS_TRACE_SCOPE("FollowSource::next");
+	if (!opened) { return false; }
+	using Clock = std::chrono::steady_clock;
+
+	// IMUが書き込まれるのを待ち始めた時刻
+	std::optional<Clock::time_point> imuWaitBegin;
+	while (true) {
+		if (loader.isOpened() && !videoPending) {
+			const RecordingIndex& index = loader.getRecordingIndex();
+
+			// 行の無いフレームは、それより後のフレームの行が書き込まれていれば読み飛ばす (行はフレーム順に書き込まれる)
+			while (nextFrame + 1 < index.frameCount() && !index.timestamp(nextFrame).has_value()) { nextFrame++; }
+
+			const std::optional<double> timestamp = index.timestamp(nextFrame);
+			if (timestamp.has_value()) {
+				// フレームのタイムスタンプまでのIMUが書き込まれていなければ、imuWaitの間だけ待つ
+				const SensorBounds& imu = index.imuBounds();
+				// (補間する場合はフレームより後の値も必要)
+				const bool interpolated = fields & FIELD_IMU_INTERPOLATED;
+				bool imuReady = !(fields & (FIELD_IMU | FIELD_IMU_BATCH | FIELD_IMU_INTERPOLATED)) || (0 < imu.count && (
+					interpolated ? timestamp.value() < imu.last : timestamp.value() <= imu.last
+				));
+				if (!imuReady) {
+					if (!imuWaitBegin.has_value()) { imuWaitBegin = Clock::now(); }
+					imuReady = options.imuWait <= std::chrono::duration<double>(Clock::now() - imuWaitBegin.value()).count();
+				}
+				if (imuReady) {
+					if (loader.frame(nextFrame, into, fields)) {
+						nextFrame++;
+						return true;
+					}
+
+					// 行はあるが動画のフレームがまだ書き込まれていないので、ファイルが更新されるまで読み込まない
+					videoPending = true;
+				}
+			}
+		}
+
+		switch (wait()) {
+			case WaitResult::STOPPED:
+				return false;
+			case WaitResult::CHANGED:
+				update();
+				break;
+			case WaitResult::UNCHANGED:
+				if (0.0 < options.idleTimeout &&
+					options.idleTimeout <= std::chrono::duration<double>(Clock::now() - lastChange).count()
+				) { return false; }
+
+				// 書き込み中のロックなどで開けなかった場合は、ファイルが更新されなくても開き直す
+				if (!loader.isOpened()) { update(); }
+				break;
+		}
+	}
+}
+
+void FollowSource::seek(uint64_t frameNumber) {
+	nextFrame = frameNumber;
+	videoPending = false;
+}
+
+uint64_t FollowSource::getFrameCount() const {
+	return loader.isOpened() ? loader.getFrameCount() : 0;
+}
+
+const Description& FollowSource::getDescription() const {
+	return loader.isOpened() ? loader.getDescription() : emptyDescription;
+}
+
+void FollowSource::stop() {
+	std::lock_guard<std::mutex> lock(mutex);
+	stopped = true;
+	stopCondition.notify_all();
+}
+
+FollowSource::WaitResult FollowSource::wait() {
+	QS_TRACE_SCOPE("FollowSource::wait");
+	{
+		// ビジーループにならないよう、stop()が呼ばれるかpollIntervalが経過するまで眠る
+		std::unique_lock<std::mutex> lock(mutex);
+		const std::chrono::duration<double> interval(std::max(options.pollInterval, 0.001));
+		if (stopCondition.wait_for(lock, interval, [this]() { return stopped; })) { return WaitResult::STOPPED; }
+	}
+
+	const RecordingStamp current = readRecordingStamp(recDir);
+	if (current == stamp) { return WaitResult::UNCHANGED; }
+	lastChange = std::chrono::steady_clock::now();
+	return WaitResult::CHANGED;
+}
+
+void FollowSource::update() {
+	QS_TRACE_SCOPE("FollowSource::update");
+
+	// 読み込んでいる間に更新された場合は次のwait()で検出されるよう、読み込む前の状態を記録する
+	stamp = readRecordingStamp(recDir);
+	videoPending = false;
+
+	// 開いている録画には追記された行のみを加える (録画の長さによらず一定の時間で終わる)
+	if (loader.isOpened() && loader.refresh()) { return; }
+
+	// 書き込み中のディレクトリには索引を保存しないよう、読み込み専用で開く
+	loader.setSensorMemoryLimit(options.sensorMemoryLimit);
+	loader.open(recDir, OpenMode::READ_ONLY);
+}
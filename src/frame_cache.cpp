@@ -0,0 +1,156 @@
+#include "frame_cache.h"
+#include "inflate_engine.h"
+
+using namespace qs;
+
+// 行列が占めるバイト数
+static size_t matBytes(const cv::Mat& mat) {
+	return mat.total() * mat.elemSize();
+}
+
+// fieldsに含まれていればsrcをdstにコピーし、含まれていなければdstを空にする
+// (copyToはdstの解像度と型が一致する場合は再確保しない)
+static void copyField(const cv::Mat& src, cv::Mat& dst, FieldMask fields, FieldMask field) {
+	if (fields & field) { src.copyTo(dst); }
+	else { dst.release(); }
+}
+
+FrameCache::FrameCache(size_t capacityBytes, FieldMask cachedFields)
+	: capacityBytes(capacityBytes), cachedFields(cachedFields & FIELD_CAMERA) {}
+
+void FrameCache::setCapacity(size_t capacityBytes) {
+	this->capacityBytes = capacityBytes;
+	evict();
+}
+
+void FrameCache::setCachedFields(FieldMask cachedFields) {
+	// 保持するデータの種類が変わった場合は既存のエントリを破棄する
+	cachedFields &= FIELD_CAMERA;
+	if (this->cachedFields != cachedFields) { clear(); }
+	this->cachedFields = cachedFields;
+}
+
+size_t FrameCache::getCapacity() const {
+	return capacityBytes;
+}
+
+FieldMask FrameCache::getCachedFields() const {
+	return cachedFields;
+}
+
+bool FrameCache::isEnabled() const {
+	return 0 < capacityBytes && 0 != cachedFields;
+}
+
+bool FrameCache::get(uint64_t frameNumber, FieldMask fields, Camera& into) {
+	if (!isEnabled()) { return false; }
+	fields &= FIELD_CAMERA;
+	auto it = lookup.find(frameNumber);
+	if (it == lookup.end() || (it->second->fields & fields) != fields) {
+		missCount++;
+		return false;
+	}
+	hitCount++;
+
+	// 最近使用したエントリとして先頭に移動
+	entries.splice(entries.begin(), entries, it->second);
+	const Camera& camera = it->second->camera;
+
+	into.frameNumber = camera.frameNumber;
+	into.timestamp = camera.timestamp;
+	copyField(camera.color, into.color, fields, FIELD_COLOR);
+	copyField(camera.depth, into.depth, fields, FIELD_DEPTH);
+	copyField(camera.confidence, into.confidence, fields, FIELD_CONFIDENCE);
+	copyField(camera.intrinsicsMatrix, into.intrinsicsMatrix, fields, FIELD_MATRICES);
+	copyField(camera.projectionMatrix, into.projectionMatrix, fields, FIELD_MATRICES);
+	copyField(camera.viewMatrix, into.viewMatrix, fields, FIELD_MATRICES);
+	// 展開を遅延している行列は展開後に変更されないので共有する
+	into.lazyDepth = (fields & FIELD_DEPTH) ? camera.lazyDepth : nullptr;
+	into.lazyConfidence = (fields & FIELD_CONFIDENCE) ? camera.lazyConfidence : nullptr;
+	into.depthStatus = (fields & FIELD_DEPTH) ? camera.depthStatus : InflateStatus::SKIPPED;
+	into.confidenceStatus = (fields & FIELD_CONFIDENCE) ? camera.confidenceStatus : InflateStatus::SKIPPED;
+	return true;
+}
+
+void FrameCache::put(const Camera& camera, FieldMask fields) {
+	if (!isEnabled()) { return; }
+	fields &= cachedFields;
+	if (0 == fields) { return; }
+
+	// 登録するデータのみを深いコピーで保持する
+	Entry entry{ camera.frameNumber, Camera{}, fields, sizeof(Entry) };
+	entry.camera.frameNumber = camera.frameNumber;
+	entry.camera.timestamp = camera.timestamp;
+	if (fields & FIELD_COLOR) { entry.camera.color = camera.color.clone(); }
+	if (fields & FIELD_DEPTH) {
+		entry.camera.depth = camera.depth.clone();
+		entry.camera.lazyDepth = camera.lazyDepth;
+		entry.camera.depthStatus = camera.depthStatus;
+	}
+	if (fields & FIELD_CONFIDENCE) {
+		entry.camera.confidence = camera.confidence.clone();
+		entry.camera.lazyConfidence = camera.lazyConfidence;
+		entry.camera.confidenceStatus = camera.confidenceStatus;
+	}
+	if (fields & FIELD_MATRICES) {
+		entry.camera.intrinsicsMatrix = camera.intrinsicsMatrix.clone();
+		entry.camera.projectionMatrix = camera.projectionMatrix.clone();
+		entry.camera.viewMatrix = camera.viewMatrix.clone();
+	}
+	entry.bytes +=
+		matBytes(entry.camera.color) + matBytes(entry.camera.depth) + matBytes(entry.camera.confidence) +
+		matBytes(entry.camera.intrinsicsMatrix) + matBytes(entry.camera.projectionMatrix) + matBytes(entry.camera.viewMatrix);
+	if (entry.camera.lazyDepth) { entry.bytes += entry.camera.lazyDepth->bytes(); }
+	if (entry.camera.lazyConfidence) { entry.bytes += entry.camera.lazyConfidence->bytes(); }
+
+	// 1フレームで容量を超える場合は登録しない
+	if (capacityBytes < entry.bytes) { return; }
+
+	// 同じフレームが登録済みの場合は置き換える
+	auto it = lookup.find(camera.frameNumber);
+	if (it != lookup.end()) {
+		usedBytes -= it->second->bytes;
+		entries.erase(it->second);
+		lookup.erase(it);
+	}
+
+	usedBytes += entry.bytes;
+	entries.push_front(std::move(entry));
+	lookup[camera.frameNumber] = entries.begin();
+	evict();
+}
+
+void FrameCache::clear() {
+	entries.clear();
+	lookup.clear();
+	usedBytes = 0;
+}
+
+uint64_t FrameCache::hits() const {
+	return hitCount;
+}
+
+uint64_t FrameCache::misses() const {
+	return missCount;
+}
+
+size_t FrameCache::sizeBytes() const {
+	return usedBytes;
+}
+
+size_t FrameCache::entryCount() const {
+	return entries.size();
+}
+
+void FrameCache::resetCounters() {
+	hitCount = missCount = 0;
+}
+
+void FrameCache::evict() {
+	while (capacityBytes < usedBytes && !entries.empty()) {
+		const Entry& oldest = entries.back();
+		usedBytes -= oldest.bytes;
+		lookup.erase(oldest.frameNumber);
+		entries.pop_back();
+	}
+}
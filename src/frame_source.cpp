@@ -0,0 +1,66 @@
+#include "frame_source.h"
+#include "quad_loader.h"
+#include "packed_recording.h"
+#include "image_sequence_source.h"
+#include "follow_source.h"
+
+using namespace qs;
+
+bool FrameSource::frame(uint64_t frameNumber, QuadFrame& into, FieldMask fields) {
+	seek(frameNumber);
+	return next(into, fields);
+}
+
+void qs::releaseBorrowedMats(Camera& camera) {
+	for (cv::Mat* mat : {
+		&camera.color, &camera.depth, &camera.confidence,
+		&camera.intrinsicsMatrix, &camera.projectionMatrix, &camera.viewMatrix,
+	}) {
+		// 外部の領域を指す行列は参照カウンタ (cv::Mat::u) を持たない
+		if (!mat->empty() && nullptr == mat->u) { mat->release(); }
+	}
+}
+
+// 保存形式をディレクトリの中身から判別する
+static SourceType detectSourceType(const std::filesystem::path& path) {
+	std::error_code error;
+	if (std::filesystem::exists(path / "packed.qsp", error)) { return SourceType::PACKED; }
+	if (std::filesystem::exists(path / "db.sqlite3", error)) { return SourceType::QUADDUMP; }
+	return SourceType::IMAGE_SEQUENCE;
+}
+
+std::unique_ptr<FrameSource> qs::openFrameSource(const std::filesystem::path& path, SourceType type) {
+	if (SourceType::AUTO == type) { type = detectSourceType(path); }
+
+	std::unique_ptr<FrameSource> source;
+	switch (type) {
+		case SourceType::PACKED: {
+			auto packed = std::make_unique<PackedLoader>();
+			packed->open(path);
+			source = std::move(packed);
+			break;
+		}
+		case SourceType::QUADDUMP: {
+			auto loader = std::make_unique<QuadLoader>();
+			loader->open(path);
+			source = std::move(loader);
+			break;
+		}
+		case SourceType::IMAGE_SEQUENCE: {
+			auto sequence = std::make_unique<ImageSequenceSource>();
+			sequence->open(path);
+			source = std::move(sequence);
+			break;
+		}
+		case SourceType::FOLLOW: {
+			auto follow = std::make_unique<FollowSource>();
+			follow->open(path);
+			source = std::move(follow);
+			break;
+		}
+		default: break;
+	}
+
+	if (!source || !source->isOpened()) { return nullptr; }
+	return source;
+}
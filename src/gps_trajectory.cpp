@@ -0,0 +1,333 @@
+#include "gps_trajectory.h"
+#include "trace.h"
+#include <cmath>
+#include <algorithm>
+#include "opencv2/core/hal/intrin.hpp"
+
+using namespace qs;
+
+namespace {
+	constexpr double degreeToRadian = 3.14159265358979323846 / 180.0;
+
+	// GpsBatchの全ての列 (timestampを含む)
+	using Column = std::vector<double> GpsBatch::*;
+	const Column gpsColumns[] = {
+		&GpsBatch::timestamp,
+		&GpsBatch::latitude, &GpsBatch::longitude, &GpsBatch::altitude,
+		&GpsBatch::horizontalAccuracy, &GpsBatch::verticalAccuracy,
+	};
+
+	// 一度に変換する要素数 (三角関数の結果を置く一時領域の大きさ)
+	constexpr size_t chunkSize = 256;
+
+	/*
+		count (chunkSize以下) 個の緯度経度高度をECEFに変換する
+			N = a / sqrt(1 - e^2 sin^2(φ))
+			X = (N + h) cos(φ) cos(λ)
+			Y = (N + h) cos(φ) sin(λ)
+			Z = (N (1 - e^2) + h) sin(φ)
+	*/
+	void geodeticToEcefChunk(
+		const double* latitude, const double* longitude, const double* altitude, size_t count,
+		double* x, double* y, double* z
+	) {
+		// 三角関数はSIMD化できないので先にまとめて計算する
+		double sinLat[chunkSize], cosLat[chunkSize], sinLon[chunkSize], cosLon[chunkSize];
+		for (size_t i = 0; i < count; i++) {
+			const double phi = latitude[i] * degreeToRadian, lambda = longitude[i] * degreeToRadian;
+			sinLat[i] = std::sin(phi); cosLat[i] = std::cos(phi);
+			sinLon[i] = std::sin(lambda); cosLon[i] = std::cos(lambda);
+		}
+
+		const double a = Wgs84::semiMajorAxis, e2 = Wgs84::eccentricity2;
+		size_t i = 0;
+#if CV_SIMD128_64F
+		const cv::v_float64x2 va = cv::v_setall_f64(a), one = cv::v_setall_f64(1.0);
+		const cv::v_float64x2 ve2 = cv::v_setall_f64(e2), polar = cv::v_setall_f64(1.0 - e2);
+		for (; i + 2 <= count; i += 2) {
+			const cv::v_float64x2 sp = cv::v_load(sinLat + i), cp = cv::v_load(cosLat + i);
+			const cv::v_float64x2 h = cv::v_load(altitude + i);
+			const cv::v_float64x2 n = va / cv::v_sqrt(one - ve2 * sp * sp);
+			const cv::v_float64x2 r = (n + h) * cp;
+			cv::v_store(x + i, r * cv::v_load(cosLon + i));
+			cv::v_store(y + i, r * cv::v_load(sinLon + i));
+			cv::v_store(z + i, cv::v_muladd(n, polar, h) * sp);
+		}
+#endif
+		for (; i < count; i++) {
+			const double n = a / std::sqrt(1.0 - e2 * sinLat[i] * sinLat[i]);
+			const double r = (n + altitude[i]) * cosLat[i];
+			x[i] = r * cosLon[i];
+			y[i] = r * sinLon[i];
+			z[i] = (n * (1.0 - e2) + altitude[i]) * sinLat[i];
+		}
+	}
+
+	// out = rotation * (in - origin) (count個のベクトル)
+	void rotateFromOrigin(
+		const double* rotation, const double* origin,
+		const double* x, const double* y, const double* z, size_t count,
+		double* outX, double* outY, double* outZ
+	) {
+		size_t i = 0;
+#if CV_SIMD128_64F
+		cv::v_float64x2 r[9];
+		for (int k = 0; k < 9; k++) { r[k] = cv::v_setall_f64(rotation[k]); }
+		const cv::v_float64x2 ox = cv::v_setall_f64(origin[0]), oy = cv::v_setall_f64(origin[1]), oz = cv::v_setall_f64(origin[2]);
+		for (; i + 2 <= count; i += 2) {
+			const cv::v_float64x2 dx = cv::v_load(x + i) - ox, dy = cv::v_load(y + i) - oy, dz = cv::v_load(z + i) - oz;
+			cv::v_store(outX + i, cv::v_muladd(r[0], dx, cv::v_muladd(r[1], dy, r[2] * dz)));
+			cv::v_store(outY + i, cv::v_muladd(r[3], dx, cv::v_muladd(r[4], dy, r[5] * dz)));
+			cv::v_store(outZ + i, cv::v_muladd(r[6], dx, cv::v_muladd(r[7], dy, r[8] * dz)));
+		}
+#endif
+		for (; i < count; i++) {
+			const double dx = x[i] - origin[0], dy = y[i] - origin[1], dz = z[i] - origin[2];
+			outX[i] = rotation[0] * dx + rotation[1] * dy + rotation[2] * dz;
+			outY[i] = rotation[3] * dx + rotation[4] * dy + rotation[5] * dz;
+			outZ[i] = rotation[6] * dx + rotation[7] * dy + rotation[8] * dz;
+		}
+	}
+}
+
+// GpsBatch
+size_t GpsBatch::size() const {
+	return timestamp.size();
+}
+
+bool GpsBatch::empty() const {
+	return timestamp.empty();
+}
+
+void GpsBatch::reserve(size_t capacity) {
+	for (Column column : gpsColumns) { (this->*column).reserve(capacity); }
+}
+
+void GpsBatch::resize(size_t size) {
+	for (Column column : gpsColumns) { (this->*column).resize(size); }
+}
+
+void GpsBatch::clear() {
+	for (Column column : gpsColumns) { (this->*column).clear(); }
+}
+
+void GpsBatch::assign(const Gps* first, const Gps* last) {
+	clear();
+	append(first, last);
+}
+
+void GpsBatch::append(const Gps* first, const Gps* last) {
+	const size_t offset = size();
+	resize(offset + static_cast<size_t>(last - first));
+	size_t i = offset;
+	for (const Gps* gps = first; gps != last; gps++, i++) {
+		timestamp[i] = gps->timestamp;
+		latitude[i] = gps->latitude;
+		longitude[i] = gps->longitude;
+		altitude[i] = gps->altitude;
+		horizontalAccuracy[i] = gps->horizontalAccuracy;
+		verticalAccuracy[i] = gps->verticalAccuracy;
+	}
+}
+
+void GpsBatch::push_back(const Gps& gps) {
+	append(&gps, &gps + 1);
+}
+
+Gps GpsBatch::at(size_t index) const {
+	return Gps{
+		0, timestamp[index],
+		latitude[index], longitude[index], altitude[index],
+		horizontalAccuracy[index], verticalAccuracy[index],
+	};
+}
+
+// ECEF
+cv::Vec3d qs::geodeticToEcef(double latitude, double longitude, double altitude) {
+	double x, y, z;
+	geodeticToEcefChunk(&latitude, &longitude, &altitude, 1, &x, &y, &z);
+	return cv::Vec3d(x, y, z);
+}
+
+void qs::geodeticToEcef(const GpsBatch& gps, Vec3Batch& ecef) {
+	QS_TRACE_SCOPE("geodeticToEcef");
+	const size_t count = gps.size();
+	ecef.resize(count);
+	for (size_t begin = 0; begin < count; begin += chunkSize) {
+		const size_t n = std::min(chunkSize, count - begin);
+		geodeticToEcefChunk(
+			gps.latitude.data() + begin, gps.longitude.data() + begin, gps.altitude.data() + begin, n,
+			ecef.x.data() + begin, ecef.y.data() + begin, ecef.z.data() + begin
+		);
+	}
+}
+
+// EnuFrame
+EnuFrame::EnuFrame() : EnuFrame(0.0, 0.0, 0.0) {}
+
+EnuFrame::EnuFrame(double latitude, double longitude, double altitude) :
+	latitude(latitude), longitude(longitude), altitude(altitude)
+{
+	const cv::Vec3d ecef = geodeticToEcef(latitude, longitude, altitude);
+	origin[0] = ecef[0]; origin[1] = ecef[1]; origin[2] = ecef[2];
+
+	// 各行は原点における東、北、上の単位ベクトル (ECEF)
+	const double phi = latitude * degreeToRadian, lambda = longitude * degreeToRadian;
+	const double sp = std::sin(phi), cp = std::cos(phi), sl = std::sin(lambda), cl = std::cos(lambda);
+	const double r[9] = {
+		-sl,      cl,       0.0,
+		-sp * cl, -sp * sl, cp,
+		cp * cl,  cp * sl,  sp,
+	};
+	std::copy(r, r + 9, rotation);
+}
+
+double EnuFrame::getLatitude() const {
+	return latitude;
+}
+
+double EnuFrame::getLongitude() const {
+	return longitude;
+}
+
+double EnuFrame::getAltitude() const {
+	return altitude;
+}
+
+cv::Vec3d EnuFrame::ecefToEnu(const cv::Vec3d& ecef) const {
+	double x, y, z;
+	rotateFromOrigin(rotation, origin, &ecef[0], &ecef[1], &ecef[2], 1, &x, &y, &z);
+	return cv::Vec3d(x, y, z);
+}
+
+cv::Vec3d EnuFrame::geodeticToEnu(double latitude, double longitude, double altitude) const {
+	return ecefToEnu(geodeticToEcef(latitude, longitude, altitude));
+}
+
+void EnuFrame::ecefToEnu(const Vec3Batch& ecef, Vec3Batch& enu) const {
+	const size_t count = ecef.size();
+	enu.resize(count);
+	rotateFromOrigin(
+		rotation, origin, ecef.x.data(), ecef.y.data(), ecef.z.data(), count,
+		enu.x.data(), enu.y.data(), enu.z.data()
+	);
+}
+
+void EnuFrame::geodeticToEnu(const GpsBatch& gps, Vec3Batch& enu) const {
+	QS_TRACE_SCOPE("EnuFrame::geodeticToEnu");
+	const size_t count = gps.size();
+	enu.resize(count);
+
+	// ECEFはチャンク毎に一時領域に置き、キャッシュに載っている間にENUへ変換する
+	double x[chunkSize], y[chunkSize], z[chunkSize];
+	for (size_t begin = 0; begin < count; begin += chunkSize) {
+		const size_t n = std::min(chunkSize, count - begin);
+		geodeticToEcefChunk(
+			gps.latitude.data() + begin, gps.longitude.data() + begin, gps.altitude.data() + begin, n, x, y, z
+		);
+		rotateFromOrigin(rotation, origin, x, y, z, n, enu.x.data() + begin, enu.y.data() + begin, enu.z.data() + begin);
+	}
+}
+
+// GpsTrajectory
+size_t GpsTrajectory::size() const {
+	return timestamp.size();
+}
+
+void GpsTrajectory::clear() {
+	frameNumber.clear();
+	timestamp.clear();
+	position.clear();
+	horizontalAccuracy.clear();
+	verticalAccuracy.clear();
+	valid.clear();
+}
+
+bool qs::buildGpsTrajectory(
+	const GpsBatch& gps, const std::vector<double>& timestamps,
+	const GpsTrajectoryOptions& options, GpsTrajectory& into
+) {
+	QS_TRACE_SCOPE("buildGpsTrajectory");
+	into.timestamp.clear();
+	into.position.clear();
+	into.horizontalAccuracy.clear();
+	into.verticalAccuracy.clear();
+	into.valid.clear();
+
+	// 原点 (指定されていなければ最初の有効な測位)
+	const size_t gpsCount = gps.size();
+	size_t firstValid = 0;
+	while (firstValid < gpsCount && gps.horizontalAccuracy[firstValid] < 0.0) { firstValid++; }
+	if (gpsCount == firstValid) { return false; }
+	if (options.origin.has_value()) {
+		const cv::Vec3d& origin = options.origin.value();
+		into.origin = EnuFrame(origin[0], origin[1], origin[2]);
+	}
+	else {
+		into.origin = EnuFrame(gps.latitude[firstValid], gps.longitude[firstValid], gps.altitude[firstValid]);
+	}
+
+	Vec3Batch enu;
+	into.origin.geodeticToEnu(gps, enu);
+
+	const size_t count = timestamps.size();
+	into.timestamp.assign(timestamps.begin(), timestamps.end());
+	into.position.resize(count);
+	into.horizontalAccuracy.resize(count);
+	into.verticalAccuracy.resize(count);
+	into.valid.resize(count);
+
+	// 時刻は昇順なので、窓の始点は前の時刻の位置から探し始める
+	const double sigma = std::max(options.smoothingTime, 1e-3);
+	const double radius = 3.0 * sigma;
+	const double inverseTwoSigma2 = 0.5 / (sigma * sigma);
+	const double minAccuracy = std::max(options.minAccuracy, 1e-3);
+	size_t windowBegin = 0;
+	for (size_t i = 0; i < count; i++) {
+		const double t = timestamps[i];
+		while (windowBegin < gpsCount && gps.timestamp[windowBegin] < t - radius) { windowBegin++; }
+
+		// 重み w = exp(-dt^2 / 2σ^2) / accuracy^2 による加重平均
+		double horizontalWeight = 0.0, horizontalVariance = 0.0, east = 0.0, north = 0.0;
+		double verticalWeight = 0.0, verticalVariance = 0.0, up = 0.0;
+		for (size_t k = windowBegin; k < gpsCount && gps.timestamp[k] <= t + radius; k++) {
+			if (gps.horizontalAccuracy[k] < 0.0) { continue; }
+			const double dt = gps.timestamp[k] - t;
+			const double kernel = std::exp(-dt * dt * inverseTwoSigma2);
+
+			const double h = std::max(gps.horizontalAccuracy[k], minAccuracy);
+			const double hw = kernel / (h * h);
+			horizontalWeight += hw;
+			horizontalVariance += hw * hw * h * h;
+			east += hw * enu.x[k];
+			north += hw * enu.y[k];
+
+			if (gps.verticalAccuracy[k] < 0.0) { continue; }
+			const double v = std::max(gps.verticalAccuracy[k], minAccuracy);
+			const double vw = kernel / (v * v);
+			verticalWeight += vw;
+			verticalVariance += vw * vw * v * v;
+			up += vw * enu.z[k];
+		}
+
+		into.valid[i] = (0.0 < horizontalWeight) ? 1 : 0;
+		if (0.0 < horizontalWeight) {
+			into.position.x[i] = east / horizontalWeight;
+			into.position.y[i] = north / horizontalWeight;
+			into.horizontalAccuracy[i] = std::sqrt(horizontalVariance) / horizontalWeight;
+		}
+		else {
+			into.position.x[i] = into.position.y[i] = 0.0;
+			into.horizontalAccuracy[i] = -1.0;
+		}
+		if (0.0 < verticalWeight) {
+			into.position.z[i] = up / verticalWeight;
+			into.verticalAccuracy[i] = std::sqrt(verticalVariance) / verticalWeight;
+		}
+		else {
+			into.position.z[i] = 0.0;
+			into.verticalAccuracy[i] = -1.0;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,157 @@
+#include "image_sequence_source.h"
+#include "trace.h"
+#include <map>
+#include <fstream>
+#include <algorithm>
+
+using namespace qs;
+
+// 画像として読み込む拡張子かどうか
+static bool isImage(const std::filesystem::path& path) {
+	std::string extension = path.extension().u8string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+	for (const char* candidate : { ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".exr" }) {
+		if (extension == candidate) { return true; }
+	}
+	return false;
+}
+
+// ディレクトリ内の画像をファイル名の順に列挙する
+static std::vector<std::filesystem::path> listImages(const std::filesystem::path& dir) {
+	std::vector<std::filesystem::path> images;
+	std::error_code error;
+	if (!std::filesystem::is_directory(dir, error)) { return images; }
+	for (const auto& entry : std::filesystem::directory_iterator(dir, error)) {
+		if (entry.is_regular_file(error) && isImage(entry.path())) { images.push_back(entry.path()); }
+	}
+	std::sort(images.begin(), images.end());
+	return images;
+}
+
+// 拡張子を除いたファイル名から画像のパスを引く表
+static std::map<std::string, std::filesystem::path> imagesByStem(const std::filesystem::path& dir) {
+	std::map<std::string, std::filesystem::path> images;
+	for (const auto& path : listImages(dir)) { images.emplace(path.stem().u8string(), path); }
+	return images;
+}
+
+ImageSequenceSource::ImageSequenceSource() {}
+
+ImageSequenceSource::~ImageSequenceSource() { close(); }
+
+void ImageSequenceSource::open(const std::filesystem::path& dir, double fps) {
+	QS_TRACE_SCOPE("ImageSequenceSource::open");
+	close();
+
+	std::vector<std::filesystem::path> colors = listImages(dir / "color");
+	if (colors.empty()) { colors = listImages(dir); }
+	if (colors.empty()) { close(); return; }
+	const auto depths = imagesByStem(dir / "depth");
+	const auto confidences = imagesByStem(dir / "confidence");
+
+	// タイムスタンプ
+	std::vector<double> timestamps;
+	std::ifstream timestampFile(dir / "timestamps.txt");
+	for (double timestamp; timestampFile >> timestamp;) { timestamps.push_back(timestamp); }
+
+	entries.reserve(colors.size());
+	for (size_t i = 0; i < colors.size(); i++) {
+		Entry entry;
+		entry.color = colors[i];
+		const std::string stem = colors[i].stem().u8string();
+		if (auto it = depths.find(stem); it != depths.end()) { entry.depth = it->second; }
+		if (auto it = confidences.find(stem); it != confidences.end()) { entry.confidence = it->second; }
+		entry.timestamp = (i < timestamps.size()) ? timestamps[i] : i / (0.0 < fps ? fps : 30.0);
+		entries.push_back(std::move(entry));
+	}
+
+	// 解像度は最初の画像から取得する
+	const cv::Mat color = cv::imread(entries[0].color.u8string(), cv::IMREAD_COLOR);
+	if (color.empty()) { close(); return; }
+	description.date = "";
+	description.colorWidth = static_cast<uint64_t>(color.cols);
+	description.colorHeight = static_cast<uint64_t>(color.rows);
+	description.depthWidth = description.depthHeight = std::nullopt;
+	description.confidenceWidth = description.confidenceHeight = std::nullopt;
+	if (!entries[0].depth.empty()) {
+		const cv::Mat depth = cv::imread(entries[0].depth.u8string(), cv::IMREAD_UNCHANGED);
+		if (!depth.empty()) { description.depthWidth = depth.cols; description.depthHeight = depth.rows; }
+	}
+	if (!entries[0].confidence.empty()) {
+		const cv::Mat confidence = cv::imread(entries[0].confidence.u8string(), cv::IMREAD_UNCHANGED);
+		if (!confidence.empty()) { description.confidenceWidth = confidence.cols; description.confidenceHeight = confidence.rows; }
+	}
+
+	nextFrameNumber = 0;
+}
+
+void ImageSequenceSource::close() {
+	entries.clear();
+	nextFrameNumber = 0;
+}
+
+bool ImageSequenceSource::isOpened() const {
+	return !entries.empty();
+}
+
+// 画像を読み込んでdstに書き込む (ファイルが無いか読み込めない場合はdstを空にする)
+static InflateStatus readImage(const std::filesystem::path& path, int flags, cv::Mat& dst) {
+	if (path.empty()) { dst.release(); return InflateStatus::MISSING; }
+	dst = cv::imread(path.u8string(), flags);
+	return dst.empty() ? InflateStatus::CORRUPTED : InflateStatus::OK;
+}
+
+bool ImageSequenceSource::next(QuadFrame& into, FieldMask fields) {
+	QS_TRACE_SCOPE("ImageSequenceSource::next");
+	if (entries.size() <= nextFrameNumber) { return false; }
+	const Entry& entry = entries[nextFrameNumber];
+	Camera& camera = into.camera;
+	releaseBorrowedMats(camera);
+	camera.frameNumber = nextFrameNumber;
+	camera.timestamp = entry.timestamp;
+	camera.lazyDepth.reset();
+	camera.lazyConfidence.reset();
+
+	if (fields & FIELD_COLOR) {
+		if (InflateStatus::OK != readImage(entry.color, cv::IMREAD_COLOR, camera.color)) { return false; }
+	}
+	else { camera.color.release(); }
+
+	if (fields & FIELD_DEPTH) {
+		camera.depthStatus = readImage(entry.depth, cv::IMREAD_UNCHANGED, camera.depth);
+		// 16bitの画像はミリメートル単位として、QuadDumpと同じメートル単位の浮動小数点に変換する
+		if (InflateStatus::OK == camera.depthStatus && CV_32FC1 != camera.depth.type()) {
+			if (CV_16UC1 == camera.depth.type()) { camera.depth.convertTo(camera.depth, CV_32F, 0.001); }
+			else { camera.depth.release(); camera.depthStatus = InflateStatus::CORRUPTED; }
+		}
+	}
+	else { camera.depth.release(); camera.depthStatus = InflateStatus::SKIPPED; }
+
+	if (fields & FIELD_CONFIDENCE) {
+		camera.confidenceStatus = readImage(entry.confidence, cv::IMREAD_GRAYSCALE, camera.confidence);
+	}
+	else { camera.confidence.release(); camera.confidenceStatus = InflateStatus::SKIPPED; }
+
+	camera.intrinsicsMatrix.release();
+	camera.projectionMatrix.release();
+	camera.viewMatrix.release();
+	into.imu.clear();
+	into.imuBatch.clear();
+	into.interpolatedImu.reset();
+	into.gps.clear();
+
+	nextFrameNumber++;
+	return true;
+}
+
+void ImageSequenceSource::seek(uint64_t frameNumber) {
+	nextFrameNumber = frameNumber;
+}
+
+uint64_t ImageSequenceSource::getFrameCount() const {
+	return entries.size();
+}
+
+const Description& ImageSequenceSource::getDescription() const {
+	return description;
+}
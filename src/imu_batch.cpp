@@ -0,0 +1,276 @@
+#include "types.h"
+#include "trace.h"
+#include <cmath>
+#include <algorithm>
+#include "opencv2/core/hal/intrin.hpp"
+
+using namespace qs;
+
+namespace {
+	// ImuBatchの全ての列 (timestampを含む)
+	using Column = std::vector<double> ImuBatch::*;
+	const Column imuColumns[] = {
+		&ImuBatch::timestamp,
+		&ImuBatch::gravityX, &ImuBatch::gravityY, &ImuBatch::gravityZ,
+		&ImuBatch::userAcclerationX, &ImuBatch::userAcclerationY, &ImuBatch::userAcclerationZ,
+		&ImuBatch::rotationRateX, &ImuBatch::rotationRateY, &ImuBatch::rotationRateZ,
+		&ImuBatch::attitudeX, &ImuBatch::attitudeY, &ImuBatch::attitudeZ,
+	};
+
+	// out[i] = sqrt(x[i]^2 + y[i]^2 + z[i]^2)
+	void norm3(const double* x, const double* y, const double* z, size_t count, double* out) {
+		size_t i = 0;
+#if CV_SIMD128_64F
+		for (; i + 2 <= count; i += 2) {
+			const cv::v_float64x2 vx = cv::v_load(x + i), vy = cv::v_load(y + i), vz = cv::v_load(z + i);
+			cv::v_store(out + i, cv::v_sqrt(cv::v_muladd(vx, vx, cv::v_muladd(vy, vy, vz * vz))));
+		}
+#endif
+		for (; i < count; i++) { out[i] = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]); }
+	}
+
+	// x[i] -= value
+	void subtract(double* x, size_t count, double value) {
+		size_t i = 0;
+#if CV_SIMD128_64F
+		const cv::v_float64x2 v = cv::v_setall_f64(value);
+		for (; i + 2 <= count; i += 2) { cv::v_store(x + i, cv::v_load(x + i) - v); }
+#endif
+		for (; i < count; i++) { x[i] -= value; }
+	}
+
+	/*
+		Rz(z) * Rx(x) * Ry(y) * a * scale を計算する
+		SIMDのベクトルとdoubleのどちらでも同じ式で計算できるようにテンプレートにしている。
+	*/
+	template<typename V>
+	void rotateToWorld(
+		V sx, V cx, V sy, V cy, V sz, V cz, V ax, V ay, V az, V scale,
+		V& ox, V& oy, V& oz
+	) {
+		// Ry * a
+		const V bx = cy * ax + sy * az;
+		const V bz = cy * az - sy * ax;
+		// Rx * (Ry * a)
+		const V cy_ = cx * ay - sx * bz;
+		const V cz_ = sx * ay + cx * bz;
+		// Rz * (Rx * Ry * a)
+		ox = (cz * bx - sz * cy_) * scale;
+		oy = (sz * bx + cz * cy_) * scale;
+		oz = cz_ * scale;
+	}
+
+	/*
+		rateを台形則で積分し、先頭をinitialとした累積値をoutに書き込む
+		各区間の増分をまとめて計算してから累積する (累積は直前の値に依存するためSIMD化しない)。
+	*/
+	void integrateAxis(const double* t, const double* rate, size_t count, double initial, double* out) {
+		if (0 == count) { return; }
+		out[0] = initial;
+		size_t i = 1;
+#if CV_SIMD128_64F
+		const cv::v_float64x2 half = cv::v_setall_f64(0.5);
+		for (; i + 2 <= count; i += 2) {
+			const cv::v_float64x2 dt = cv::v_load(t + i) - cv::v_load(t + i - 1);
+			const cv::v_float64x2 sum = cv::v_load(rate + i) + cv::v_load(rate + i - 1);
+			cv::v_store(out + i, sum * dt * half);
+		}
+#endif
+		for (; i < count; i++) { out[i] = 0.5 * (rate[i] + rate[i - 1]) * (t[i] - t[i - 1]); }
+		for (i = 1; i < count; i++) { out[i] += out[i - 1]; }
+	}
+}
+
+// Vec3Batch
+size_t Vec3Batch::size() const {
+	return x.size();
+}
+
+void Vec3Batch::resize(size_t size) {
+	x.resize(size);
+	y.resize(size);
+	z.resize(size);
+}
+
+void Vec3Batch::clear() {
+	x.clear();
+	y.clear();
+	z.clear();
+}
+
+cv::Vec3d Vec3Batch::at(size_t index) const {
+	return cv::Vec3d(x[index], y[index], z[index]);
+}
+
+// ImuBatch
+size_t ImuBatch::size() const {
+	return timestamp.size();
+}
+
+bool ImuBatch::empty() const {
+	return timestamp.empty();
+}
+
+void ImuBatch::reserve(size_t capacity) {
+	for (Column column : imuColumns) { (this->*column).reserve(capacity); }
+}
+
+void ImuBatch::resize(size_t size) {
+	for (Column column : imuColumns) { (this->*column).resize(size); }
+}
+
+void ImuBatch::clear() {
+	for (Column column : imuColumns) { (this->*column).clear(); }
+}
+
+void ImuBatch::assign(const Imu* first, const Imu* last) {
+	clear();
+	append(first, last);
+}
+
+void ImuBatch::append(const Imu* first, const Imu* last) {
+	const size_t offset = size();
+	resize(offset + static_cast<size_t>(last - first));
+
+	// 構造体の配列を列ごとの配列に並べ替える
+	size_t i = offset;
+	for (const Imu* imu = first; imu != last; imu++, i++) {
+		timestamp[i] = imu->timestamp;
+		gravityX[i] = imu->gravityX;
+		gravityY[i] = imu->gravityY;
+		gravityZ[i] = imu->gravityZ;
+		userAcclerationX[i] = imu->userAcclerationX;
+		userAcclerationY[i] = imu->userAcclerationY;
+		userAcclerationZ[i] = imu->userAcclerationZ;
+		rotationRateX[i] = imu->rotationRateX;
+		rotationRateY[i] = imu->rotationRateY;
+		rotationRateZ[i] = imu->rotationRateZ;
+		attitudeX[i] = imu->attitudeX;
+		attitudeY[i] = imu->attitudeY;
+		attitudeZ[i] = imu->attitudeZ;
+	}
+}
+
+void ImuBatch::push_back(const Imu& imu) {
+	append(&imu, &imu + 1);
+}
+
+void ImuBatch::append(const ImuBatch& other, size_t first, size_t last) {
+	for (Column column : imuColumns) {
+		const std::vector<double>& source = other.*column;
+		(this->*column).insert((this->*column).end(), source.begin() + first, source.begin() + last);
+	}
+}
+
+Imu ImuBatch::at(size_t index) const {
+	return Imu{
+		0, timestamp[index],
+		gravityX[index], gravityY[index], gravityZ[index],
+		userAcclerationX[index], userAcclerationY[index], userAcclerationZ[index],
+		rotationRateX[index], rotationRateY[index], rotationRateZ[index],
+		attitudeX[index], attitudeY[index], attitudeZ[index],
+	};
+}
+
+cv::Vec3d ImuBatch::gravity(size_t index) const {
+	return cv::Vec3d(gravityX[index], gravityY[index], gravityZ[index]);
+}
+
+cv::Vec3d ImuBatch::userAccleration(size_t index) const {
+	return cv::Vec3d(userAcclerationX[index], userAcclerationY[index], userAcclerationZ[index]);
+}
+
+cv::Vec3d ImuBatch::rotationRate(size_t index) const {
+	return cv::Vec3d(rotationRateX[index], rotationRateY[index], rotationRateZ[index]);
+}
+
+cv::Vec3d ImuBatch::attitude(size_t index) const {
+	return cv::Vec3d(attitudeX[index], attitudeY[index], attitudeZ[index]);
+}
+
+void ImuBatch::gravityNorm(std::vector<double>& out) const {
+	out.resize(size());
+	norm3(gravityX.data(), gravityY.data(), gravityZ.data(), size(), out.data());
+}
+
+void ImuBatch::userAcclerationNorm(std::vector<double>& out) const {
+	out.resize(size());
+	norm3(userAcclerationX.data(), userAcclerationY.data(), userAcclerationZ.data(), size(), out.data());
+}
+
+void ImuBatch::rotationRateNorm(std::vector<double>& out) const {
+	out.resize(size());
+	norm3(rotationRateX.data(), rotationRateY.data(), rotationRateZ.data(), size(), out.data());
+}
+
+void ImuBatch::subtractBias(const cv::Vec3d& acclerationBias, const cv::Vec3d& rotationRateBias) {
+	subtract(userAcclerationX.data(), size(), acclerationBias[0]);
+	subtract(userAcclerationY.data(), size(), acclerationBias[1]);
+	subtract(userAcclerationZ.data(), size(), acclerationBias[2]);
+	subtract(rotationRateX.data(), size(), rotationRateBias[0]);
+	subtract(rotationRateY.data(), size(), rotationRateBias[1]);
+	subtract(rotationRateZ.data(), size(), rotationRateBias[2]);
+}
+
+void ImuBatch::userAcclerationInWorld(Vec3Batch& out) const {
+	QS_TRACE_SCOPE("ImuBatch::userAcclerationInWorld");
+	const size_t count = size();
+	out.resize(count);
+
+	// 三角関数はSIMD化できないので、キャッシュに収まる大きさのチャンク毎に先にまとめて計算する
+	constexpr size_t chunkSize = 256;
+	double sx[chunkSize], cx[chunkSize], sy[chunkSize], cy[chunkSize], sz[chunkSize], cz[chunkSize];
+	for (size_t begin = 0; begin < count; begin += chunkSize) {
+		const size_t n = std::min(chunkSize, count - begin);
+		for (size_t j = 0; j < n; j++) {
+			sx[j] = std::sin(attitudeX[begin + j]); cx[j] = std::cos(attitudeX[begin + j]);
+			sy[j] = std::sin(attitudeY[begin + j]); cy[j] = std::cos(attitudeY[begin + j]);
+			sz[j] = std::sin(attitudeZ[begin + j]); cz[j] = std::cos(attitudeZ[begin + j]);
+		}
+
+		const double* ax = userAcclerationX.data() + begin;
+		const double* ay = userAcclerationY.data() + begin;
+		const double* az = userAcclerationZ.data() + begin;
+		double* ox = out.x.data() + begin;
+		double* oy = out.y.data() + begin;
+		double* oz = out.z.data() + begin;
+		size_t j = 0;
+#if CV_SIMD128_64F
+		const cv::v_float64x2 scale = cv::v_setall_f64(standardGravity);
+		for (; j + 2 <= n; j += 2) {
+			cv::v_float64x2 vx, vy, vz;
+			rotateToWorld(
+				cv::v_load(sx + j), cv::v_load(cx + j), cv::v_load(sy + j),
+				cv::v_load(cy + j), cv::v_load(sz + j), cv::v_load(cz + j),
+				cv::v_load(ax + j), cv::v_load(ay + j), cv::v_load(az + j), scale,
+				vx, vy, vz
+			);
+			cv::v_store(ox + j, vx);
+			cv::v_store(oy + j, vy);
+			cv::v_store(oz + j, vz);
+		}
+#endif
+		for (; j < n; j++) {
+			rotateToWorld(sx[j], cx[j], sy[j], cy[j], sz[j], cz[j], ax[j], ay[j], az[j], standardGravity, ox[j], oy[j], oz[j]);
+		}
+	}
+}
+
+void ImuBatch::integrate(
+	const cv::Vec3d& initialVelocity, const cv::Vec3d& initialPosition,
+	Vec3Batch& velocity, Vec3Batch& position
+) const {
+	QS_TRACE_SCOPE("ImuBatch::integrate");
+	const size_t count = size();
+	Vec3Batch accleration;
+	userAcclerationInWorld(accleration);
+	velocity.resize(count);
+	position.resize(count);
+	const double* t = timestamp.data();
+	integrateAxis(t, accleration.x.data(), count, initialVelocity[0], velocity.x.data());
+	integrateAxis(t, accleration.y.data(), count, initialVelocity[1], velocity.y.data());
+	integrateAxis(t, accleration.z.data(), count, initialVelocity[2], velocity.z.data());
+	integrateAxis(t, velocity.x.data(), count, initialPosition[0], position.x.data());
+	integrateAxis(t, velocity.y.data(), count, initialPosition[1], position.y.data());
+	integrateAxis(t, velocity.z.data(), count, initialPosition[2], position.z.data());
+}
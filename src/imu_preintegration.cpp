@@ -0,0 +1,333 @@
+#include "imu_preintegration.h"
+#include "trace.h"
+#include <cmath>
+
+using namespace qs;
+
+/*
+	メモ
+	事前積分は C. Forster et al., "On-Manifold Preintegration for Real-Time Visual-Inertial Odometry" (2017) に従う。
+	1区間に含まれるIMUの値は数個から数十個と少ないため、cv::Matxの一時オブジェクトを作らずに
+	行優先の固定長配列で計算し、結果のみをPreintegratedImuに書き込む。
+*/
+
+namespace {
+	// out = a * b (3x3、outはa, bと異なる領域であること)
+	void mul33(const double* a, const double* b, double* out) {
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				out[r * 3 + c] = a[r * 3 + 0] * b[0 * 3 + c] + a[r * 3 + 1] * b[1 * 3 + c] + a[r * 3 + 2] * b[2 * 3 + c];
+			}
+		}
+	}
+
+	// out = a^T * b (3x3、outはa, bと異なる領域であること)
+	void mul33TransposedA(const double* a, const double* b, double* out) {
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				out[r * 3 + c] = a[0 * 3 + r] * b[0 * 3 + c] + a[1 * 3 + r] * b[1 * 3 + c] + a[2 * 3 + r] * b[2 * 3 + c];
+			}
+		}
+	}
+
+	// out = a * v (3x3 * 3)
+	void mul33Vec(const double* a, const double* v, double* out) {
+		for (int r = 0; r < 3; r++) { out[r] = a[r * 3 + 0] * v[0] + a[r * 3 + 1] * v[1] + a[r * 3 + 2] * v[2]; }
+	}
+
+	// out = [v]x (歪対称行列)
+	void skew(const double* v, double* out) {
+		out[0] = 0.0;   out[1] = -v[2]; out[2] = v[1];
+		out[3] = v[2];  out[4] = 0.0;   out[5] = -v[0];
+		out[6] = -v[1]; out[7] = v[0];  out[8] = 0.0;
+	}
+
+	/*
+		回転ベクトルphiの指数写像Rと右Jacobian Jrを求める
+			R  = I + sin(θ)/θ [phi]x + (1 - cos(θ))/θ^2 [phi]x^2
+			Jr = I - (1 - cos(θ))/θ^2 [phi]x + (θ - sin(θ))/θ^3 [phi]x^2
+	*/
+	void expSo3(const double* phi, double* R, double* Jr) {
+		const double theta2 = phi[0] * phi[0] + phi[1] * phi[1] + phi[2] * phi[2];
+		double a, b, c;
+		if (theta2 < 1e-16) {
+			// θが小さい場合はテイラー展開の先頭の項を使用する
+			a = 1.0 - theta2 / 6.0;
+			b = 0.5 - theta2 / 24.0;
+			c = 1.0 / 6.0 - theta2 / 120.0;
+		}
+		else {
+			const double theta = std::sqrt(theta2);
+			const double s = std::sin(theta), co = std::cos(theta);
+			a = s / theta;
+			b = (1.0 - co) / theta2;
+			c = (theta - s) / (theta2 * theta);
+		}
+
+		// [phi]x^2 = phi * phi^T - θ^2 * I
+		double K[9], K2[9];
+		skew(phi, K);
+		for (int r = 0; r < 3; r++) {
+			for (int col = 0; col < 3; col++) {
+				K2[r * 3 + col] = phi[r] * phi[col] - ((r == col) ? theta2 : 0.0);
+			}
+		}
+		for (int i = 0; i < 9; i++) {
+			const double identity = (0 == i % 4) ? 1.0 : 0.0;
+			R[i] = identity + a * K[i] + b * K2[i];
+			Jr[i] = identity - b * K[i] + c * K2[i];
+		}
+	}
+
+	void setIdentity33(double* out) {
+		for (int i = 0; i < 9; i++) { out[i] = (0 == i % 4) ? 1.0 : 0.0; }
+	}
+
+	void copy33(const double* in, cv::Matx33d& out) {
+		for (int i = 0; i < 9; i++) { out.val[i] = in[i]; }
+	}
+
+	// 1つの区間を積分する
+	void preintegrateWindow(
+		const ImuBatch& samples, double from, double to, size_t begin, size_t end,
+		const ImuNoise& noise, const cv::Vec3d& accelBias, const cv::Vec3d& gyroBias,
+		PreintegratedImu& out
+	) {
+		const double g0 = ImuBatch::standardGravity;
+		const double gyroVariance = noise.gyroNoiseDensity * noise.gyroNoiseDensity;
+		const double accelVariance = noise.accelNoiseDensity * noise.accelNoiseDensity;
+
+		double R[9], v[3] = {0.0, 0.0, 0.0}, p[3] = {0.0, 0.0, 0.0};
+		double cov[81] = {};
+		double rotationByGyroBias[9] = {};
+		double velocityByAccelBias[9] = {}, velocityByGyroBias[9] = {};
+		double positionByAccelBias[9] = {}, positionByGyroBias[9] = {};
+		setIdentity33(R);
+
+		// 状態遷移行列 A (ループごとに変化しない要素はここで設定する)
+		double A[81] = {};
+		for (int i = 3; i < 9; i++) { A[i * 9 + i] = 1.0; }
+		double tmp[81];
+
+		for (size_t k = begin; k < end; k++) {
+			const double start = (k == begin) ? from : samples.timestamp[k];
+			const double stop = (k + 1 < end) ? samples.timestamp[k + 1] : to;
+			const double dt = stop - start;
+			if (dt <= 0.0) { continue; }
+
+			const double f[3] = {
+				(samples.userAcclerationX[k] - samples.gravityX[k]) * g0 - accelBias[0],
+				(samples.userAcclerationY[k] - samples.gravityY[k]) * g0 - accelBias[1],
+				(samples.userAcclerationZ[k] - samples.gravityZ[k]) * g0 - accelBias[2],
+			};
+			const double phi[3] = {
+				(samples.rotationRateX[k] - gyroBias[0]) * dt,
+				(samples.rotationRateY[k] - gyroBias[1]) * dt,
+				(samples.rotationRateZ[k] - gyroBias[2]) * dt,
+			};
+			double dR[9], Jr[9];
+			expSo3(phi, dR, Jr);
+
+			// RF = ΔR * [f]x
+			double F[9], RF[9];
+			skew(f, F);
+			mul33(R, F, RF);
+
+			// 共分散 Σ = A Σ A^T + B Q B^T
+			{
+				for (int r = 0; r < 3; r++) {
+					for (int c = 0; c < 3; c++) {
+						A[r * 9 + c] = dR[c * 3 + r];
+						A[(3 + r) * 9 + c] = -RF[r * 3 + c] * dt;
+						A[(6 + r) * 9 + c] = -0.5 * RF[r * 3 + c] * dt * dt;
+					}
+					A[(6 + r) * 9 + (3 + r)] = dt;
+				}
+				for (int r = 0; r < 9; r++) {
+					for (int c = 0; c < 9; c++) {
+						double sum = 0.0;
+						for (int i = 0; i < 9; i++) { sum += A[r * 9 + i] * cov[i * 9 + c]; }
+						tmp[r * 9 + c] = sum;
+					}
+				}
+				for (int r = 0; r < 9; r++) {
+					for (int c = r; c < 9; c++) {
+						double sum = 0.0;
+						for (int i = 0; i < 9; i++) { sum += tmp[r * 9 + i] * A[c * 9 + i]; }
+						cov[r * 9 + c] = cov[c * 9 + r] = sum;
+					}
+				}
+
+				// 回転のノイズ: Jr Jr^T σg^2 dt
+				for (int r = 0; r < 3; r++) {
+					for (int c = 0; c < 3; c++) {
+						const double JJ = Jr[r * 3 + 0] * Jr[c * 3 + 0] + Jr[r * 3 + 1] * Jr[c * 3 + 1] + Jr[r * 3 + 2] * Jr[c * 3 + 2];
+						cov[r * 9 + c] += JJ * gyroVariance * dt;
+					}
+				}
+				// 速度と位置のノイズ (ΔR ΔR^T = I なので対角成分のみ)
+				for (int i = 0; i < 3; i++) {
+					cov[(3 + i) * 9 + (3 + i)] += accelVariance * dt;
+					cov[(3 + i) * 9 + (6 + i)] += 0.5 * accelVariance * dt * dt;
+					cov[(6 + i) * 9 + (3 + i)] += 0.5 * accelVariance * dt * dt;
+					cov[(6 + i) * 9 + (6 + i)] += 0.25 * accelVariance * dt * dt * dt;
+				}
+			}
+
+			// バイアスに関するJacobian (更新前のΔRとJacobianを使用する)
+			{
+				double RFJ[9], next[9];
+				mul33(RF, rotationByGyroBias, RFJ);
+				for (int i = 0; i < 9; i++) {
+					positionByAccelBias[i] += velocityByAccelBias[i] * dt - 0.5 * R[i] * dt * dt;
+					positionByGyroBias[i] += velocityByGyroBias[i] * dt - 0.5 * RFJ[i] * dt * dt;
+					velocityByAccelBias[i] -= R[i] * dt;
+					velocityByGyroBias[i] -= RFJ[i] * dt;
+				}
+				mul33TransposedA(dR, rotationByGyroBias, next);
+				for (int i = 0; i < 9; i++) { rotationByGyroBias[i] = next[i] - Jr[i] * dt; }
+			}
+
+			// 回転、速度、位置の変化量
+			{
+				double Rf[3], next[9];
+				mul33Vec(R, f, Rf);
+				for (int i = 0; i < 3; i++) {
+					p[i] += v[i] * dt + 0.5 * Rf[i] * dt * dt;
+					v[i] += Rf[i] * dt;
+				}
+				mul33(R, dR, next);
+				for (int i = 0; i < 9; i++) { R[i] = next[i]; }
+			}
+		}
+
+		out.startTime = from;
+		out.endTime = to;
+		out.deltaTime = to - from;
+		out.sampleCount = end - begin;
+		copy33(R, out.deltaRotation);
+		out.deltaVelocity = cv::Vec3d(v[0], v[1], v[2]);
+		out.deltaPosition = cv::Vec3d(p[0], p[1], p[2]);
+		for (int i = 0; i < 81; i++) { out.covariance.val[i] = cov[i]; }
+		copy33(rotationByGyroBias, out.rotationByGyroBias);
+		copy33(velocityByAccelBias, out.velocityByAccelBias);
+		copy33(velocityByGyroBias, out.velocityByGyroBias);
+		copy33(positionByAccelBias, out.positionByAccelBias);
+		copy33(positionByGyroBias, out.positionByGyroBias);
+		out.accelBias = accelBias;
+		out.gyroBias = gyroBias;
+	}
+
+	// out = J * (newBias - bias) を加えたベクトル
+	cv::Vec3d addLinear(
+		const cv::Vec3d& value,
+		const cv::Matx33d& accelJacobian, const cv::Vec3d& accelDelta,
+		const cv::Matx33d& gyroJacobian, const cv::Vec3d& gyroDelta
+	) {
+		double a[3], g[3];
+		mul33Vec(accelJacobian.val, accelDelta.val, a);
+		mul33Vec(gyroJacobian.val, gyroDelta.val, g);
+		return cv::Vec3d(value[0] + a[0] + g[0], value[1] + a[1] + g[1], value[2] + a[2] + g[2]);
+	}
+}
+
+// PreintegratedImu
+cv::Matx33d PreintegratedImu::correctedRotation(const cv::Vec3d& newGyroBias) const {
+	// ΔR(b) = ΔR(b0) * Exp(∂ΔR/∂bg * (b - b0))
+	const cv::Vec3d delta = newGyroBias - gyroBias;
+	double phi[3], dR[9], Jr[9], R[9];
+	mul33Vec(rotationByGyroBias.val, delta.val, phi);
+	expSo3(phi, dR, Jr);
+	mul33(deltaRotation.val, dR, R);
+	cv::Matx33d out;
+	copy33(R, out);
+	return out;
+}
+
+cv::Vec3d PreintegratedImu::correctedVelocity(const cv::Vec3d& newAccelBias, const cv::Vec3d& newGyroBias) const {
+	return addLinear(deltaVelocity, velocityByAccelBias, newAccelBias - accelBias, velocityByGyroBias, newGyroBias - gyroBias);
+}
+
+cv::Vec3d PreintegratedImu::correctedPosition(const cv::Vec3d& newAccelBias, const cv::Vec3d& newGyroBias) const {
+	return addLinear(deltaPosition, positionByAccelBias, newAccelBias - accelBias, positionByGyroBias, newGyroBias - gyroBias);
+}
+
+// ImuPreintegrator
+ImuPreintegrator::ImuPreintegrator() {}
+
+ImuPreintegrator::ImuPreintegrator(const ImuNoise& noise) : noise(noise) {}
+
+void ImuPreintegrator::setNoise(const ImuNoise& noise) {
+	this->noise = noise;
+}
+
+const ImuNoise& ImuPreintegrator::getNoise() const {
+	return noise;
+}
+
+void ImuPreintegrator::clear() {
+	samples.clear();
+	windows.clear();
+	preintegrated.clear();
+	lastFrameTimestamp.reset();
+}
+
+void ImuPreintegrator::reserve(size_t windows, size_t samples) {
+	this->windows.reserve(windows);
+	this->preintegrated.reserve(windows);
+	this->samples.reserve(samples);
+}
+
+size_t ImuPreintegrator::addWindow(double from, double to, const Imu* first, const Imu* last) {
+	const size_t begin = samples.size();
+	samples.append(first, last);
+	windows.push_back(Window{ from, to, begin, samples.size() });
+	preintegrated.emplace_back();
+	return windows.size() - 1;
+}
+
+size_t ImuPreintegrator::addWindow(double from, double to, const ImuBatch& batch) {
+	const size_t begin = samples.size();
+	samples.append(batch, 0, batch.size());
+	windows.push_back(Window{ from, to, begin, samples.size() });
+	preintegrated.emplace_back();
+	return windows.size() - 1;
+}
+
+size_t ImuPreintegrator::addFrame(const QuadFrame& frame) {
+	const double to = frame.camera.timestamp;
+	size_t index;
+	if (!frame.imuBatch.empty()) {
+		const double from = lastFrameTimestamp.value_or(frame.imuBatch.timestamp.front());
+		index = addWindow(from, to, frame.imuBatch);
+	}
+	else {
+		const double from = lastFrameTimestamp.value_or(frame.imu.empty() ? to : frame.imu.front().timestamp);
+		index = addWindow(from, to, frame.imu.data(), frame.imu.data() + frame.imu.size());
+	}
+	lastFrameTimestamp = to;
+	return index;
+}
+
+size_t ImuPreintegrator::size() const {
+	return windows.size();
+}
+
+void ImuPreintegrator::integrate(const cv::Vec3d& accelBias, const cv::Vec3d& gyroBias) {
+	QS_TRACE_SCOPE("ImuPreintegrator::integrate");
+	for (size_t i = 0; i < windows.size(); i++) {
+		const Window& window = windows[i];
+		preintegrateWindow(
+			samples, window.from, window.to, window.begin, window.end,
+			noise, accelBias, gyroBias, preintegrated[i]
+		);
+	}
+}
+
+const PreintegratedImu& ImuPreintegrator::at(size_t index) const {
+	return preintegrated.at(index);
+}
+
+const std::vector<PreintegratedImu>& ImuPreintegrator::results() const {
+	return preintegrated;
+}
@@ -0,0 +1,196 @@
+#include "imu_resampler.h"
+#include "trace.h"
+#include <cmath>
+#include <algorithm>
+#include "opencv2/core/hal/intrin.hpp"
+
+using namespace qs;
+
+namespace {
+	struct Quaternion {
+		double w, x, y, z;
+	};
+
+	// オイラー角 (Rz(z) * Rx(x) * Ry(y)) を四元数に変換する
+	Quaternion toQuaternion(double attitudeX, double attitudeY, double attitudeZ) {
+		const double cx = std::cos(attitudeX * 0.5), sx = std::sin(attitudeX * 0.5);
+		const double cy = std::cos(attitudeY * 0.5), sy = std::sin(attitudeY * 0.5);
+		const double cz = std::cos(attitudeZ * 0.5), sz = std::sin(attitudeZ * 0.5);
+		return Quaternion{
+			cz * cx * cy - sz * sx * sy,
+			cz * sx * cy - cx * sz * sy,
+			cz * cx * sy + sz * sx * cy,
+			cx * sz * cy + cz * sx * sy,
+		};
+	}
+
+	// 四元数をオイラー角に戻す (回転行列の R21 = sin(x), R20 = -cos(x)sin(y), R22 = cos(x)cos(y), R01 = -sin(z)cos(x), R11 = cos(z)cos(x) を使う)
+	void toEuler(const Quaternion& q, double& attitudeX, double& attitudeY, double& attitudeZ) {
+		const double r21 = 2.0 * (q.y * q.z + q.w * q.x);
+		const double r20 = 2.0 * (q.x * q.z - q.w * q.y);
+		const double r22 = 1.0 - 2.0 * (q.x * q.x + q.y * q.y);
+		const double r01 = 2.0 * (q.x * q.y - q.w * q.z);
+		const double r11 = 1.0 - 2.0 * (q.x * q.x + q.z * q.z);
+		attitudeX = std::asin(std::clamp(r21, -1.0, 1.0));
+		attitudeY = std::atan2(-r20, r22);
+		attitudeZ = std::atan2(-r01, r11);
+	}
+
+	Quaternion slerp(const Quaternion& a, Quaternion b, double t) {
+		double dot = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+		// 短い方の弧を通るようにする
+		if (dot < 0.0) { b = Quaternion{ -b.w, -b.x, -b.y, -b.z }; dot = -dot; }
+		double wa, wb;
+		if (0.9995 < dot) {
+			// ほぼ同じ向きの場合は線形補間して正規化する
+			wa = 1.0 - t;
+			wb = t;
+		}
+		else {
+			const double theta = std::acos(dot);
+			const double s = std::sin(theta);
+			wa = std::sin((1.0 - t) * theta) / s;
+			wb = std::sin(t * theta) / s;
+		}
+		Quaternion q{ wa * a.w + wb * b.w, wa * a.x + wb * b.x, wa * a.y + wb * b.y, wa * a.z + wb * b.z };
+		const double norm = std::sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+		return Quaternion{ q.w / norm, q.x / norm, q.y / norm, q.z / norm };
+	}
+
+	double weightOf(double before, double after, double timestamp) {
+		return (before < after) ? std::clamp((timestamp - before) / (after - before), 0.0, 1.0) : 0.0;
+	}
+
+	// out[i] = lo[i] + w[i] * (hi[i] - lo[i])
+	void lerp(const double* lo, const double* hi, const double* w, size_t count, double* out) {
+		size_t i = 0;
+#if CV_SIMD128_64F
+		for (; i + 2 <= count; i += 2) {
+			const cv::v_float64x2 vlo = cv::v_load(lo + i);
+			cv::v_store(out + i, cv::v_muladd(cv::v_load(w + i), cv::v_load(hi + i) - vlo, vlo));
+		}
+#endif
+		for (; i < count; i++) { out[i] = lo[i] + w[i] * (hi[i] - lo[i]); }
+	}
+
+	// 線形補間する列 (attitudeは別に処理する)
+	using Column = std::vector<double> ImuBatch::*;
+	const Column linearColumns[] = {
+		&ImuBatch::gravityX, &ImuBatch::gravityY, &ImuBatch::gravityZ,
+		&ImuBatch::userAcclerationX, &ImuBatch::userAcclerationY, &ImuBatch::userAcclerationZ,
+		&ImuBatch::rotationRateX, &ImuBatch::rotationRateY, &ImuBatch::rotationRateZ,
+	};
+}
+
+void qs::resampleImu(const ImuBatch& samples, const double* timestamps, size_t count, ImuBatch& into) {
+	QS_TRACE_SCOPE("resampleImu");
+	const size_t sampleCount = samples.size();
+	if (0 == sampleCount) { into.clear(); return; }
+	into.resize(count);
+	std::copy(timestamps, timestamps + count, into.timestamp.begin());
+
+	/*
+		時刻はチャンク毎に次の手順で補間する
+		1. 各時刻の前後の値の番号と重みを求める (時刻は昇順なので、前の時刻の位置から探し始める)
+		2. 線形補間する列の前後の値を連続した配列に集め、SIMD命令で補間する
+		3. attitudeは1つずつ球面線形補間する (同じ値を何度も四元数に変換しないように直前の結果を再利用する)
+	*/
+	constexpr size_t chunkSize = 256;
+	size_t loIndex[chunkSize], hiIndex[chunkSize];
+	double weight[chunkSize], lo[chunkSize], hi[chunkSize];
+	const double* t = samples.timestamp.data();
+	size_t cursor = 0;
+	size_t cachedLo = sampleCount, cachedHi = sampleCount;
+	Quaternion quaternionLo{}, quaternionHi{};
+
+	for (size_t begin = 0; begin < count; begin += chunkSize) {
+		const size_t n = std::min(chunkSize, count - begin);
+
+		// 1. 前後の値の番号と重み
+		for (size_t j = 0; j < n; j++) {
+			const double timestamp = timestamps[begin + j];
+			while (cursor + 1 < sampleCount && t[cursor + 1] <= timestamp) { cursor++; }
+			if (timestamp <= t[cursor] || cursor + 1 == sampleCount) {
+				loIndex[j] = hiIndex[j] = cursor;
+				weight[j] = 0.0;
+			}
+			else {
+				loIndex[j] = cursor;
+				hiIndex[j] = cursor + 1;
+				weight[j] = weightOf(t[cursor], t[cursor + 1], timestamp);
+			}
+		}
+
+		// 2. 線形補間
+		for (Column column : linearColumns) {
+			const double* source = (samples.*column).data();
+			for (size_t j = 0; j < n; j++) {
+				lo[j] = source[loIndex[j]];
+				hi[j] = source[hiIndex[j]];
+			}
+			lerp(lo, hi, weight, n, (into.*column).data() + begin);
+		}
+
+		// 3. 球面線形補間
+		for (size_t j = 0; j < n; j++) {
+			const size_t a = loIndex[j], b = hiIndex[j];
+			const size_t i = begin + j;
+			if (a == b || 0.0 == weight[j]) {
+				into.attitudeX[i] = samples.attitudeX[a];
+				into.attitudeY[i] = samples.attitudeY[a];
+				into.attitudeZ[i] = samples.attitudeZ[a];
+				continue;
+			}
+			if (a != cachedLo) {
+				quaternionLo = (a == cachedHi) ? quaternionHi :
+					toQuaternion(samples.attitudeX[a], samples.attitudeY[a], samples.attitudeZ[a]);
+				cachedLo = a;
+			}
+			if (b != cachedHi) {
+				quaternionHi = toQuaternion(samples.attitudeX[b], samples.attitudeY[b], samples.attitudeZ[b]);
+				cachedHi = b;
+			}
+			toEuler(slerp(quaternionLo, quaternionHi, weight[j]), into.attitudeX[i], into.attitudeY[i], into.attitudeZ[i]);
+		}
+	}
+}
+
+void qs::resampleImu(const ImuBatch& samples, const std::vector<double>& timestamps, ImuBatch& into) {
+	resampleImu(samples, timestamps.data(), timestamps.size(), into);
+}
+
+Imu qs::interpolateImu(const Imu& before, const Imu& after, double timestamp) {
+	const double w = weightOf(before.timestamp, after.timestamp, timestamp);
+	auto mix = [w](double a, double b) { return a + w * (b - a); };
+	Imu imu{
+		0, timestamp,
+		mix(before.gravityX, after.gravityX), mix(before.gravityY, after.gravityY), mix(before.gravityZ, after.gravityZ),
+		mix(before.userAcclerationX, after.userAcclerationX),
+		mix(before.userAcclerationY, after.userAcclerationY),
+		mix(before.userAcclerationZ, after.userAcclerationZ),
+		mix(before.rotationRateX, after.rotationRateX),
+		mix(before.rotationRateY, after.rotationRateY),
+		mix(before.rotationRateZ, after.rotationRateZ),
+		before.attitudeX, before.attitudeY, before.attitudeZ,
+	};
+	if (0.0 < w) {
+		toEuler(
+			slerp(
+				toQuaternion(before.attitudeX, before.attitudeY, before.attitudeZ),
+				toQuaternion(after.attitudeX, after.attitudeY, after.attitudeZ), w
+			),
+			imu.attitudeX, imu.attitudeY, imu.attitudeZ
+		);
+	}
+	return imu;
+}
+
+std::optional<Imu> qs::interpolateImu(const std::optional<Imu>& before, const std::optional<Imu>& after, double timestamp) {
+	if (before.has_value() && after.has_value()) { return interpolateImu(before.value(), after.value(), timestamp); }
+	std::optional<Imu> nearest = before.has_value() ? before : after;
+	if (nearest.has_value()) {
+		nearest->id = 0;
+		nearest->timestamp = timestamp;
+	}
+	return nearest;
+}
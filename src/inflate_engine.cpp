@@ -0,0 +1,219 @@
+#include "inflate_engine.h"
+#include "trace.h"
+#include <cassert>
+#include <cstring>
+
+using namespace qs;
+
+// Inflater
+Inflater::Inflater() {
+	memset(&stream, 0, sizeof(z_stream));
+}
+
+Inflater::~Inflater() {
+	if (initialized) { inflateEnd(&stream); }
+}
+
+InflateStatus Inflater::inflate(
+	const std::optional<std::vector<char>>& src,
+	const std::optional<uint64_t>& width, const std::optional<uint64_t>& height,
+	int type, cv::Mat& dst
+) {
+	if (!src.has_value() || !width.has_value() || !height.has_value()) {
+		dst.release();
+		return InflateStatus::MISSING;
+	}
+
+	// cv::Matは行間にアライメントが混入する場合があるが、
+	// cv::Mat::createによって作成された配列は常に連続となる
+	// また、解像度と型が既存の配列と一致する場合は再確保されない
+	dst.create(static_cast<int>(height.value()), static_cast<int>(width.value()), type);
+	assert(dst.isContinuous());
+
+	// z_streamは初回のみ初期化し、2回目以降はリセットして再利用する
+	if (!initialized) {
+		if (Z_OK != inflateInit2(&stream, -15)) { dst.release(); return InflateStatus::CORRUPTED; }
+		initialized = true;
+	}
+	else if (Z_OK != inflateReset(&stream)) { dst.release(); return InflateStatus::CORRUPTED; }
+
+	stream.next_in = (Bytef*)src->data();
+	stream.avail_in = static_cast<uInt>(src->size());
+	stream.next_out = (Bytef*)dst.ptr<char>(0);
+	stream.avail_out = static_cast<uInt>(dst.total() * dst.elemSize());
+	const int result = ::inflate(&stream, Z_FINISH);
+
+	// 出力先が全て埋まった場合は成功とみなす
+	if ((Z_STREAM_END == result || Z_OK == result || Z_BUF_ERROR == result) && 0 == stream.avail_out) {
+		return InflateStatus::OK;
+	}
+	dst.release();
+	if (Z_STREAM_END == result || Z_BUF_ERROR == result) { return InflateStatus::TRUNCATED; }
+	return InflateStatus::CORRUPTED;
+}
+
+// LazyInflate
+void LazyInflate::assign(
+	const std::optional<std::vector<char>>& src,
+	const std::optional<uint64_t>& width, const std::optional<uint64_t>& height,
+	int type
+) {
+	if (src.has_value()) {
+		if (!this->src.has_value()) { this->src.emplace(); }
+		this->src->assign(src->begin(), src->end());
+	}
+	else { this->src.reset(); }
+	this->width = width;
+	this->height = height;
+	this->type = type;
+	inflateStatus = InflateStatus::DEFERRED;
+	inflated.store(false, std::memory_order_release);
+}
+
+const cv::Mat& LazyInflate::get() const {
+	// 展開済みであればロックを取らずに返す
+	if (!inflated.load(std::memory_order_acquire)) { inflate(); }
+	return mat;
+}
+
+InflateStatus LazyInflate::status() const {
+	if (!inflated.load(std::memory_order_acquire)) { inflate(); }
+	return inflateStatus;
+}
+
+bool LazyInflate::isInflated() const {
+	return inflated.load(std::memory_order_acquire);
+}
+
+size_t LazyInflate::bytes() const {
+	size_t size = src.has_value() ? src->size() : 0;
+	if (width.has_value() && height.has_value()) { size += width.value() * height.value() * CV_ELEM_SIZE(type); }
+	return size;
+}
+
+void LazyInflate::inflate() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (inflated.load(std::memory_order_relaxed)) { return; }
+	QS_TRACE_SCOPE("LazyInflate::inflate");
+
+	// z_streamはスレッド毎に使い回す
+	thread_local Inflater inflater;
+	inflateStatus = inflater.inflate(src, width, height, type, mat);
+	inflated.store(true, std::memory_order_release);
+}
+
+// InflateEngine
+InflateEngine::InflateEngine() {}
+
+InflateEngine::~InflateEngine() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	jobReady.notify_one();
+	if (worker.joinable()) { worker.join(); }
+}
+
+void InflateEngine::inflate(const CameraForOrm& row, const Description& description, Camera& into, FieldMask fields) {
+	QS_TRACE_SCOPE("InflateEngine::inflate");
+	const bool withDepth = (fields & FIELD_DEPTH);
+	const bool withConfidence = (fields & FIELD_CONFIDENCE);
+	into.lazyDepth.reset();
+	into.lazyConfidence.reset();
+
+	// 片方のみの場合や、並列に展開しない設定の場合はこのスレッドで展開する
+	if (!withDepth || !withConfidence || !parallel) {
+		if (withDepth) {
+			into.depthStatus = depthInflater.inflate(
+				row.depthZlib, description.depthWidth, description.depthHeight, CV_32FC1, into.depth
+			);
+		}
+		else { into.depth.release(); into.depthStatus = InflateStatus::SKIPPED; }
+		if (withConfidence) {
+			into.confidenceStatus = confidenceInflater.inflate(
+				row.confidenceZlib, description.confidenceWidth, description.confidenceHeight, CV_8UC1, into.confidence
+			);
+		}
+		else { into.confidence.release(); into.confidenceStatus = InflateStatus::SKIPPED; }
+		return;
+	}
+
+	// ワーカースレッドは初回の呼び出し時に起動する
+	if (!worker.joinable()) { worker = std::thread([this]() { run(); }); }
+
+	// 信頼度の展開をワーカースレッドに依頼
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = Job{
+			&row.confidenceZlib, &description.confidenceWidth, &description.confidenceHeight,
+			&into.confidence, &into.confidenceStatus
+		};
+	}
+	jobReady.notify_one();
+
+	// デプスはこのスレッドで展開
+	{
+		QS_TRACE_SCOPE("inflate depth");
+		into.depthStatus = depthInflater.inflate(
+			row.depthZlib, description.depthWidth, description.depthHeight, CV_32FC1, into.depth
+		);
+	}
+
+	// 信頼度の展開が終わるのを待つ
+	std::unique_lock<std::mutex> lock(mutex);
+	jobDone.wait(lock, [this]() { return !job.has_value(); });
+}
+
+void InflateEngine::setParallel(bool parallel) {
+	this->parallel = parallel;
+}
+
+bool InflateEngine::getParallel() const {
+	return parallel;
+}
+
+// 共有されていなければptrの領域を再利用し、共有されていれば新しく作成する
+static LazyInflate& reuseLazy(std::shared_ptr<LazyInflate>& ptr) {
+	if (!ptr || 1 < ptr.use_count()) { ptr = std::make_shared<LazyInflate>(); }
+	return *ptr;
+}
+
+void InflateEngine::defer(const CameraForOrm& row, const Description& description, Camera& into, FieldMask fields) {
+	into.depth.release();
+	into.confidence.release();
+	if (fields & FIELD_DEPTH) {
+		reuseLazy(into.lazyDepth).assign(row.depthZlib, description.depthWidth, description.depthHeight, CV_32FC1);
+		into.depthStatus = InflateStatus::DEFERRED;
+	}
+	else { into.lazyDepth.reset(); into.depthStatus = InflateStatus::SKIPPED; }
+	if (fields & FIELD_CONFIDENCE) {
+		reuseLazy(into.lazyConfidence).assign(
+			row.confidenceZlib, description.confidenceWidth, description.confidenceHeight, CV_8UC1
+		);
+		into.confidenceStatus = InflateStatus::DEFERRED;
+	}
+	else { into.lazyConfidence.reset(); into.confidenceStatus = InflateStatus::SKIPPED; }
+}
+
+void InflateEngine::run() {
+	Trace::setThreadName("InflateEngine worker");
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		jobReady.wait(lock, [this]() { return quit || job.has_value(); });
+		if (quit) { return; }
+
+		// 展開中はロックを解放しておく
+		Job current = job.value();
+		lock.unlock();
+		{
+			QS_TRACE_SCOPE("inflate confidence");
+			*current.status = confidenceInflater.inflate(
+				*current.src, *current.width, *current.height, CV_8UC1, *current.dst
+			);
+		}
+		lock.lock();
+
+		job.reset();
+		jobDone.notify_one();
+	}
+}
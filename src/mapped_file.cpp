@@ -0,0 +1,91 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace qs;
+
+MappedFile::MappedFile() {}
+
+MappedFile::~MappedFile() { close(); }
+
+#ifdef _WIN32
+bool MappedFile::open(const std::filesystem::path& path) {
+	close();
+
+	// パスに非ASCII文字が含まれていても開けるようにワイド文字版を使用する
+	HANDLE file = CreateFileW(
+		path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+	);
+	if (INVALID_HANDLE_VALUE == file) { return false; }
+	fileHandle = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || 0 == size.QuadPart) { close(); return false; }
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (nullptr == mapping) { close(); return false; }
+	mappingHandle = mapping;
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (nullptr == view) { close(); return false; }
+	mapped = static_cast<const uint8_t*>(view);
+	mappedSize = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapped) { UnmapViewOfFile(mapped); }
+	if (mappingHandle) { CloseHandle(mappingHandle); }
+	if (fileHandle) { CloseHandle(fileHandle); }
+	mapped = nullptr;
+	mappedSize = 0;
+	mappingHandle = fileHandle = nullptr;
+}
+#else
+bool MappedFile::open(const std::filesystem::path& path) {
+	close();
+
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) { return false; }
+	struct stat status;
+	if (0 != fstat(fd, &status) || status.st_size <= 0) { ::close(fd); return false; }
+
+	// マップした後はファイル記述子を閉じてもよい
+	void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (MAP_FAILED == view) { return false; }
+	mapped = static_cast<const uint8_t*>(view);
+	mappedSize = static_cast<size_t>(status.st_size);
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapped) { munmap(const_cast<uint8_t*>(mapped), mappedSize); }
+	mapped = nullptr;
+	mappedSize = 0;
+}
+#endif
+
+bool MappedFile::isOpened() const {
+	return nullptr != mapped;
+}
+
+const uint8_t* MappedFile::data() const {
+	return mapped;
+}
+
+size_t MappedFile::size() const {
+	return mappedSize;
+}
+
+const uint8_t* MappedFile::at(uint64_t offset, uint64_t size) const {
+	if (mappedSize < offset || mappedSize - offset < size) { return nullptr; }
+	return mapped + offset;
+}
@@ -0,0 +1,76 @@
+#include "memory_source.h"
+
+using namespace qs;
+
+MemorySource::MemorySource() : description{} {}
+
+MemorySource::MemorySource(const Description& description) : description(description) {}
+
+MemorySource::~MemorySource() {}
+
+void MemorySource::setDescription(const Description& description) {
+	this->description = description;
+}
+
+void MemorySource::push(QuadFrame frame) {
+	frames.push_back(std::move(frame));
+}
+
+void MemorySource::clear() {
+	frames.clear();
+	nextFrameNumber = 0;
+}
+
+bool MemorySource::isOpened() const {
+	return true;
+}
+
+// fieldsに含まれていればsrcをdstにコピーし、含まれていなければdstを空にする
+static void copyField(const cv::Mat& src, cv::Mat& dst, FieldMask fields, FieldMask field) {
+	if (fields & field) { src.copyTo(dst); }
+	else { dst.release(); }
+}
+
+bool MemorySource::next(QuadFrame& into, FieldMask fields) {
+	if (frames.size() <= nextFrameNumber) { return false; }
+	const QuadFrame& frame = frames[nextFrameNumber];
+	const Camera& camera = frame.camera;
+	releaseBorrowedMats(into.camera);
+
+	into.camera.frameNumber = camera.frameNumber;
+	into.camera.timestamp = camera.timestamp;
+	copyField(camera.color, into.camera.color, fields, FIELD_COLOR);
+	copyField(camera.getDepth(), into.camera.depth, fields, FIELD_DEPTH);
+	copyField(camera.getConfidence(), into.camera.confidence, fields, FIELD_CONFIDENCE);
+	copyField(camera.intrinsicsMatrix, into.camera.intrinsicsMatrix, fields, FIELD_MATRICES);
+	copyField(camera.projectionMatrix, into.camera.projectionMatrix, fields, FIELD_MATRICES);
+	copyField(camera.viewMatrix, into.camera.viewMatrix, fields, FIELD_MATRICES);
+	into.camera.depthStatus = (fields & FIELD_DEPTH) ? camera.getDepthStatus() : InflateStatus::SKIPPED;
+	into.camera.confidenceStatus = (fields & FIELD_CONFIDENCE) ? camera.getConfidenceStatus() : InflateStatus::SKIPPED;
+	into.camera.lazyDepth.reset();
+	into.camera.lazyConfidence.reset();
+
+	if (fields & FIELD_IMU) { into.imu.assign(frame.imu.begin(), frame.imu.end()); }
+	else { into.imu.clear(); }
+	if (fields & FIELD_IMU_BATCH) { into.imuBatch.assign(frame.imu.data(), frame.imu.data() + frame.imu.size()); }
+	else { into.imuBatch.clear(); }
+	if (fields & FIELD_IMU_INTERPOLATED) { into.interpolatedImu = frame.interpolatedImu; }
+	else { into.interpolatedImu.reset(); }
+	if (fields & FIELD_GPS) { into.gps.assign(frame.gps.begin(), frame.gps.end()); }
+	else { into.gps.clear(); }
+
+	nextFrameNumber++;
+	return true;
+}
+
+void MemorySource::seek(uint64_t frameNumber) {
+	nextFrameNumber = frameNumber;
+}
+
+uint64_t MemorySource::getFrameCount() const {
+	return frames.size();
+}
+
+const Description& MemorySource::getDescription() const {
+	return description;
+}
@@ -0,0 +1,448 @@
+#include "packed_recording.h"
+#include "quad_loader.h"
+#include "recording_index.h"
+#include "imu_resampler.h"
+#include "trace.h"
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+using namespace qs;
+
+// packedファイルの識別子とバージョン
+static const char packedMagic[4] = { 'Q', 'S', 'P', 'K' };
+static const uint32_t packedVersion = 1;
+
+// 各区画の先頭の境界 (キャッシュラインとSIMDの読み込みに合わせる)
+static const uint64_t packedAlignment = 64;
+static uint64_t alignUp(uint64_t value) {
+	return (value + packedAlignment - 1) / packedAlignment * packedAlignment;
+}
+
+// キーフレームの情報が無い動画で、このフレーム数以内であればシークせずにgrab()で読み飛ばす
+static const uint64_t maxGrabFrames = 64;
+
+// センサーのテーブルの全ての行をタイムスタンプ順に1行ずつ読み込み、writeRowに渡す (全件をメモリに載せない)
+template<typename T, typename WriteRow>
+static bool forEachSensorRow(const SqliteConnection& connection, WriteRow writeRow) {
+	const std::string sql = std::string("SELECT ") + SensorTable<T>::columns +
+		" FROM " + SensorTable<T>::name + " ORDER BY timestamp ASC";
+	SqliteStatement statement;
+	if (!statement.prepare(connection, sql.c_str())) { return false; }
+	T row{};
+	int result;
+	while (SQLITE_ROW == (result = statement.step())) {
+		SensorTable<T>::read(statement, row);
+		writeRow(row);
+	}
+	return SQLITE_DONE == result;
+}
+
+// matの内容がfloat型でcount要素であればdstにコピーする
+static bool copyMatrix(const cv::Mat& mat, float* dst, size_t count) {
+	if (mat.empty() || CV_32F != mat.type() || count != mat.total() || !mat.isContinuous()) { return false; }
+	std::memcpy(dst, mat.ptr<float>(0), count * sizeof(float));
+	return true;
+}
+
+bool qs::convertToPacked(const std::filesystem::path& recDir, const std::filesystem::path& outputPath) {
+	QS_TRACE_SCOPE("convertToPacked");
+	const std::filesystem::path packedPath = outputPath.empty() ? recDir / "packed.qsp" : outputPath;
+	const std::filesystem::path videoPath = recDir / "camera.mp4";
+
+	// デプス、信頼度、行列はQuadLoaderで読み込む (カラー画像は変換しない)
+	QuadLoader loader;
+	loader.open(recDir, OpenMode::READ_ONLY);
+	if (!loader.isOpened()) { return false; }
+	const Description& description = loader.getDescription();
+
+	// IMUとGPSはローダーとは別の読み込み専用の接続で順に読み込む
+	SqliteConnection connection;
+	if (!connection.openReadOnly((recDir / "db.sqlite3").u8string())) { return false; }
+
+	std::vector<uint64_t> keyframes;
+	if (!readMp4Keyframes(videoPath, keyframes)) { keyframes.clear(); }
+
+	std::error_code error;
+	const uint64_t videoSize = std::filesystem::file_size(videoPath, error);
+	if (error) { return false; }
+
+	PackedHeader header{};
+	std::memcpy(header.magic, packedMagic, 4);
+	header.version = packedVersion;
+	header.headerSize = sizeof(PackedHeader);
+	header.frameSize = sizeof(PackedFrame);
+	header.imuSize = sizeof(Imu);
+	header.gpsSize = sizeof(Gps);
+	std::strncpy(header.date, description.date.c_str(), sizeof(header.date) - 1);
+	header.colorWidth = description.colorWidth;
+	header.colorHeight = description.colorHeight;
+	header.depthWidth = description.depthWidth.value_or(0);
+	header.depthHeight = description.depthHeight.value_or(0);
+	header.confidenceWidth = description.confidenceWidth.value_or(0);
+	header.confidenceHeight = description.confidenceHeight.value_or(0);
+	header.keyframeCount = keyframes.size();
+	header.keyframeOffset = alignUp(sizeof(PackedHeader));
+	header.frameCount = loader.getFrameCount();
+	header.frameOffset = alignUp(header.keyframeOffset + header.keyframeCount * sizeof(uint64_t));
+	header.videoSize = videoSize;
+	std::vector<PackedFrame> table(header.frameCount, PackedFrame{});
+
+	// 書き込み途中のファイルを読み込まないよう、一時ファイルに書き込んでから置き換える
+	std::filesystem::path tempPath = packedPath;
+	tempPath += ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file) { return false; }
+		uint64_t position = 0;
+		auto write = [&file, &position](const void* data, uint64_t size) {
+			file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			position += size;
+		};
+		auto pad = [&write, &position]() {
+			static const char zeros[packedAlignment] = {};
+			write(zeros, alignUp(position) - position);
+		};
+
+		// ヘッダとフレーム表は最後に書き直す
+		write(&header, sizeof(header)); pad();
+		write(keyframes.data(), keyframes.size() * sizeof(uint64_t)); pad();
+		write(table.data(), table.size() * sizeof(PackedFrame)); pad();
+
+		// デプスと信頼度
+		const FieldMask fields = FIELD_DEPTH | FIELD_CONFIDENCE | FIELD_MATRICES;
+		QuadFrame quad;
+		const Camera& camera = quad.camera;
+		for (uint64_t frameNumber = 0; frameNumber < header.frameCount; frameNumber++) {
+			if (!loader.frame(frameNumber, quad, fields)) { continue; }
+			PackedFrame& entry = table[frameNumber];
+			entry.present = 1;
+			entry.timestamp = camera.timestamp;
+			entry.depthStatus = static_cast<uint8_t>(camera.depthStatus);
+			entry.confidenceStatus = static_cast<uint8_t>(camera.confidenceStatus);
+			if (InflateStatus::OK == camera.depthStatus) {
+				entry.depthOffset = position;
+				write(camera.depth.ptr(0), camera.depth.total() * camera.depth.elemSize()); pad();
+			}
+			if (InflateStatus::OK == camera.confidenceStatus) {
+				entry.confidenceOffset = position;
+				write(camera.confidence.ptr(0), camera.confidence.total() * camera.confidence.elemSize()); pad();
+			}
+			entry.hasMatrices =
+				copyMatrix(camera.intrinsicsMatrix, entry.intrinsics, 9) &&
+				copyMatrix(camera.projectionMatrix, entry.projection, 16) &&
+				copyMatrix(camera.viewMatrix, entry.view, 16);
+		}
+
+		// IMUとGPS (全件をメモリに載せないよう、順に読み込んで書き出す)
+		header.imuOffset = position;
+		const bool imuRead = forEachSensorRow<Imu>(connection, [&write, &header](const Imu& imu) {
+			write(&imu, sizeof(Imu));
+			header.imuCount++;
+		});
+		if (!imuRead) { return false; }
+		pad();
+		header.gpsOffset = position;
+		const bool gpsRead = forEachSensorRow<Gps>(connection, [&write, &header](const Gps& gps) {
+			write(&gps, sizeof(Gps));
+			header.gpsCount++;
+		});
+		if (!gpsRead) { return false; }
+		pad();
+
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.seekp(static_cast<std::streamoff>(header.frameOffset));
+		file.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(table.size() * sizeof(PackedFrame)));
+		if (!file) { return false; }
+	}
+
+	std::filesystem::rename(tempPath, packedPath, error);
+	if (error) { std::filesystem::remove(tempPath, error); return false; }
+	return true;
+}
+
+PackedLoader::PackedLoader() {}
+
+PackedLoader::~PackedLoader() { close(); }
+
+void PackedLoader::open(const std::filesystem::path& recDir) {
+	open(recDir, recDir / "packed.qsp");
+}
+
+void PackedLoader::open(const std::filesystem::path& recDir, const std::filesystem::path& packedPath) {
+	QS_TRACE_SCOPE("PackedLoader::open");
+	close();
+
+	if (!file.open(packedPath)) { close(); return; }
+
+	// ヘッダの検査
+	header = reinterpret_cast<const PackedHeader*>(file.at(0, sizeof(PackedHeader)));
+	if (
+		nullptr == header ||
+		0 != std::memcmp(header->magic, packedMagic, 4) ||
+		packedVersion != header->version ||
+		sizeof(PackedHeader) != header->headerSize ||
+		sizeof(PackedFrame) != header->frameSize ||
+		sizeof(Imu) != header->imuSize ||
+		sizeof(Gps) != header->gpsSize
+	) { close(); return; }
+
+	// 各区画がファイルに収まっているかを確認する (要素数が壊れていても桁あふれしないように先に上限を確認する)
+	auto section = [this](uint64_t offset, uint64_t count, uint64_t size) -> const uint8_t* {
+		if (file.size() / size < count) { return nullptr; }
+		if (0 == count) { return file.data(); }
+		return file.at(offset, count * size);
+	};
+	keyframes = reinterpret_cast<const uint64_t*>(section(header->keyframeOffset, header->keyframeCount, sizeof(uint64_t)));
+	frames = reinterpret_cast<const PackedFrame*>(section(header->frameOffset, header->frameCount, sizeof(PackedFrame)));
+	imu = reinterpret_cast<const Imu*>(section(header->imuOffset, header->imuCount, sizeof(Imu)));
+	gps = reinterpret_cast<const Gps*>(section(header->gpsOffset, header->gpsCount, sizeof(Gps)));
+	if (!keyframes || !frames || !imu || !gps) { close(); return; }
+
+	description.date = std::string(header->date, strnlen(header->date, sizeof(header->date)));
+	description.colorWidth = header->colorWidth;
+	description.colorHeight = header->colorHeight;
+	auto optionalSize = [](uint64_t size) { return (0 < size) ? std::optional<uint64_t>(size) : std::nullopt; };
+	description.depthWidth = optionalSize(header->depthWidth);
+	description.depthHeight = optionalSize(header->depthHeight);
+	description.confidenceWidth = optionalSize(header->confidenceWidth);
+	description.confidenceHeight = optionalSize(header->confidenceHeight);
+
+	// カメラ (変換元と異なる動画であれば開かない)
+	const std::filesystem::path videoPath = recDir / "camera.mp4";
+	std::error_code error;
+	const uint64_t videoSize = std::filesystem::file_size(videoPath, error);
+	if (error || videoSize != header->videoSize) { close(); return; }
+	video.open(videoPath.u8string());
+	if (!video.isOpened()) { close(); return; }
+
+	nextFrameNumber = 0;
+	videoFrame = 0;
+	preTimestamp = 0.0;
+}
+
+void PackedLoader::close() {
+	video.release();
+	file.close();
+	header = nullptr;
+	keyframes = nullptr;
+	frames = nullptr;
+	imu = nullptr;
+	gps = nullptr;
+}
+
+bool PackedLoader::isOpened() const {
+	return nullptr != header && video.isOpened();
+}
+
+std::optional<QuadFrame> PackedLoader::next(FieldMask fields) {
+	QuadFrame quadFrame;
+	if (!next(quadFrame, fields)) { return std::nullopt; }
+	return quadFrame;
+}
+
+bool PackedLoader::next(QuadFrame& into, FieldMask fields) {
+	QS_TRACE_SCOPE("PackedLoader::next");
+	if (!isOpened()) { return false; }
+
+	// データベースに行が無かったフレームは読み飛ばす
+	while (nextFrameNumber < header->frameCount && !frames[nextFrameNumber].present) { nextFrameNumber++; }
+	if (header->frameCount <= nextFrameNumber) { return false; }
+
+	if (fields & FIELD_COLOR) {
+		if (!readColor(nextFrameNumber, into.camera.color)) { return false; }
+	}
+	else { into.camera.color.release(); }
+	decode(nextFrameNumber, into, fields);
+	nextFrameNumber++;
+	return true;
+}
+
+void PackedLoader::seek(uint64_t frameNumber) {
+	if (!isOpened()) { return; }
+	nextFrameNumber = frameNumber;
+
+	// 1フレーム前が存在する場合、そのタイムスタンプを取得
+	preTimestamp = 0.0;
+	for (uint64_t i = std::min(frameNumber, header->frameCount); 0 < i; i--) {
+		if (frames[i - 1].present) { preTimestamp = frames[i - 1].timestamp; break; }
+	}
+}
+
+std::optional<QuadFrame> PackedLoader::frame(uint64_t frameNumber, FieldMask fields) {
+	QuadFrame quadFrame;
+	if (!frame(frameNumber, quadFrame, fields)) { return std::nullopt; }
+	return quadFrame;
+}
+
+bool PackedLoader::frame(uint64_t frameNumber, QuadFrame& into, FieldMask fields) {
+	if (!isOpened() || header->frameCount <= frameNumber || !frames[frameNumber].present) { return false; }
+	if (frameNumber != nextFrameNumber) { seek(frameNumber); }
+	return next(into, fields);
+}
+
+uint64_t PackedLoader::getFrameCount() const {
+	return header ? header->frameCount : 0;
+}
+
+const Description& PackedLoader::getDescription() const {
+	return description;
+}
+
+SensorSpan<Imu> PackedLoader::imuSlice(double from, double to) const {
+	if (nullptr == imu || to <= from) { return SensorSpan<Imu>{}; }
+	auto compare = [](double lhs, const Imu& rhs) { return lhs < rhs.timestamp; };
+	const Imu* first = std::upper_bound(imu, imu + header->imuCount, from, compare);
+	const Imu* last = std::upper_bound(first, imu + header->imuCount, to, compare);
+	return SensorSpan<Imu>{ first, last };
+}
+
+void PackedLoader::imuBatch(double from, double to, ImuBatch& into) const {
+	SensorSpan<Imu> span = imuSlice(from, to);
+	into.assign(span.begin(), span.end());
+}
+
+void PackedLoader::resampleImu(const std::vector<double>& timestamps, ImuBatch& into) const {
+	QS_TRACE_SCOPE("PackedLoader::resampleImu");
+	if (timestamps.empty()) { into.clear(); return; }
+	ImuBatch samples;
+	imuBatch(timestamps.front() - imuLookaround, timestamps.back() + imuLookaround, samples);
+	qs::resampleImu(samples, timestamps, into);
+}
+
+void PackedLoader::gpsBatch(double from, double to, GpsBatch& into) const {
+	SensorSpan<Gps> span = gpsSlice(from, to);
+	into.assign(span.begin(), span.end());
+}
+
+bool PackedLoader::gpsTrajectory(GpsTrajectory& into, const GpsTrajectoryOptions& options) const {
+	QS_TRACE_SCOPE("PackedLoader::gpsTrajectory");
+	into.clear();
+	if (!isOpened()) { return false; }
+	for (uint64_t frameNumber = 0; frameNumber < header->frameCount; frameNumber++) {
+		if (!frames[frameNumber].present) { continue; }
+		into.frameNumber.push_back(frameNumber);
+		into.timestamp.push_back(frames[frameNumber].timestamp);
+	}
+	if (into.timestamp.empty()) { return false; }
+
+	const double radius = 3.0 * options.smoothingTime;
+	GpsBatch gps;
+	gpsBatch(into.timestamp.front() - radius, into.timestamp.back() + radius, gps);
+	const std::vector<double> timestamps = into.timestamp;
+	if (!buildGpsTrajectory(gps, timestamps, options, into)) { into.clear(); return false; }
+	return true;
+}
+
+std::optional<Imu> PackedLoader::imuAt(double timestamp) const {
+	if (nullptr == imu || 0 == header->imuCount) { return std::nullopt; }
+	// マップした領域は全てタイムスタンプ順なので、直後の値を二分探索すれば直前の値はその1つ前になる
+	auto compare = [](double lhs, const Imu& rhs) { return lhs < rhs.timestamp; };
+	const Imu* last = imu + header->imuCount;
+	const Imu* next = std::upper_bound(imu, last, timestamp, compare);
+	std::optional<Imu> before, after;
+	if (next != imu && timestamp - imuLookaround < (next - 1)->timestamp) { before = *(next - 1); }
+	if (next != last && next->timestamp <= timestamp + imuLookaround) { after = *next; }
+	return interpolateImu(before, after, timestamp);
+}
+
+SensorSpan<Gps> PackedLoader::gpsSlice(double from, double to) const {
+	if (nullptr == gps || to <= from) { return SensorSpan<Gps>{}; }
+	auto compare = [](double lhs, const Gps& rhs) { return lhs < rhs.timestamp; };
+	const Gps* first = std::upper_bound(gps, gps + header->gpsCount, from, compare);
+	const Gps* last = std::upper_bound(first, gps + header->gpsCount, to, compare);
+	return SensorSpan<Gps>{ first, last };
+}
+
+bool PackedLoader::readColor(uint64_t colorFrame, cv::Mat& color) {
+	QS_TRACE_SCOPE("PackedLoader::readColor");
+
+	// QuadLoader::readColorと同様に、間にキーフレームが無ければシークせずに読み進める
+	if (videoFrame != colorFrame) {
+		const uint64_t* keyframe = std::upper_bound(keyframes, keyframes + header->keyframeCount, colorFrame);
+		const bool hasKeyframe = (keyframe != keyframes);
+		const uint64_t target = hasKeyframe ? *(keyframe - 1) : colorFrame;
+		const bool forward = videoFrame < colorFrame && (hasKeyframe ? (target <= videoFrame) : (colorFrame - videoFrame <= maxGrabFrames));
+		if (!forward) {
+			video.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(target));
+			videoFrame = target;
+		}
+		for (; videoFrame < colorFrame; videoFrame++) {
+			if (!video.grab()) { return false; }
+		}
+	}
+
+	if (!video.read(color)) { return false; }
+	videoFrame++;
+	return true;
+}
+
+// マップした領域を指す行列をdstに設定する (領域が無い場合は保存されていた展開結果を返す)
+static InflateStatus mapMat(
+	const MappedFile& file, uint64_t offset, uint64_t width, uint64_t height, int type, uint8_t savedStatus, cv::Mat& dst
+) {
+	const InflateStatus saved = static_cast<InflateStatus>(savedStatus);
+	const uint64_t bytes = width * height * CV_ELEM_SIZE(type);
+	const uint8_t* data = (0 != offset && 0 < bytes) ? file.at(offset, bytes) : nullptr;
+	if (nullptr == data) {
+		dst.release();
+		return (InflateStatus::OK == saved) ? InflateStatus::TRUNCATED : saved;
+	}
+	dst = cv::Mat(static_cast<int>(height), static_cast<int>(width), type, const_cast<uint8_t*>(data));
+	return InflateStatus::OK;
+}
+
+// フレーム表の行列を指す行列をdstに設定する
+static void mapMatrix(bool enabled, int rows, int cols, const float* data, cv::Mat& dst) {
+	if (enabled) { dst = cv::Mat(rows, cols, CV_32F, const_cast<float*>(data)); }
+	else { dst.release(); }
+}
+
+void PackedLoader::decode(uint64_t frameNumber, QuadFrame& into, FieldMask fields) {
+	const PackedFrame& entry = frames[frameNumber];
+	Camera& camera = into.camera;
+	camera.frameNumber = frameNumber;
+	camera.timestamp = entry.timestamp;
+	camera.lazyDepth.reset();
+	camera.lazyConfidence.reset();
+
+	// デプスと信頼度
+	if (fields & FIELD_DEPTH) {
+		camera.depthStatus = mapMat(
+			file, entry.depthOffset, header->depthWidth, header->depthHeight, CV_32FC1, entry.depthStatus, camera.depth
+		);
+	}
+	else { camera.depth.release(); camera.depthStatus = InflateStatus::SKIPPED; }
+	if (fields & FIELD_CONFIDENCE) {
+		camera.confidenceStatus = mapMat(
+			file, entry.confidenceOffset, header->confidenceWidth, header->confidenceHeight, CV_8UC1, entry.confidenceStatus, camera.confidence
+		);
+	}
+	else { camera.confidence.release(); camera.confidenceStatus = InflateStatus::SKIPPED; }
+
+	// ARKitから取得した行列
+	const bool withMatrices = (fields & FIELD_MATRICES) && entry.hasMatrices;
+	mapMatrix(withMatrices, 3, 3, entry.intrinsics, camera.intrinsicsMatrix);
+	mapMatrix(withMatrices, 4, 4, entry.projection, camera.projectionMatrix);
+	mapMatrix(withMatrices, 4, 4, entry.view, camera.viewMatrix);
+
+	// IMUとGPS
+	if (fields & (FIELD_IMU | FIELD_IMU_BATCH)) {
+		SensorSpan<Imu> span = imuSlice(preTimestamp, camera.timestamp);
+		if (fields & FIELD_IMU) { into.imu.assign(span.begin(), span.end()); }
+		else { into.imu.clear(); }
+		if (fields & FIELD_IMU_BATCH) { into.imuBatch.assign(span.begin(), span.end()); }
+		else { into.imuBatch.clear(); }
+	}
+	else { into.imu.clear(); into.imuBatch.clear(); }
+	if (fields & FIELD_GPS) {
+		SensorSpan<Gps> span = gpsSlice(preTimestamp, camera.timestamp);
+		into.gps.assign(span.begin(), span.end());
+	}
+	else { into.gps.clear(); }
+	if (fields & FIELD_IMU_INTERPOLATED) { into.interpolatedImu = imuAt(camera.timestamp); }
+	else { into.interpolatedImu.reset(); }
+
+	preTimestamp = camera.timestamp;
+}
@@ -0,0 +1,185 @@
+#include "parallel_reader.h"
+#include "trace.h"
+
+using namespace qs;
+
+ParallelReader::ParallelReader() {}
+
+ParallelReader::~ParallelReader() { close(); }
+
+void ParallelReader::open(const std::filesystem::path& recDir) {
+	open(recDir, Options());
+}
+
+void ParallelReader::open(const std::filesystem::path& recDir, const Options& options) {
+	close();
+	this->options = options;
+	this->options.chunkFrames = std::max<uint64_t>(options.chunkFrames, 1);
+	this->options.queueDepth = std::max<size_t>(options.queueDepth, 1);
+	size_t workers = options.workers;
+	if (0 == workers) { workers = std::max<size_t>(std::thread::hardware_concurrency(), 1); }
+
+	// 最初のワーカーでキーフレームの索引を作成してから、他のワーカーを並列に開く
+	// (ワーカー毎に展開用のスレッドを起動しないようにし、センサーの索引のメモリはワーカー間で分け合う)
+	loaders.resize(workers);
+	for (auto& loader : loaders) {
+		loader = std::make_unique<QuadLoader>();
+		loader->setSensorMemoryLimit(options.sensorMemoryLimit / workers);
+		loader->setParallelInflate(false);
+	}
+	loaders[0]->open(recDir, options.mode);
+	if (!loaders[0]->isOpened()) { close(); return; }
+	std::vector<std::thread> openers;
+	for (size_t i = 1; i < workers; i++) {
+		openers.emplace_back([this, i, &recDir]() { loaders[i]->open(recDir, OpenMode::READ_ONLY); });
+	}
+	for (auto& opener : openers) { opener.join(); }
+	for (auto& loader : loaders) {
+		if (!loader->isOpened()) { close(); return; }
+	}
+
+	frameCount = loaders[0]->getFrameCount();
+	chunkCount = (frameCount + this->options.chunkFrames - 1) / this->options.chunkFrames;
+	rewind();
+}
+
+void ParallelReader::close() {
+	stopWorkers();
+	loaders.clear();
+	frameCount = chunkCount = 0;
+}
+
+bool ParallelReader::isOpened() const {
+	return !loaders.empty();
+}
+
+uint64_t ParallelReader::getFrameCount() const {
+	return frameCount;
+}
+
+size_t ParallelReader::getWorkers() const {
+	return loaders.size();
+}
+
+bool ParallelReader::takeChunk(uint64_t& chunk, uint64_t& first, uint64_t& last) {
+	// mutexをロックした状態で呼ぶこと
+	if (stopping || chunkCount <= nextChunk) { return false; }
+	chunk = nextChunk++;
+	first = chunk * options.chunkFrames;
+	last = std::min(first + options.chunkFrames, frameCount);
+	return true;
+}
+
+bool ParallelReader::next(QuadFrame& into) {
+	if (!isOpened()) { return false; }
+	if (!running) { startOrdered(); }
+
+	while (consumeChunk < chunkCount) {
+		// 読み出す区間がワーカーに割り当てられるまで待つ
+		std::shared_ptr<BoundedQueue<QuadFrame>> queue;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			chunkAdded.wait(lock, [this]() { return stopping || 0 < chunkQueues.count(consumeChunk); });
+			if (stopping) { return false; }
+			queue = chunkQueues[consumeChunk];
+		}
+
+		auto frame = queue->pop();
+		if (frame) {
+			std::swap(into, *frame);
+			freeFrames.tryPush(std::move(*frame));
+			return true;
+		}
+
+		// この区間のフレームは全て返したので次の区間へ進む
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			chunkQueues.erase(consumeChunk);
+		}
+		consumeChunk++;
+	}
+	return false;
+}
+
+void ParallelReader::startOrdered() {
+	freeFrames.reset(loaders.size() * (options.queueDepth + 1) + 1);
+	running = true;
+	for (size_t i = 0; i < loaders.size(); i++) {
+		threads.emplace_back([this, i]() {
+			Trace::setThreadName("ParallelReader worker");
+			QuadLoader& loader = *loaders[i];
+			while (true) {
+				// 区間の割り当てとキューの登録は、区間の順序が入れ替わらないように同時に行う
+				uint64_t chunk, first, last;
+				auto queue = std::make_shared<BoundedQueue<QuadFrame>>(options.queueDepth);
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!takeChunk(chunk, first, last)) { break; }
+					chunkQueues[chunk] = queue;
+				}
+				chunkAdded.notify_all();
+
+				for (uint64_t frameNumber = first; frameNumber < last && !stopping; frameNumber++) {
+					QuadFrame frame;
+					if (auto recycled = freeFrames.tryPop()) { frame = std::move(*recycled); }
+					if (!loader.frame(frameNumber, frame, options.fields)) { continue; }
+					if (!queue->push(std::move(frame))) { break; }
+				}
+				queue->close();
+			}
+		});
+	}
+}
+
+bool ParallelReader::forEach(const std::function<void(QuadFrame&)>& callback) {
+	if (!isOpened()) { return false; }
+	rewind();
+
+	for (size_t i = 0; i < loaders.size(); i++) {
+		threads.emplace_back([this, i, &callback]() {
+			Trace::setThreadName("ParallelReader worker");
+			QuadLoader& loader = *loaders[i];
+			QuadFrame frame;
+			while (true) {
+				uint64_t chunk, first, last;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!takeChunk(chunk, first, last)) { break; }
+				}
+				for (uint64_t frameNumber = first; frameNumber < last && !stopping; frameNumber++) {
+					if (!loader.frame(frameNumber, frame, options.fields)) { continue; }
+					callback(frame);
+				}
+			}
+		});
+	}
+	for (auto& thread : threads) { thread.join(); }
+	threads.clear();
+
+	rewind();
+	return true;
+}
+
+void ParallelReader::rewind() {
+	stopWorkers();
+	nextChunk = 0;
+	consumeChunk = 0;
+	stopping = false;
+}
+
+void ParallelReader::stopWorkers() {
+	// キューを閉じると、push()で待機しているワーカーは直ちに区間を終える
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		for (auto& chunkQueue : chunkQueues) { chunkQueue.second->close(); }
+	}
+	chunkAdded.notify_all();
+	freeFrames.close();
+	for (auto& thread : threads) {
+		if (thread.joinable()) { thread.join(); }
+	}
+	threads.clear();
+	chunkQueues.clear();
+	running = false;
+}
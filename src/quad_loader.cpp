@@ -1,15 +1,62 @@
 #include "quad_loader.h"
+#include "trace.h"
 #include <cassert>
 #include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 
 using namespace qs;
 
+// 読み込みに必要なテーブルと列が存在するかどうかを、SQLの準備のみで確認する
+static bool checkSchema(const SqliteConnection& connection) {
+	const char* queries[] = {
+		"SELECT date, color_width, color_height, depth_width, depth_height, "
+		"confidence_width, confidence_height FROM description LIMIT 0",
+		"SELECT id, timestamp, color_frame, depth_zlib, confidence_zlib, "
+		"intrinsics_matrix_3x3, projection_matrix_4x4, view_matrix_4x4 FROM camera LIMIT 0",
+		"SELECT id, timestamp, gravity_x, gravity_y, gravity_z, "
+		"user_accleration_x, user_accleration_y, user_accleration_z, "
+		"rotation_rate_x, rotation_rate_y, rotation_rate_z, "
+		"attitude_x, attitude_y, attitude_z FROM imu LIMIT 0",
+		"SELECT id, timestamp, latitude, longitude, altitude, "
+		"horizontal_accuracy, vertical_accuracy FROM gps LIMIT 0",
+	};
+	for (const char* query : queries) {
+		SqliteStatement statement;
+		if (!statement.prepare(connection, query)) { return false; }
+	}
+	return true;
+}
+
+// descriptionテーブルの最初の行を読み込む
+static bool readDescription(const SqliteConnection& connection, Description& into) {
+	SqliteStatement statement;
+	if (!statement.prepare(connection,
+		"SELECT date, color_width, color_height, depth_width, depth_height, "
+		"confidence_width, confidence_height FROM description LIMIT 1"
+	)) { return false; }
+	if (SQLITE_ROW != statement.step()) { return false; }
+	auto optionalSize = [&statement](int column) -> std::optional<uint64_t> {
+		if (statement.isNull(column)) { return std::nullopt; }
+		return static_cast<uint64_t>(statement.getInt64(column));
+	};
+	into.date = statement.getText(0);
+	into.colorWidth = static_cast<uint64_t>(statement.getInt64(1));
+	into.colorHeight = static_cast<uint64_t>(statement.getInt64(2));
+	into.depthWidth = optionalSize(3);
+	into.depthHeight = optionalSize(4);
+	into.confidenceWidth = optionalSize(5);
+	into.confidenceHeight = optionalSize(6);
+	return true;
+}
+
 QuadLoader::QuadLoader() {}
 
-QuadLoader::~QuadLoader() {}
+QuadLoader::~QuadLoader() { close(); }
 
-void QuadLoader::open(const std::filesystem::path& recDir) {
-	using namespace sqlite_orm;
+void QuadLoader::open(const std::filesystem::path& recDir, OpenMode mode) {
+	QS_TRACE_SCOPE("QuadLoader::open");
 
 	std::string videoPathUTF8 = [recDir]() {
 		std::filesystem::path videoPath = recDir;
@@ -22,116 +69,495 @@ void QuadLoader::open(const std::filesystem::path& recDir) {
 		return dbPath.u8string();
 	}();
 
+	// 以前のファイルを先読みしているスレッドを停止
+	stopPrefetch();
+	this->recDir = recDir;
+
 	// カメラ
 	video.open(videoPathUTF8);
 	if (!video.isOpened()) { close(); return; }
 
 	// データベース
+	const bool readOnly = (OpenMode::READ_ONLY == mode);
+
+	// 毎フレームの問い合わせに使用する接続
+	// (READ_ONLYでは書き込めないディレクトリに置かれたWALモードのデータベースもimmutableで開けるようにする)
+	if (!(readOnly ? connection.openReadOnly(dbPathUTF8) : connection.open(dbPathUTF8))) { close(); return; }
+	if (readOnly) {
+		connection.exec("PRAGMA mmap_size = 268435456");
+		connection.exec("PRAGMA cache_size = -65536");
+		if (!checkSchema(connection)) { close(); return; }
+	}
+
+	// 索引ファイルが最新であれば、スキーマの同期、説明の取得、テーブルの全件走査を省略する
+	// (索引ファイルはスキーマを同期した後に作成されている)
+	const bool indexed = recordingIndex.load(recDir, connection);
 	try {
-		storagePtr = std::make_unique<QSStorage>(makeQSStorage(dbPathUTF8));
-		QSStorage& storage = *storagePtr;
-		storage.sync_schema();
-		std::optional<Description> descriptionOpt;
-		for (auto& desc : storage.iterate<Description>()) {
-			descriptionOpt = std::move(desc);
-			break;
+		// 読み込み専用の場合はsqlite_ormのストレージを作成しない
+		// (ストレージは読み書き可能な接続でデータベースを開き、閉じるときにWALをチェックポイントしてしまう)
+		if (!readOnly) {
+			storagePtr = std::make_unique<QSStorage>(makeQSStorage(dbPathUTF8));
+			if (!indexed) { storagePtr->sync_schema(); }
 		}
-		if (!descriptionOpt.has_value()) { close(); return; }
-		description = descriptionOpt.value();
+		else { storagePtr.reset(); }
 	}
 	catch(const std::system_error&) { close(); return; }
 
+	if (indexed) { description = recordingIndex.description(); }
+	else {
+		if (!readDescription(connection, description)) { close(); return; }
+
+		// 索引を作成する (読み込み専用の場合はファイルに保存しない)
+		if (!recordingIndex.build(recDir, connection, description)) { close(); return; }
+		if (!readOnly) { recordingIndex.save(recDir); }
+	}
+
+	// IMUとGPSの索引 (読み込み専用の場合は開く時間を短くするため、要求された区間のみを読み込む)
+	if (!sensorIndex.open(
+		connection, sensorMemoryLimit, recordingIndex.imuBounds(), recordingIndex.gpsBounds(), readOnly
+	)) { close(); return; }
+
+	// cameraテーブルの索引を作成
+	if (!cameraIndex.open(connection, recordingIndex)) { close(); return; }
+
+	// 以前のファイルのフレームを破棄
+	frameCache.clear();
+
 	// 1フレーム前のタイムスタンプを表す変数をリセット
-	preTimestamp = 0.0;
+	preTimestamp = returnedTimestamp = 0.0;
+	nextFrameNumber = 0;
+	videoFrame = 0;
 }
 
 void QuadLoader::close() {
+	// 先読みスレッドがvideoとstorageを使用しているので先に停止する
+	stopPrefetch();
 	video.release();
-	storagePtr.release();
+	cameraIndex.close();
+	recordingIndex.close();
+	connection.close();
+	sensorIndex.close();
+	storagePtr.reset();
+	frameCache.clear();
 }
 
 bool QuadLoader::isOpened() const {
-	return (storagePtr && video.isOpened());
+	return (connection.isOpened() && video.isOpened());
+}
+
+// 従来のnext()の引数をFieldMaskに変換する
+static FieldMask toFieldMask(bool withImu, bool withGps) {
+	FieldMask fields = FIELD_CAMERA;
+	if (withImu) { fields |= FIELD_IMU; }
+	if (withGps) { fields |= FIELD_GPS; }
+	return fields;
 }
 
 std::optional<QuadFrame> QuadLoader::next(bool withImu, bool withGps) {
-	using namespace sqlite_orm;
+	return next(toFieldMask(withImu, withGps));
+}
+
+bool QuadLoader::next(QuadFrame& into, bool withImu, bool withGps) {
+	return next(into, toFieldMask(withImu, withGps));
+}
+
+std::optional<QuadFrame> QuadLoader::next(FieldMask fields) {
+	QuadFrame quadFrame;
+	if (!next(quadFrame, fields)) { return std::nullopt; }
+	return quadFrame;
+}
 
+bool QuadLoader::next(QuadFrame& into, FieldMask fields) {
+	QS_TRACE_SCOPE("QuadLoader::next");
 	// ファイルが開かれていなければ処理を終了
-	if (!isOpened()) { return std::nullopt; }
-	QSStorage& storage = *storagePtr;
+	if (!isOpened()) { return false; }
+	releaseBorrowedMats(into.camera);
+
+	// 先読みが無効な場合はこのスレッドで全ての処理を行う
+	if (0 == prefetchDepth) {
+		// キャッシュに存在すれば動画とデータベースを読まずにIMUとGPSのみを取得する
+		if (frameCache.get(nextFrameNumber, fields, into.camera)) {
+			decodeSensors(into, fields);
+		}
+		else {
+			if (fields & FIELD_COLOR) {
+				if (!readColor(nextFrameNumber, into.camera.color)) { return false; }
+			}
+			else { into.camera.color.release(); }
+			if (!decode(nextFrameNumber, into, fields)) { return false; }
+			frameCache.put(into.camera, fields);
+		}
+		nextFrameNumber = into.camera.frameNumber + stride;
+		returnedTimestamp = into.camera.timestamp;
+		return true;
+	}
+
+	// 先読み中のフレームと取得するデータの種類や間隔が異なる場合は、現在の位置から先読みをやり直す
+	if (prefetching && (prefetchFields != fields || prefetchStride != stride)) { restartPrefetch(); }
+	if (!prefetching) { startPrefetch(fields); }
+
+	std::optional<QuadFrame> quad;
+	{
+		QS_TRACE_SCOPE("wait prefetch");
+		quad = frameQueue.pop();
+	}
+	if (!quad) { return false; }
+	std::swap(into, *quad);
+	nextFrameNumber = into.camera.frameNumber + stride;
+	returnedTimestamp = into.camera.timestamp;
+
+	// 呼び出し元が使い終わった領域は先読みスレッドで再利用する
+	freeFrames.tryPush(std::move(*quad));
+	return true;
+}
+
+bool QuadLoader::readColor(uint64_t colorFrame, cv::Mat& color) {
+	QS_TRACE_SCOPE("QuadLoader::readColor");
+	// 動画の位置が読み込むフレームと異なる場合は移動する
+	if (videoFrame != colorFrame) {
+		// 現在の位置と目的のフレームの間にキーフレームが無ければ、シークせずにそのまま読み進める
+		const std::optional<uint64_t> keyframe = recordingIndex.keyframeBefore(colorFrame);
+		const bool forward = videoFrame < colorFrame && (
+			keyframe.has_value() ? (keyframe.value() <= videoFrame) : (colorFrame - videoFrame <= maxGrabFrames)
+		);
+		if (!forward) {
+			// 直前のキーフレームへシークし、そこから目的のフレームまでデコードする
+			const uint64_t target = keyframe.value_or(colorFrame);
+			video.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(target));
+			videoFrame = target;
+		}
+
+		// 読み飛ばすフレームは色変換とコピーを省略する
+		for (; videoFrame < colorFrame; videoFrame++) {
+			if (!video.grab()) { return false; }
+		}
+	}
 
 	// 動画の次のフレームを取得
-	const uint64_t colorFrame = static_cast<uint64_t>(video.get(cv::CAP_PROP_POS_FRAMES));
-	cv::Mat color;
-	if (!video.read(color)) { return std::nullopt; }
+	if (!video.read(color)) { return false; }
+	videoFrame++;
+	return true;
+}
 
+bool QuadLoader::decode(uint64_t colorFrame, QuadFrame& into, FieldMask fields) {
+	QS_TRACE_SCOPE("QuadLoader::decode");
 	// 現在のフレーム番号の情報をデータベースから取得
-	std::optional<CameraForOrm> cameraForOrmOpt;
-	for(auto& camera : storage.iterate<CameraForOrm>(
-		where(c(&CameraForOrm::colorFrame) == colorFrame)
-	)) {
-		cameraForOrmOpt = camera;
-	}
-	if (!cameraForOrmOpt.has_value()) { return std::nullopt; }
-	CameraForOrm cameraForOrm = cameraForOrmOpt.value();
+	if (!cameraIndex.fetch(colorFrame, cameraRow, fields)) { return false; }
 
-	// CameraIterでは検索条件に'where color_frame is not null'を指定しているので
+	// 索引にはcolor_frameがnullでない行のみ登録されているので
 	// colorFrameにnulloptが返ることはないはず
-	assert(cameraForOrm.colorFrame.has_value());
+	assert(cameraRow.colorFrame.has_value());
 
 	// CameraForOrmからCameraに変換
-	Camera camera = std::move(cameraForOrm.toCamera(description, color));
+	// (展開に失敗した場合はcamera.depthStatusとcamera.confidenceStatusにその理由が設定される)
+	Camera& camera = into.camera;
+	cameraRow.toCameraWithoutBlobs(camera, fields & FIELD_MATRICES);
+	if (lazyInflate) { inflateEngine.defer(cameraRow, description, camera, fields); }
+	else { inflateEngine.inflate(cameraRow, description, camera, fields); }
+
+	decodeSensors(into, fields);
+	return true;
+}
+
+void QuadLoader::decodeSensors(QuadFrame& into, FieldMask fields) {
+	const Camera& camera = into.camera;
 
 	// IMU
-	std::vector<Imu> imu;
-	if (withImu) {
-		imu = std::move(storage.get_all<Imu>(
-			where(
-				preTimestamp < c(&Imu::timestamp) and
-				c(&Imu::timestamp) <= camera.timestamp
-			)
-		));
+	// (assignは確保済みの領域に収まる場合は再確保しない)
+	if (fields & (FIELD_IMU | FIELD_IMU_BATCH)) {
+		SensorSpan<Imu> span = sensorIndex.imu(preTimestamp, camera.timestamp);
+		if (fields & FIELD_IMU) { into.imu.assign(span.begin(), span.end()); }
+		else { into.imu.clear(); }
+		if (fields & FIELD_IMU_BATCH) { into.imuBatch.assign(span.begin(), span.end()); }
+		else { into.imuBatch.clear(); }
 	}
+	else { into.imu.clear(); into.imuBatch.clear(); }
 
 	// GPS
-	std::vector<Gps> gps;
-	if (withGps) {
-		gps = std::move(storage.get_all<Gps>(
-			where(
-				preTimestamp < c(&Gps::timestamp) and
-				c(&Gps::timestamp) <= camera.timestamp
-			)
-		));
+	if (fields & FIELD_GPS) {
+		SensorSpan<Gps> span = sensorIndex.gps(preTimestamp, camera.timestamp);
+		into.gps.assign(span.begin(), span.end());
 	}
+	else { into.gps.clear(); }
+
+	// カメラの時刻のIMU
+	if (fields & FIELD_IMU_INTERPOLATED) { into.interpolatedImu = imuAt(camera.timestamp); }
+	else { into.interpolatedImu.reset(); }
 
 	preTimestamp = camera.timestamp;
+}
 
-	return QuadFrame {
-		std::move(camera), imu, gps
-	};
+std::optional<Imu> QuadLoader::imuAt(double timestamp) {
+	// 直前の値は前回のフレームからの区間に無ければ遡って探す
+	std::optional<Imu> before, after;
+	SensorSpan<Imu> span = sensorIndex.imu(preTimestamp, timestamp);
+	if (span.begin() == span.end()) { span = sensorIndex.imu(timestamp - imuLookaround, timestamp); }
+	if (span.begin() != span.end()) { before = *(span.end() - 1); }
+	span = sensorIndex.imu(timestamp, timestamp + imuLookaround);
+	if (span.begin() != span.end()) { after = *span.begin(); }
+	return interpolateImu(before, after, timestamp);
 }
 
 const std::unique_ptr<QSStorage>& QuadLoader::getStorage() const {
 	return storagePtr;
 }
 
-void QuadLoader::seek(const uint64_t frameNumber) {
-	using namespace sqlite_orm;
+const RecordingIndex& QuadLoader::getRecordingIndex() const {
+	return recordingIndex;
+}
+
+bool QuadLoader::refresh() {
+	QS_TRACE_SCOPE("QuadLoader::refresh");
+	if (!isOpened()) { return false; }
+
+	// 先読みスレッドが索引と動画を使用しているので止める
+	if (prefetching) { restartPrefetch(); }
+
+	bool videoChanged = false;
+	if (!recordingIndex.extend(recDir, connection, videoChanged)) { close(); return false; }
+	if (!sensorIndex.refresh(recordingIndex.imuBounds(), recordingIndex.gpsBounds())) { close(); return false; }
 
+	// 書き込まれたフレームは開き直さなければ読めないので、動画が更新された場合のみ開き直す
+	// (開き直すと先頭に戻るので、次のreadColor()で目的のフレームへシークさせる)
+	if (videoChanged) {
+		video.release();
+		video.open((recDir / "camera.mp4").u8string());
+		if (!video.isOpened()) { close(); return false; }
+		videoFrame = 0;
+	}
+	return true;
+}
+
+void QuadLoader::seek(const uint64_t frameNumber) {
+	QS_TRACE_SCOPE("QuadLoader::seek");
 	// ファイルが開かれていなければ処理を終了
 	if (!isOpened()) { return; }
-	QSStorage& storage = *storagePtr;
 
-	// 動画のシーク
-	video.set(cv::CAP_PROP_POS_FRAMES, static_cast<uint64_t>(frameNumber));
-	const uint64_t postFrameNumber = static_cast<uint64_t>(video.get(cv::CAP_PROP_POS_FRAMES));
+	// 先読み中のフレームは全て破棄する
+	stopPrefetch();
+
+	// 動画のシークは、次に色を読み込むときにreadColor()で行う
+	nextFrameNumber = frameNumber;
 
 	// 1フレーム前が存在する場合、そのタイムスタンプを取得
-	preTimestamp = 0.0;
-	std::unique_ptr<double> preTimestampOpt = storage.max(&CameraForOrm::timestamp, where(
-		is_not_null(&CameraForOrm::colorFrame) and
-		c(&CameraForOrm::colorFrame) < frameNumber
-	));
-	if (preTimestampOpt) { preTimestamp = *preTimestampOpt; }
+	preTimestamp = returnedTimestamp = recordingIndex.previousTimestamp(frameNumber).value_or(0.0);
+}
+
+std::optional<QuadFrame> QuadLoader::frame(uint64_t frameNumber, FieldMask fields) {
+	QuadFrame quadFrame;
+	if (!frame(frameNumber, quadFrame, fields)) { return std::nullopt; }
+	return quadFrame;
+}
+
+bool QuadLoader::frame(uint64_t frameNumber, QuadFrame& into, FieldMask fields) {
+	// 連続したフレームを要求された場合は、先読みを破棄しないようにシークしない
+	if (frameNumber != nextFrameNumber) { seek(frameNumber); }
+	return next(into, fields);
+}
+
+uint64_t QuadLoader::getFrameCount() const {
+	return recordingIndex.frameCount();
+}
+
+const Description& QuadLoader::getDescription() const {
+	return description;
+}
+
+void QuadLoader::setSensorMemoryLimit(size_t bytes) {
+	sensorMemoryLimit = bytes;
+}
+
+void QuadLoader::setLazyInflate(bool lazy) {
+	if (lazy == lazyInflate) { return; }
+
+	// 先読み済みのフレームは以前の設定で展開されているので読み込みをやり直す
+	if (prefetching) { restartPrefetch(); }
+	lazyInflate = lazy;
+}
+
+bool QuadLoader::getLazyInflate() const {
+	return lazyInflate;
+}
+
+void QuadLoader::setParallelInflate(bool parallel) {
+	if (parallel == inflateEngine.getParallel()) { return; }
+
+	// 先読みスレッドが展開に使用しているので、止めてから変更する
+	if (prefetching) { restartPrefetch(); }
+	inflateEngine.setParallel(parallel);
+}
+
+bool QuadLoader::getParallelInflate() const {
+	return inflateEngine.getParallel();
+}
+
+SensorSpan<Imu> QuadLoader::imuSlice(double from, double to) {
+	return sensorIndex.imu(from, to);
+}
+
+void QuadLoader::imuBatch(double from, double to, ImuBatch& into) {
+	QS_TRACE_SCOPE("QuadLoader::imuBatch");
+	into.clear();
+
+	// 先読みスレッドが同じ索引のチャンクを読み替えるので止める (次のnext()で再開する)
+	if (prefetching) { restartPrefetch(); }
+
+	// 区間を記録されている範囲に制限する (-infやinfを指定しても有限回の読み込みで終わるように)
+	const SensorBounds& bounds = recordingIndex.imuBounds();
+	if (0 == bounds.count) { return; }
+	from = std::max(from, std::nextafter(bounds.first, -std::numeric_limits<double>::infinity()));
+	to = std::min(to, bounds.last);
+	if (to <= from) { return; }
+
+	// 全て読み込んでいる場合は1回で、チャンク単位の場合は読み込んだチャンクごとに取得する
+	while (from < to) {
+		SensorSpan<Imu> span = sensorIndex.imuChunk(from, to);
+		into.append(span.begin(), span.end());
+	}
+}
+
+void QuadLoader::resampleImu(const std::vector<double>& timestamps, ImuBatch& into) {
+	QS_TRACE_SCOPE("QuadLoader::resampleImu");
+	if (timestamps.empty()) { into.clear(); return; }
+	ImuBatch samples;
+	imuBatch(timestamps.front() - imuLookaround, timestamps.back() + imuLookaround, samples);
+	qs::resampleImu(samples, timestamps, into);
+}
+
+void QuadLoader::gpsBatch(double from, double to, GpsBatch& into) {
+	QS_TRACE_SCOPE("QuadLoader::gpsBatch");
+	into.clear();
+
+	// imuBatch()と同様に、先読みスレッドと同じ索引を読まないよう先読みを止める
+	if (prefetching) { restartPrefetch(); }
+
+	// imuBatch()と同様に区間を記録されている範囲に制限し、読み込んだチャンクごとに取得する
+	const SensorBounds& bounds = recordingIndex.gpsBounds();
+	if (0 == bounds.count) { return; }
+	from = std::max(from, std::nextafter(bounds.first, -std::numeric_limits<double>::infinity()));
+	to = std::min(to, bounds.last);
+	if (to <= from) { return; }
+
+	while (from < to) {
+		SensorSpan<Gps> span = sensorIndex.gpsChunk(from, to);
+		into.append(span.begin(), span.end());
+	}
+}
+
+bool QuadLoader::gpsTrajectory(GpsTrajectory& into, const GpsTrajectoryOptions& options) {
+	QS_TRACE_SCOPE("QuadLoader::gpsTrajectory");
+	into.clear();
+	if (!isOpened()) { return false; }
+
+	// フレームのタイムスタンプは索引から取得する (行の無いフレームは除く)
+	for (uint64_t frameNumber = 0; frameNumber < recordingIndex.frameCount(); frameNumber++) {
+		const std::optional<double> timestamp = recordingIndex.timestamp(frameNumber);
+		if (!timestamp.has_value()) { continue; }
+		into.frameNumber.push_back(frameNumber);
+		into.timestamp.push_back(timestamp.value());
+	}
+	if (into.timestamp.empty()) { return false; }
+
+	const double radius = 3.0 * options.smoothingTime;
+	GpsBatch gps;
+	gpsBatch(into.timestamp.front() - radius, into.timestamp.back() + radius, gps);
+	const std::vector<double> timestamps = into.timestamp;
+	if (!buildGpsTrajectory(gps, timestamps, options, into)) { into.clear(); return false; }
+	return true;
+}
+
+SensorSpan<Gps> QuadLoader::gpsSlice(double from, double to) {
+	return sensorIndex.gps(from, to);
+}
+
+void QuadLoader::setStride(uint64_t stride) {
+	this->stride = std::max<uint64_t>(stride, 1);
+}
+
+uint64_t QuadLoader::getStride() const {
+	return stride;
+}
+
+void QuadLoader::setPrefetch(size_t depth) {
+	if (depth == prefetchDepth) { return; }
+
+	// 先読みを止め、まだnext()で返していないフレームから読み込みをやり直す
+	if (prefetching) { restartPrefetch(); }
+	prefetchDepth = depth;
+}
+
+size_t QuadLoader::getPrefetch() const {
+	return prefetchDepth;
+}
+
+void QuadLoader::setFrameCache(size_t bytes, FieldMask cachedFields) {
+	frameCache.setCachedFields(cachedFields);
+	frameCache.setCapacity(bytes);
+}
+
+const FrameCache& QuadLoader::getFrameCache() const {
+	return frameCache;
+}
+
+void QuadLoader::startPrefetch(FieldMask fields) {
+	prefetchFields = fields;
+	prefetchStride = stride;
+	colorQueue.reset(prefetchDepth);
+	frameQueue.reset(prefetchDepth);
+	freeColors.reset(prefetchDepth + 2);
+	freeFrames.reset(prefetchDepth + 2);
+	prefetching = true;
+
+	// 1段目: 動画のデコード
+	// (色を要求されていない場合は動画を読まずにフレーム番号のみを後段に渡す)
+	videoThread = std::thread([this, fields, step = stride, colorFrame = nextFrameNumber]() mutable {
+		Trace::setThreadName("QuadLoader video");
+		for (;; colorFrame += step) {
+			ColorFrame frame{ colorFrame, cv::Mat() };
+			if (fields & FIELD_COLOR) {
+				if (auto recycled = freeColors.tryPop()) { frame.color = std::move(*recycled); }
+				if (!readColor(frame.colorFrame, frame.color)) { break; }
+			}
+			if (!colorQueue.push(std::move(frame))) { break; }
+		}
+		colorQueue.close();
+	});
+
+	// 2段目: データベースの読み込みとzlibの展開
+	decodeThread = std::thread([this, fields]() {
+		Trace::setThreadName("QuadLoader decode");
+		while (true) {
+			auto frame = colorQueue.pop();
+			if (!frame) { break; }
+			QuadFrame quad;
+			if (auto recycled = freeFrames.tryPop()) { quad = std::move(*recycled); }
+			std::swap(quad.camera.color, frame->color);
+			freeColors.tryPush(std::move(frame->color));
+			if (!decode(frame->colorFrame, quad, fields)) { break; }
+			if (!frameQueue.push(std::move(quad))) { break; }
+		}
+		// 後段が終了した場合は前段も停止させる
+		colorQueue.close();
+		frameQueue.close();
+	});
+}
+
+void QuadLoader::stopPrefetch() {
+	if (!prefetching) { return; }
+
+	// キューを閉じると、push()やpop()で待機しているスレッドは直ちに終了する
+	colorQueue.close();
+	frameQueue.close();
+	if (videoThread.joinable()) { videoThread.join(); }
+	if (decodeThread.joinable()) { decodeThread.join(); }
+	prefetching = false;
+}
+
+void QuadLoader::restartPrefetch() {
+	stopPrefetch();
+
+	// 先読みスレッドが進めたpreTimestampを、最後に返したフレームの時刻に戻す
+	// (seek(nextFrameNumber)で戻すとnextFrameNumberの1フレーム前の時刻になり、
+	// 間引き再生で読み飛ばした区間のIMUとGPSが失われる)
+	preTimestamp = returnedTimestamp;
 }
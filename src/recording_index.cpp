@@ -0,0 +1,549 @@
+#include "recording_index.h"
+#include "trace.h"
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <fstream>
+#include <algorithm>
+
+using namespace qs;
+
+// 索引ファイルの識別子とバージョン
+static const char recordingIndexMagic[4] = { 'Q', 'S', 'R', 'I' };
+static const uint32_t recordingIndexVersion = 2;
+
+namespace {
+	// MP4のボックスを読み込むための補助クラス
+	struct Mp4Reader {
+		std::ifstream file;
+		uint64_t fileSize = 0;
+
+		bool readU32(uint32_t& value) {
+			unsigned char buffer[4];
+			if (!file.read(reinterpret_cast<char*>(buffer), 4)) { return false; }
+			value = (uint32_t(buffer[0]) << 24) | (uint32_t(buffer[1]) << 16) | (uint32_t(buffer[2]) << 8) | uint32_t(buffer[3]);
+			return true;
+		}
+		bool readU64(uint64_t& value) {
+			uint32_t high, low;
+			if (!readU32(high) || !readU32(low)) { return false; }
+			value = (uint64_t(high) << 32) | uint64_t(low);
+			return true;
+		}
+		bool seek(uint64_t position) {
+			file.clear();
+			return static_cast<bool>(file.seekg(static_cast<std::streamoff>(position)));
+		}
+
+		// positionから始まるボックスのヘッダを読み込む
+		// bodyにはヘッダを除いた中身の開始位置、endにはボックスの終了位置が入る
+		bool readBox(uint64_t position, uint64_t parentEnd, char type[4], uint64_t& body, uint64_t& end) {
+			if (parentEnd < position + 8 || !seek(position)) { return false; }
+			uint32_t size32;
+			if (!readU32(size32) || !file.read(type, 4)) { return false; }
+			body = position + 8;
+			if (1 == size32) {
+				uint64_t size64;
+				if (!readU64(size64)) { return false; }
+				body += 8;
+				end = position + size64;
+			}
+			else if (0 == size32) { end = parentEnd; }
+			else { end = position + size32; }
+			return body <= end && end <= parentEnd;
+		}
+	};
+
+	struct Mp4Track {
+		bool isVideo = false;
+		bool hasSyncSamples = false;
+		uint64_t sampleCount = 0;
+		std::vector<uint64_t> syncSamples;
+	};
+
+	bool isType(const char type[4], const char* name) {
+		return 0 == std::memcmp(type, name, 4);
+	}
+
+	// trakボックス以下を再帰的に解析する
+	bool parseTrack(Mp4Reader& reader, uint64_t begin, uint64_t end, Mp4Track& track) {
+		for (uint64_t position = begin; position + 8 <= end;) {
+			char type[4];
+			uint64_t body, boxEnd;
+			if (!reader.readBox(position, end, type, body, boxEnd)) { return false; }
+
+			if (isType(type, "mdia") || isType(type, "minf") || isType(type, "stbl")) {
+				if (!parseTrack(reader, body, boxEnd, track)) { return false; }
+			}
+			else if (isType(type, "hdlr")) {
+				// version(1) + flags(3) + pre_defined(4) + handler_type(4)
+				char handler[4];
+				if (!reader.seek(body + 8) || !reader.file.read(handler, 4)) { return false; }
+				track.isVideo = isType(handler, "vide");
+			}
+			else if (isType(type, "stsz")) {
+				// version(1) + flags(3) + sample_size(4) + sample_count(4)
+				uint32_t sampleCount;
+				if (!reader.seek(body + 8) || !reader.readU32(sampleCount)) { return false; }
+				track.sampleCount = sampleCount;
+			}
+			else if (isType(type, "stss")) {
+				// version(1) + flags(3) + entry_count(4) + sample_number(4) * entry_count
+				uint32_t entryCount;
+				if (!reader.seek(body + 4) || !reader.readU32(entryCount)) { return false; }
+				if (boxEnd < body + 8 + uint64_t(entryCount) * 4) { return false; }
+				track.hasSyncSamples = true;
+				track.syncSamples.resize(entryCount);
+				for (uint32_t i = 0; i < entryCount; i++) {
+					uint32_t sampleNumber;
+					if (!reader.readU32(sampleNumber)) { return false; }
+					// sample_numberは1から始まる
+					track.syncSamples[i] = (0 < sampleNumber) ? sampleNumber - 1 : 0;
+				}
+			}
+			position = boxEnd;
+			if (boxEnd == body) { break; }
+		}
+		return true;
+	}
+}
+
+bool qs::readMp4Keyframes(const std::filesystem::path& videoPath, std::vector<uint64_t>& keyframes) {
+	keyframes.clear();
+	Mp4Reader reader;
+	reader.file.open(videoPath, std::ios::binary);
+	if (!reader.file) { return false; }
+	std::error_code error;
+	reader.fileSize = std::filesystem::file_size(videoPath, error);
+	if (error) { return false; }
+
+	// moovボックスを探す (mdatの後ろにある場合もある)
+	for (uint64_t position = 0; position + 8 <= reader.fileSize;) {
+		char type[4];
+		uint64_t body, end;
+		if (!reader.readBox(position, reader.fileSize, type, body, end)) { return false; }
+		if (isType(type, "moov")) {
+			for (uint64_t trak = body; trak + 8 <= end;) {
+				char trakType[4];
+				uint64_t trakBody, trakEnd;
+				if (!reader.readBox(trak, end, trakType, trakBody, trakEnd)) { return false; }
+				if (isType(trakType, "trak")) {
+					Mp4Track track;
+					if (!parseTrack(reader, trakBody, trakEnd, track)) { return false; }
+					if (track.isVideo) {
+						// stssが無い場合は全てのサンプルが同期サンプル
+						if (track.hasSyncSamples) { keyframes = std::move(track.syncSamples); }
+						else {
+							keyframes.resize(track.sampleCount);
+							for (uint64_t i = 0; i < track.sampleCount; i++) { keyframes[i] = i; }
+						}
+						std::sort(keyframes.begin(), keyframes.end());
+						return !keyframes.empty();
+					}
+				}
+				trak = trakEnd;
+				if (trakEnd == trakBody) { break; }
+			}
+			return false;
+		}
+		position = end;
+		if (end == body) { break; }
+	}
+	return false;
+}
+
+/*
+	索引ファイルの形式 (数値は全て実行環境のバイトオーダーとレイアウト、各区画の先頭は8バイト境界)
+	IndexHeader
+	録画の日付 (dateSizeバイトの文字列、終端文字なし)
+	フレーム表 (IndexFrame * frameCount、フレーム番号順で行が無いフレームも含む)
+	キーフレームのフレーム番号 (u64 * keyframeCount)
+*/
+namespace {
+	constexpr size_t keySize = std::tuple_size<RecordingKey>::value;
+
+	struct IndexHeader {
+		char magic[4];
+		uint32_t version;
+		// 各構造体の大きさ (コンパイラやバージョンの異なる環境で作成されたファイルを検出する)
+		uint32_t headerSize, frameSize;
+		uint64_t fileSize;
+		// これより後ろの全てのバイトのチェックサム
+		uint64_t checksum;
+		int64_t key[keySize];
+		uint64_t colorWidth, colorHeight;
+		// 0の場合はデプスまたは信頼度が記録されていない
+		uint64_t depthWidth, depthHeight;
+		uint64_t confidenceWidth, confidenceHeight;
+		uint64_t dateSize, dateOffset;
+		uint64_t frameCount, frameOffset;
+		uint64_t keyframeCount, keyframeOffset;
+		uint64_t imuCount;
+		double imuFirst, imuLast;
+		uint64_t gpsCount;
+		double gpsFirst, gpsLast;
+	};
+
+	using IndexFrame = RecordingIndex::IndexFrame;
+
+	// チェックサムの対象となる範囲の先頭
+	constexpr size_t checksumBegin = offsetof(IndexHeader, key);
+
+	static_assert(0 == sizeof(IndexHeader) % 8 && 0 == checksumBegin % 8, "IndexHeader must be 8-byte aligned");
+	static_assert(16 == sizeof(IndexFrame), "IndexFrame must be packed");
+
+	uint64_t alignUp(uint64_t value) {
+		return (value + 7) & ~uint64_t(7);
+	}
+
+	// 8バイト単位で計算するFNV-1a (sizeは8の倍数であること)
+	uint64_t checksum(const uint8_t* data, size_t size) {
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (size_t i = 0; i + 8 <= size; i += 8) {
+			uint64_t word;
+			std::memcpy(&word, data + i, 8);
+			hash = (hash ^ word) * 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	/*
+		テーブルのafter < rowid <= untilの行の行数とタイムスタンプの範囲を取得し、boundsに加える
+		(rowidの範囲で区切るので、前回までに数えた行を重複して数えない)
+	*/
+	bool addBounds(const SqliteConnection& connection, const char* table, int64_t after, int64_t until, SensorBounds& bounds) {
+		const std::string sql = std::string("SELECT COUNT(*), MIN(timestamp), MAX(timestamp) FROM ") + table +
+			" WHERE ? < rowid AND rowid <= ?";
+		SqliteStatement statement;
+		if (!statement.prepare(connection, sql.c_str())) { return false; }
+		statement.bind(1, after);
+		statement.bind(2, until);
+		if (SQLITE_ROW != statement.step()) { return false; }
+		const uint64_t count = static_cast<uint64_t>(statement.getInt64(0));
+		if (0 == count) { return true; }
+		const double first = statement.getDouble(1), last = statement.getDouble(2);
+		bounds.first = (0 == bounds.count) ? first : std::min(bounds.first, first);
+		bounds.last = (0 == bounds.count) ? last : std::max(bounds.last, last);
+		bounds.count += count;
+		return true;
+	}
+
+	// cameraテーブルのafter < rowid <= untilの行をフレーム表に書き込む
+	bool addFrames(const SqliteConnection& connection, int64_t after, int64_t until, std::vector<IndexFrame>& frameList) {
+		SqliteStatement statement;
+		if (!statement.prepare(connection,
+			"SELECT color_frame, id, timestamp FROM camera "
+			"WHERE ? < rowid AND rowid <= ? AND color_frame IS NOT NULL ORDER BY color_frame"
+		)) { return false; }
+		statement.bind(1, after);
+		statement.bind(2, until);
+		int result;
+		while (SQLITE_ROW == (result = statement.step())) {
+			const int64_t colorFrame = statement.getInt64(0);
+			if (colorFrame < 0) { continue; }
+			const size_t index = static_cast<size_t>(colorFrame);
+			if (frameList.size() <= index) {
+				frameList.resize(index + 1, IndexFrame{ -1, std::numeric_limits<double>::quiet_NaN() });
+			}
+			frameList[index] = IndexFrame{ statement.getInt64(1), statement.getDouble(2) };
+		}
+		return SQLITE_DONE == result;
+	}
+
+	// RecordingKeyの各値の位置
+	enum KeySlot : size_t { VIDEO_SIZE, VIDEO_TIME, SCHEMA_VERSION, CAMERA_ROWID, IMU_ROWID, GPS_ROWID };
+}
+
+RecordingStamp qs::readRecordingStamp(const std::filesystem::path& recDir) {
+	const std::filesystem::path paths[] = {
+		recDir / "camera.mp4", recDir / "db.sqlite3", recDir / "db.sqlite3-wal"
+	};
+	RecordingStamp stamp;
+	size_t i = 0;
+	for (const auto& path : paths) {
+		std::error_code error;
+		const uintmax_t size = std::filesystem::file_size(path, error);
+		stamp[i++] = error ? -1 : static_cast<int64_t>(size);
+		const auto time = std::filesystem::last_write_time(path, error);
+		stamp[i++] = error ? -1 : static_cast<int64_t>(time.time_since_epoch().count());
+	}
+
+	// -walは無い場合と空の場合を区別しない
+	if (stamp[4] <= 0) { stamp[4] = stamp[5] = 0; }
+	return stamp;
+}
+
+bool qs::readRecordingKey(const std::filesystem::path& recDir, const SqliteConnection& connection, RecordingKey& key) {
+	const std::filesystem::path videoPath = recDir / "camera.mp4";
+	std::error_code error;
+	const uintmax_t size = std::filesystem::file_size(videoPath, error);
+	key[0] = error ? -1 : static_cast<int64_t>(size);
+	const auto time = std::filesystem::last_write_time(videoPath, error);
+	key[1] = error ? -1 : static_cast<int64_t>(time.time_since_epoch().count());
+
+	const char* queries[] = {
+		"PRAGMA schema_version",
+		"SELECT MAX(rowid) FROM camera",
+		"SELECT MAX(rowid) FROM imu",
+		"SELECT MAX(rowid) FROM gps",
+	};
+	size_t i = 2;
+	for (const char* query : queries) {
+		SqliteStatement statement;
+		if (!statement.prepare(connection, query) || SQLITE_ROW != statement.step()) { return false; }
+		key[i++] = statement.isNull(0) ? -1 : statement.getInt64(0);
+	}
+	return true;
+}
+
+bool RecordingIndex::load(const std::filesystem::path& recDir, const SqliteConnection& connection) {
+	QS_TRACE_SCOPE("RecordingIndex::load");
+	close();
+	if (!file.open(recDir / fileName) || file.size() < sizeof(IndexHeader)) { close(); return false; }
+
+	// 動画かデータベースの内容が更新されていれば作成し直す
+	RecordingKey current;
+	if (!readRecordingKey(recDir, connection, current)) { close(); return false; }
+	const IndexHeader* header = reinterpret_cast<const IndexHeader*>(file.data());
+	if (0 != std::memcmp(header->key, current.data(), sizeof(header->key))) { close(); return false; }
+
+	if (!attach(file.data(), file.size())) { close(); return false; }
+	loaded = true;
+	return true;
+}
+
+bool RecordingIndex::build(const std::filesystem::path& recDir, const SqliteConnection& connection, const Description& description) {
+	QS_TRACE_SCOPE("RecordingIndex::build");
+	close();
+
+	// 読み込み中に録画が更新された場合に次回作成し直すよう、読み込む前の状態を記録する
+	// (行はrowidがkeyの値以下のもののみを読み込む)
+	if (!readRecordingKey(recDir, connection, key)) { close(); return false; }
+
+	// キーフレームの情報が得られない動画でもタイムスタンプとrowidの対応表は使用できる
+	if (!readMp4Keyframes(recDir / "camera.mp4", keyframeList)) { keyframeList.clear(); }
+
+	if (
+		!addFrames(connection, -1, key[CAMERA_ROWID], frameList) ||
+		!addBounds(connection, "imu", -1, key[IMU_ROWID], imu) ||
+		!addBounds(connection, "gps", -1, key[GPS_ROWID], gps)
+	) { close(); return false; }
+
+	desc = description;
+	attachLists();
+	return true;
+}
+
+bool RecordingIndex::extend(const std::filesystem::path& recDir, const SqliteConnection& connection, bool& videoChanged) {
+	QS_TRACE_SCOPE("RecordingIndex::extend");
+	videoChanged = false;
+	if (!isOpened()) { return false; }
+
+	RecordingKey current;
+	if (!readRecordingKey(recDir, connection, current)) { return false; }
+	if (current == key) { return true; }
+
+	// スキーマが変わった場合や行が削除された場合は追記では表せないので作成し直す
+	if (
+		current[SCHEMA_VERSION] != key[SCHEMA_VERSION] || current[CAMERA_ROWID] < key[CAMERA_ROWID] ||
+		current[IMU_ROWID] < key[IMU_ROWID] || current[GPS_ROWID] < key[GPS_ROWID]
+	) {
+		const Description description = desc;
+		videoChanged = true;
+		return build(recDir, connection, description);
+	}
+
+	// 索引ファイルから読み込んだ場合は、追記できるように内容を配列に移す (最初の1回のみ)
+	if (loaded) {
+		frameList.assign(frameTable, frameTable + frames);
+		keyframeList.assign(keyframeTable, keyframeTable + keyframes);
+		file.close();
+		loaded = false;
+	}
+
+	// 前回までに読み込んだ行より後の行のみを読み込む
+	if (
+		!addFrames(connection, key[CAMERA_ROWID], current[CAMERA_ROWID], frameList) ||
+		!addBounds(connection, "imu", key[IMU_ROWID], current[IMU_ROWID], imu) ||
+		!addBounds(connection, "gps", key[GPS_ROWID], current[GPS_ROWID], gps)
+	) { close(); return false; }
+
+	// 動画が更新された場合のみキーフレームを読み直す
+	if (current[VIDEO_SIZE] != key[VIDEO_SIZE] || current[VIDEO_TIME] != key[VIDEO_TIME]) {
+		if (!readMp4Keyframes(recDir / "camera.mp4", keyframeList)) { keyframeList.clear(); }
+		videoChanged = true;
+	}
+
+	key = current;
+	attachLists();
+	return true;
+}
+
+bool RecordingIndex::save(const std::filesystem::path& recDir) const {
+	if (!isOpened()) { return false; }
+	const std::filesystem::path indexPath = recDir / fileName;
+	std::error_code error;
+
+	// 読み込んだ索引は保存済み
+	if (loaded) { return true; }
+
+	IndexHeader header{};
+	std::memcpy(header.magic, recordingIndexMagic, 4);
+	header.version = recordingIndexVersion;
+	header.headerSize = sizeof(IndexHeader);
+	header.frameSize = sizeof(IndexFrame);
+	std::memcpy(header.key, key.data(), sizeof(header.key));
+	header.colorWidth = desc.colorWidth;
+	header.colorHeight = desc.colorHeight;
+	header.depthWidth = desc.depthWidth.value_or(0);
+	header.depthHeight = desc.depthHeight.value_or(0);
+	header.confidenceWidth = desc.confidenceWidth.value_or(0);
+	header.confidenceHeight = desc.confidenceHeight.value_or(0);
+	header.dateSize = desc.date.size();
+	header.dateOffset = sizeof(IndexHeader);
+	header.frameCount = frames;
+	header.frameOffset = alignUp(header.dateOffset + header.dateSize);
+	header.keyframeCount = keyframes;
+	header.keyframeOffset = header.frameOffset + header.frameCount * sizeof(IndexFrame);
+	header.imuCount = imu.count;
+	header.imuFirst = imu.first;
+	header.imuLast = imu.last;
+	header.gpsCount = gps.count;
+	header.gpsFirst = gps.first;
+	header.gpsLast = gps.last;
+	header.fileSize = header.keyframeOffset + header.keyframeCount * sizeof(uint64_t);
+
+	std::vector<uint64_t> buffer(header.fileSize / 8, 0);
+	uint8_t* data = reinterpret_cast<uint8_t*>(buffer.data());
+	std::memcpy(data + header.dateOffset, desc.date.data(), header.dateSize);
+	std::memcpy(data + header.frameOffset, frameTable, header.frameCount * sizeof(IndexFrame));
+	std::memcpy(data + header.keyframeOffset, keyframeTable, header.keyframeCount * sizeof(uint64_t));
+	std::memcpy(data, &header, sizeof(IndexHeader));
+	header.checksum = checksum(data + checksumBegin, header.fileSize - checksumBegin);
+	std::memcpy(data, &header, sizeof(IndexHeader));
+
+	// 書き込み途中のファイルを読み込まないよう、一時ファイルに書き込んでから置き換える
+	std::filesystem::path tempPath = indexPath;
+	tempPath += ".tmp";
+	{
+		std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+		if (!output) { return false; }
+		output.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(header.fileSize));
+		if (!output) { output.close(); std::filesystem::remove(tempPath, error); return false; }
+	}
+	std::filesystem::rename(tempPath, indexPath, error);
+	if (error) { std::filesystem::remove(tempPath, error); return false; }
+	return true;
+}
+
+void RecordingIndex::close() {
+	file.close();
+	frameList.clear();
+	keyframeList.clear();
+	frameTable = nullptr;
+	keyframeTable = nullptr;
+	opened = false;
+	loaded = false;
+	key = RecordingKey{};
+	desc = Description{};
+	imu = gps = SensorBounds{};
+	frames = keyframes = 0;
+}
+
+bool RecordingIndex::isOpened() const {
+	return opened;
+}
+
+bool RecordingIndex::isLoaded() const {
+	return loaded;
+}
+
+const Description& RecordingIndex::description() const {
+	return desc;
+}
+
+uint64_t RecordingIndex::frameCount() const {
+	return frames;
+}
+
+std::optional<int64_t> RecordingIndex::rowid(uint64_t frameNumber) const {
+	if (frames <= frameNumber) { return std::nullopt; }
+	if (frameTable[frameNumber].rowid < 0) { return std::nullopt; }
+	return frameTable[frameNumber].rowid;
+}
+
+std::optional<double> RecordingIndex::timestamp(uint64_t frameNumber) const {
+	if (frames <= frameNumber) { return std::nullopt; }
+	if (std::isnan(frameTable[frameNumber].timestamp)) { return std::nullopt; }
+	return frameTable[frameNumber].timestamp;
+}
+
+std::optional<double> RecordingIndex::previousTimestamp(uint64_t frameNumber) const {
+	for (uint64_t i = std::min<uint64_t>(frameNumber, frames); 0 < i; i--) {
+		if (!std::isnan(frameTable[i - 1].timestamp)) { return frameTable[i - 1].timestamp; }
+	}
+	return std::nullopt;
+}
+
+std::optional<uint64_t> RecordingIndex::keyframeBefore(uint64_t frameNumber) const {
+	const uint64_t* first = keyframeTable;
+	const uint64_t* last = first + keyframes;
+	const uint64_t* it = std::upper_bound(first, last, frameNumber);
+	if (it == first) { return std::nullopt; }
+	return *(it - 1);
+}
+
+const SensorBounds& RecordingIndex::imuBounds() const {
+	return imu;
+}
+
+const SensorBounds& RecordingIndex::gpsBounds() const {
+	return gps;
+}
+
+bool RecordingIndex::attach(const uint8_t* data, size_t size) {
+	if (size < sizeof(IndexHeader)) { return false; }
+	const IndexHeader& header = *reinterpret_cast<const IndexHeader*>(data);
+	if (0 != std::memcmp(header.magic, recordingIndexMagic, 4)) { return false; }
+	if (recordingIndexVersion != header.version) { return false; }
+	if (sizeof(IndexHeader) != header.headerSize || sizeof(IndexFrame) != header.frameSize) { return false; }
+	if (size != header.fileSize || 0 != size % 8) { return false; }
+
+	// 各区画がファイルに収まっているかを、オーバーフローしないように確認する
+	auto fits = [size](uint64_t offset, uint64_t count, uint64_t unit) {
+		return 0 == offset % 8 && offset <= size && count <= (size - offset) / unit;
+	};
+	if (
+		header.dateOffset < sizeof(IndexHeader) || !fits(header.dateOffset, header.dateSize, 1) ||
+		!fits(header.frameOffset, header.frameCount, sizeof(IndexFrame)) ||
+		!fits(header.keyframeOffset, header.keyframeCount, sizeof(uint64_t))
+	) { return false; }
+	if (header.checksum != checksum(data + checksumBegin, size - checksumBegin)) { return false; }
+
+	std::memcpy(key.data(), header.key, sizeof(header.key));
+	desc.date.assign(reinterpret_cast<const char*>(data + header.dateOffset), header.dateSize);
+	desc.colorWidth = header.colorWidth;
+	desc.colorHeight = header.colorHeight;
+	auto optionalSize = [](uint64_t value) { return (0 == value) ? std::nullopt : std::optional<uint64_t>(value); };
+	desc.depthWidth = optionalSize(header.depthWidth);
+	desc.depthHeight = optionalSize(header.depthHeight);
+	desc.confidenceWidth = optionalSize(header.confidenceWidth);
+	desc.confidenceHeight = optionalSize(header.confidenceHeight);
+	imu = SensorBounds{ header.imuCount, header.imuFirst, header.imuLast };
+	gps = SensorBounds{ header.gpsCount, header.gpsFirst, header.gpsLast };
+	frames = header.frameCount;
+	frameTable = reinterpret_cast<const IndexFrame*>(data + header.frameOffset);
+	keyframes = header.keyframeCount;
+	keyframeTable = reinterpret_cast<const uint64_t*>(data + header.keyframeOffset);
+	opened = true;
+	return true;
+}
+
+void RecordingIndex::attachLists() {
+	frames = frameList.size();
+	frameTable = frameList.data();
+	keyframes = keyframeList.size();
+	keyframeTable = keyframeList.data();
+	opened = true;
+}
@@ -0,0 +1,78 @@
+#include "sensor_index.h"
+
+using namespace qs;
+
+// SensorTable
+const char* const SensorTable<Imu>::name = "imu";
+const char* const SensorTable<Imu>::columns =
+	"id, timestamp, gravity_x, gravity_y, gravity_z, "
+	"user_accleration_x, user_accleration_y, user_accleration_z, "
+	"rotation_rate_x, rotation_rate_y, rotation_rate_z, attitude_x, attitude_y, attitude_z";
+
+void SensorTable<Imu>::read(const SqliteStatement& statement, Imu& row) {
+	row.id = static_cast<uint64_t>(statement.getInt64(0));
+	row.timestamp = statement.getDouble(1);
+	row.gravityX = statement.getDouble(2);
+	row.gravityY = statement.getDouble(3);
+	row.gravityZ = statement.getDouble(4);
+	row.userAcclerationX = statement.getDouble(5);
+	row.userAcclerationY = statement.getDouble(6);
+	row.userAcclerationZ = statement.getDouble(7);
+	row.rotationRateX = statement.getDouble(8);
+	row.rotationRateY = statement.getDouble(9);
+	row.rotationRateZ = statement.getDouble(10);
+	row.attitudeX = statement.getDouble(11);
+	row.attitudeY = statement.getDouble(12);
+	row.attitudeZ = statement.getDouble(13);
+}
+
+const char* const SensorTable<Gps>::name = "gps";
+const char* const SensorTable<Gps>::columns =
+	"id, timestamp, latitude, longitude, altitude, horizontal_accuracy, vertical_accuracy";
+
+void SensorTable<Gps>::read(const SqliteStatement& statement, Gps& row) {
+	row.id = static_cast<uint64_t>(statement.getInt64(0));
+	row.timestamp = statement.getDouble(1);
+	row.latitude = statement.getDouble(2);
+	row.longitude = statement.getDouble(3);
+	row.altitude = statement.getDouble(4);
+	row.horizontalAccuracy = statement.getDouble(5);
+	row.verticalAccuracy = statement.getDouble(6);
+}
+
+// SensorIndex
+bool SensorIndex::open(
+	const SqliteConnection& connection, size_t memoryLimit,
+	const std::optional<SensorBounds>& imuBounds, const std::optional<SensorBounds>& gpsBounds, bool lazy
+) {
+	if (
+		!imuColumn.open(connection, memoryLimit, imuBounds, lazy) ||
+		!gpsColumn.open(connection, memoryLimit, gpsBounds, lazy)
+	) { close(); return false; }
+	return true;
+}
+
+void SensorIndex::close() {
+	imuColumn.close();
+	gpsColumn.close();
+}
+
+SensorSpan<Imu> SensorIndex::imu(double from, double to) {
+	return imuColumn.slice(from, to);
+}
+
+SensorSpan<Gps> SensorIndex::gps(double from, double to) {
+	return gpsColumn.slice(from, to);
+}
+
+SensorSpan<Imu> SensorIndex::imuChunk(double& from, double to) {
+	return imuColumn.chunk(from, to);
+}
+
+SensorSpan<Gps> SensorIndex::gpsChunk(double& from, double to) {
+	return gpsColumn.chunk(from, to);
+}
+
+bool SensorIndex::refresh(const std::optional<SensorBounds>& imuBounds, const std::optional<SensorBounds>& gpsBounds) {
+	return imuColumn.refresh(imuBounds) && gpsColumn.refresh(gpsBounds);
+}
@@ -0,0 +1,140 @@
+#include "sqlite_statement.h"
+
+using namespace qs;
+
+namespace {
+	// ファイルパスをsqlite3のURIに変換する
+	std::string toUri(const std::string& filepathUTF8) {
+		std::string uri = "file:";
+#ifdef _WIN32
+		// ドライブレターから始まるパスは"/C:/..."の形式にする
+		if (2 <= filepathUTF8.size() && ':' == filepathUTF8[1]) { uri += '/'; }
+#endif
+		for (const char c : filepathUTF8) {
+			switch (c) {
+#ifdef _WIN32
+				case '\\': uri += '/'; break;
+#endif
+				case '%': uri += "%25"; break;
+				case '?': uri += "%3f"; break;
+				case '#': uri += "%23"; break;
+				default: uri += c; break;
+			}
+		}
+		return uri;
+	}
+}
+
+// SqliteConnection
+SqliteConnection::~SqliteConnection() { close(); }
+
+bool SqliteConnection::open(const std::string& filepathUTF8, int flags) {
+	close();
+	if (SQLITE_OK != sqlite3_open_v2(filepathUTF8.c_str(), &db, flags, nullptr)) {
+		// 失敗した場合もハンドルが返されることがあるので解放する
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool SqliteConnection::openReadOnly(const std::string& filepathUTF8) {
+	// 開く処理はファイルを読まないので、実際にスキーマを読めるか確かめる
+	if (open(filepathUTF8, SQLITE_OPEN_READONLY) && exec("SELECT COUNT(*) FROM sqlite_master")) { return true; }
+	if (!open(toUri(filepathUTF8) + "?immutable=1", SQLITE_OPEN_READONLY | SQLITE_OPEN_URI)) { return false; }
+	if (!exec("SELECT COUNT(*) FROM sqlite_master")) { close(); return false; }
+	immutable = true;
+	return true;
+}
+
+bool SqliteConnection::isImmutable() const {
+	return immutable;
+}
+
+void SqliteConnection::close() {
+	if (db) { sqlite3_close_v2(db); }
+	db = nullptr;
+	immutable = false;
+}
+
+bool SqliteConnection::isOpened() const {
+	return nullptr != db;
+}
+
+bool SqliteConnection::exec(const char* sql) {
+	if (!db) { return false; }
+	return SQLITE_OK == sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+}
+
+sqlite3* SqliteConnection::get() const {
+	return db;
+}
+
+// SqliteStatement
+SqliteStatement::~SqliteStatement() { finalize(); }
+
+bool SqliteStatement::prepare(const SqliteConnection& connection, const char* sql) {
+	finalize();
+	if (!connection.isOpened()) { return false; }
+	if (SQLITE_OK != sqlite3_prepare_v3(connection.get(), sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr)) {
+		finalize();
+		return false;
+	}
+	return true;
+}
+
+void SqliteStatement::finalize() {
+	if (stmt) { sqlite3_finalize(stmt); }
+	stmt = nullptr;
+}
+
+bool SqliteStatement::isPrepared() const {
+	return nullptr != stmt;
+}
+
+void SqliteStatement::reset() {
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+}
+
+bool SqliteStatement::bind(int index, int64_t value) {
+	return SQLITE_OK == sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(value));
+}
+
+bool SqliteStatement::bind(int index, double value) {
+	return SQLITE_OK == sqlite3_bind_double(stmt, index, value);
+}
+
+int SqliteStatement::step() {
+	return sqlite3_step(stmt);
+}
+
+bool SqliteStatement::isNull(int column) const {
+	return SQLITE_NULL == sqlite3_column_type(stmt, column);
+}
+
+int64_t SqliteStatement::getInt64(int column) const {
+	return static_cast<int64_t>(sqlite3_column_int64(stmt, column));
+}
+
+double SqliteStatement::getDouble(int column) const {
+	return sqlite3_column_double(stmt, column);
+}
+
+std::string SqliteStatement::getText(int column) const {
+	// sqlite3_column_textを先に呼ぶ必要がある (sqlite3_column_bytesの仕様)
+	const unsigned char* text = sqlite3_column_text(stmt, column);
+	if (nullptr == text) { return std::string(); }
+	const size_t size = static_cast<size_t>(sqlite3_column_bytes(stmt, column));
+	return std::string(reinterpret_cast<const char*>(text), size);
+}
+
+bool SqliteStatement::getBlob(int column, std::vector<char>& out) const {
+	if (isNull(column)) { out.clear(); return false; }
+
+	// sqlite3_column_blobを先に呼ぶ必要がある (sqlite3_column_bytesの仕様)
+	const char* data = static_cast<const char*>(sqlite3_column_blob(stmt, column));
+	const size_t size = static_cast<size_t>(sqlite3_column_bytes(stmt, column));
+	out.assign(data, data + size);
+	return true;
+}
@@ -0,0 +1,201 @@
+#include "synthetic_recording.h"
+#include <cmath>
+#include <cassert>
+#include <cstring>
+
+using namespace qs;
+
+// 行列の内容をraw deflateで圧縮する (QuadDumpのdepth_zlibとconfidence_zlibと同じ形式)
+static bool deflateMat(const cv::Mat& mat, std::vector<char>& dst) {
+	assert(mat.isContinuous());
+	z_stream stream{};
+	if (Z_OK != deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)) { return false; }
+	const uLong srcSize = static_cast<uLong>(mat.total() * mat.elemSize());
+	dst.resize(deflateBound(&stream, srcSize));
+	stream.next_in = const_cast<Bytef*>(mat.ptr<Bytef>(0));
+	stream.avail_in = static_cast<uInt>(srcSize);
+	stream.next_out = reinterpret_cast<Bytef*>(dst.data());
+	stream.avail_out = static_cast<uInt>(dst.size());
+	const int result = deflate(&stream, Z_FINISH);
+	dst.resize(stream.total_out);
+	deflateEnd(&stream);
+	return Z_STREAM_END == result;
+}
+
+// 行列の内容をBLOBとしてコピーする
+static std::vector<char> matBlob(const cv::Mat& mat) {
+	std::vector<char> blob(mat.total() * mat.elemSize());
+	std::memcpy(blob.data(), mat.ptr(0), blob.size());
+	return blob;
+}
+
+// 時刻tにおけるカメラの軌跡 (半径radiusの円を周期periodで一周する)
+namespace {
+	constexpr double radius = 2.0;
+	constexpr double period = 20.0;
+	constexpr double pi = 3.14159265358979323846;
+	double angle(double t) { return 2.0 * pi * t / period; }
+}
+
+bool qs::writeSyntheticRecording(const std::filesystem::path& recDir, const SyntheticOptions& options) {
+	using namespace sqlite_orm;
+	if (0 == options.colorWidth || 0 == options.colorHeight || options.fps <= 0.0) { return false; }
+
+	std::error_code error;
+	std::filesystem::create_directories(recDir, error);
+	if (error) { return false; }
+	std::filesystem::path videoPath = recDir; videoPath.append("camera.mp4");
+	std::filesystem::path dbPath = recDir; dbPath.append("db.sqlite3");
+	std::filesystem::remove(videoPath, error);
+	std::filesystem::remove(dbPath, error);
+
+	cv::RNG rng(options.seed);
+	const double duration = options.frames / options.fps;
+	const bool withDepth = 0 < options.depthWidth && 0 < options.depthHeight;
+
+	// カメラ
+	const std::string& fourcc = options.fourcc;
+	if (4 != fourcc.size()) { return false; }
+	cv::VideoWriter writer(
+		videoPath.u8string(),
+		cv::VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]),
+		options.fps,
+		cv::Size(static_cast<int>(options.colorWidth), static_cast<int>(options.colorHeight))
+	);
+	if (!writer.isOpened()) { return false; }
+
+	try {
+		QSStorage storage = makeQSStorage(dbPath.u8string());
+		storage.sync_schema();
+
+		// 1つのトランザクションで書き込む (途中で失敗した場合はロールバックされる)
+		const bool committed = storage.transaction([&]() {
+			storage.insert(Description{
+				options.date,
+				options.colorWidth, options.colorHeight,
+				withDepth ? std::optional<uint64_t>(options.depthWidth) : std::nullopt,
+				withDepth ? std::optional<uint64_t>(options.depthHeight) : std::nullopt,
+				withDepth ? std::optional<uint64_t>(options.depthWidth) : std::nullopt,
+				withDepth ? std::optional<uint64_t>(options.depthHeight) : std::nullopt,
+			});
+
+			// 内部パラメータはフレーム間で変化しない
+			const float fx = 0.75f * options.colorWidth, cx = 0.5f * options.colorWidth, cy = 0.5f * options.colorHeight;
+			cv::Mat intrinsics = (cv::Mat_<float>(3, 3) << fx, 0.0f, cx, 0.0f, fx, cy, 0.0f, 0.0f, 1.0f);
+			cv::Mat projection = (cv::Mat_<float>(4, 4) <<
+				1.5f, 0.0f, 0.0f, 0.0f,
+				0.0f, 2.0f, 0.0f, 0.0f,
+				0.0f, 0.0f, -1.0f, -1.0f,
+				0.0f, 0.0f, -0.002f, 0.0f
+			);
+
+			cv::Mat color(static_cast<int>(options.colorHeight), static_cast<int>(options.colorWidth), CV_8UC3);
+			cv::Mat noise(color.size(), CV_8UC3);
+			cv::Mat depth, confidence;
+			if (withDepth) {
+				depth.create(static_cast<int>(options.depthHeight), static_cast<int>(options.depthWidth), CV_32FC1);
+				confidence.create(depth.size(), CV_8UC1);
+			}
+
+			for (uint64_t frame = 0; frame < options.frames; frame++) {
+				const double t = frame / options.fps;
+
+				// 移動する格子模様とノイズ
+				const int shift = static_cast<int>(frame * 4);
+				for (int y = 0; y < color.rows; y++) {
+					cv::Vec3b* row = color.ptr<cv::Vec3b>(y);
+					for (int x = 0; x < color.cols; x++) {
+						const bool cell = (((x + shift) / 64) + (y / 64)) % 2;
+						row[x] = cell ? cv::Vec3b(200, 160, 120) : cv::Vec3b(40, 60, 80);
+					}
+				}
+				rng.fill(noise, cv::RNG::UNIFORM, 0, 32);
+				color += noise;
+				writer.write(color);
+
+				// 奥行きが滑らかに変化する面にノイズを加えたデプスと、その信頼度
+				CameraForOrm row{};
+				row.timestamp = options.startTimestamp + t;
+				row.colorFrame = frame;
+				if (withDepth) {
+					for (int y = 0; y < depth.rows; y++) {
+						float* d = depth.ptr<float>(y);
+						uint8_t* c = confidence.ptr<uint8_t>(y);
+						for (int x = 0; x < depth.cols; x++) {
+							const double base = 1.0 + 3.0 * y / depth.rows + 0.5 * std::sin(angle(t) + 4.0 * x / depth.cols);
+							const double n = rng.gaussian(0.01);
+							d[x] = static_cast<float>(base + n);
+							c[x] = static_cast<uint8_t>(std::abs(n) < 0.01 ? 2 : (std::abs(n) < 0.02 ? 1 : 0));
+						}
+					}
+					row.depthZlib.emplace();
+					row.confidenceZlib.emplace();
+					if (!deflateMat(depth, *row.depthZlib) || !deflateMat(confidence, *row.confidenceZlib)) { return false; }
+				}
+
+				// 円周上を接線方向を向いて移動するカメラの姿勢
+				const float a = static_cast<float>(angle(t));
+				cv::Mat view = (cv::Mat_<float>(4, 4) <<
+					std::cos(a), 0.0f, -std::sin(a), 0.0f,
+					0.0f, 1.0f, 0.0f, 0.0f,
+					std::sin(a), 0.0f, std::cos(a), 0.0f,
+					static_cast<float>(radius * std::cos(a)), 1.5f, static_cast<float>(radius * std::sin(a)), 1.0f
+				);
+				row.intrinsicsMatrix = matBlob(intrinsics);
+				row.projectionMatrix = matBlob(projection);
+				row.viewMatrix = matBlob(view);
+				storage.insert(row);
+			}
+
+			// IMU (円運動の向心加速度と一定の角速度にノイズを加える)
+			if (0.0 < options.imuRate) {
+				const double omega = 2.0 * pi / period;
+				const uint64_t samples = static_cast<uint64_t>(duration * options.imuRate);
+				for (uint64_t i = 0; i < samples; i++) {
+					const double t = i / options.imuRate;
+					const double a = angle(t);
+					Imu imu{};
+					imu.timestamp = options.startTimestamp + t;
+					imu.gravityX = rng.gaussian(0.001);
+					imu.gravityY = -1.0 + rng.gaussian(0.001);
+					imu.gravityZ = rng.gaussian(0.001);
+					imu.userAcclerationX = -radius * omega * omega / 9.80665 + rng.gaussian(0.01);
+					imu.userAcclerationY = rng.gaussian(0.01);
+					imu.userAcclerationZ = rng.gaussian(0.01);
+					imu.rotationRateX = rng.gaussian(0.002);
+					imu.rotationRateY = omega + rng.gaussian(0.002);
+					imu.rotationRateZ = rng.gaussian(0.002);
+					imu.attitudeX = 0.0;
+					imu.attitudeY = 0.0;
+					imu.attitudeZ = std::remainder(a, 2.0 * pi);
+					storage.insert(imu);
+				}
+			}
+
+			// GPS (東京駅付近を中心に、カメラと同じ円を描く)
+			if (0.0 < options.gpsRate) {
+				const double metersPerDegree = 111320.0;
+				const double latitude = 35.681236, longitude = 139.767125;
+				const uint64_t samples = static_cast<uint64_t>(duration * options.gpsRate);
+				for (uint64_t i = 0; i < samples; i++) {
+					const double t = i / options.gpsRate;
+					const double a = angle(t);
+					Gps gps{};
+					gps.timestamp = options.startTimestamp + t;
+					gps.latitude = latitude + (radius * std::sin(a) + rng.gaussian(1.0)) / metersPerDegree;
+					gps.longitude = longitude + (radius * std::cos(a) + rng.gaussian(1.0)) / (metersPerDegree * std::cos(latitude * pi / 180.0));
+					gps.altitude = 40.0 + rng.gaussian(2.0);
+					gps.horizontalAccuracy = 5.0 + std::abs(rng.gaussian(1.0));
+					gps.verticalAccuracy = 8.0 + std::abs(rng.gaussian(2.0));
+					storage.insert(gps);
+				}
+			}
+			return true;
+		});
+		if (!committed) { return false; }
+	}
+	catch(const std::system_error&) { return false; }
+
+	writer.release();
+	return true;
+}
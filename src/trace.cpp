@@ -0,0 +1,172 @@
+#include "trace.h"
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace qs;
+
+namespace {
+	struct Event {
+		const char* name;
+		uint64_t begin, end;
+	};
+
+	/*
+		1つのスレッドの記録
+		書き込みは所有するスレッドのみが行い、countをreleaseで更新することで
+		dump()を呼んだスレッドから書き込み済みの区間だけを読めるようにする。
+		eventsは最初に区間を記録するときに確保する (スレッド名の設定のみでは確保しない)。
+	*/
+	struct ThreadBuffer {
+		uint32_t tid;
+		std::atomic<const char*> threadName{nullptr};
+		std::vector<Event> events;
+		std::atomic<size_t> count{0};
+		std::atomic<size_t> dropped{0};
+		ThreadBuffer(uint32_t tid) : tid(tid) {}
+	};
+
+	// 全てのスレッドのバッファ
+	// 終了したスレッドのバッファは記録を保持したまま、新しく作成されたスレッドで再利用する
+	struct Registry {
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+		std::vector<ThreadBuffer*> released;
+
+		ThreadBuffer* acquire() {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!released.empty()) {
+				ThreadBuffer* buffer = released.back();
+				released.pop_back();
+				return buffer;
+			}
+			buffers.push_back(std::make_unique<ThreadBuffer>(static_cast<uint32_t>(buffers.size() + 1)));
+			return buffers.back().get();
+		}
+
+		void release(ThreadBuffer* buffer) {
+			std::lock_guard<std::mutex> lock(mutex);
+			released.push_back(buffer);
+		}
+	};
+
+	Registry& registry() {
+		static Registry instance;
+		return instance;
+	}
+
+	// スレッドの終了時にバッファを返却する
+	struct BufferHandle {
+		ThreadBuffer* buffer = nullptr;
+		~BufferHandle() { if (buffer) { registry().release(buffer); } }
+		ThreadBuffer& get() {
+			if (nullptr == buffer) { buffer = registry().acquire(); }
+			return *buffer;
+		}
+	};
+	thread_local BufferHandle threadBuffer;
+
+	// 時刻の基準
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	std::string jsonEscape(const char* text) {
+		std::string escaped;
+		for (; *text; text++) {
+			if ('"' == *text || '\\' == *text) { escaped += '\\'; }
+			escaped += *text;
+		}
+		return escaped;
+	}
+
+	// 環境変数QS_TRACEが設定されていれば計測を有効にし、終了時に書き出す
+	std::string exitDumpPath;
+	const bool initializedFromEnv = []() {
+		const char* path = std::getenv("QS_TRACE");
+		if (nullptr == path || '\0' == *path) { return false; }
+		exitDumpPath = path;
+		registry();
+		Trace::enable();
+		std::atexit([]() { Trace::dump(exitDumpPath); });
+		return true;
+	}();
+}
+
+std::atomic<bool> Trace::enabled{false};
+
+void Trace::enable() {
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+void Trace::disable() {
+	enabled.store(false, std::memory_order_relaxed);
+}
+
+uint64_t Trace::now() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - epoch
+	).count());
+}
+
+void Trace::record(const char* name, uint64_t begin, uint64_t end) {
+	ThreadBuffer& buffer = threadBuffer.get();
+	const size_t index = buffer.count.load(std::memory_order_relaxed);
+	if (buffer.events.empty()) { buffer.events.resize(eventsPerThread); }
+	if (buffer.events.size() <= index) { buffer.dropped.fetch_add(1, std::memory_order_relaxed); return; }
+	buffer.events[index] = Event{ name, begin, end };
+	buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(const char* name) {
+	threadBuffer.get().threadName.store(name, std::memory_order_relaxed);
+}
+
+void Trace::clear() {
+	std::lock_guard<std::mutex> lock(registry().mutex);
+	for (auto& buffer : registry().buffers) {
+		buffer->count.store(0, std::memory_order_release);
+		buffer->dropped.store(0, std::memory_order_relaxed);
+	}
+}
+
+bool Trace::dump(const std::filesystem::path& path) {
+	std::ofstream file(path);
+	if (!file) { return false; }
+
+	std::lock_guard<std::mutex> lock(registry().mutex);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	auto separator = [&first]() { const char* s = first ? "" : ",\n"; first = false; return s; };
+	char number[64];
+	for (auto& buffer : registry().buffers) {
+		// スレッド名
+		if (const char* threadName = buffer->threadName.load(std::memory_order_relaxed)) {
+			file << separator()
+				<< "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid
+				<< ",\"args\":{\"name\":\"" << jsonEscape(threadName) << "\"}}";
+		}
+
+		// 区間 (時刻はマイクロ秒単位)
+		const size_t count = buffer->count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; i++) {
+			const Event& event = buffer->events[i];
+			std::snprintf(number, sizeof(number), "\"ts\":%.3f,\"dur\":%.3f",
+				event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+			file << separator()
+				<< "{\"ph\":\"X\",\"cat\":\"qs\",\"name\":\"" << jsonEscape(event.name)
+				<< "\",\"pid\":1,\"tid\":" << buffer->tid << "," << number << "}";
+		}
+
+		// 記録できなかった区間の数
+		if (const size_t dropped = buffer->dropped.load(std::memory_order_relaxed)) {
+			file << separator()
+				<< "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"dropped " << dropped << " events\",\"pid\":1,\"tid\":" << buffer->tid
+				<< ",\"ts\":" << now() / 1000.0 << "}";
+		}
+	}
+	file << "\n]}\n";
+	return static_cast<bool>(file);
+}
@@ -1,4 +1,6 @@
 #include "types.h"
+#include "inflate_engine.h"
+#include "trace.h"
 
 using namespace qs;
 
@@ -12,10 +14,31 @@ Camera Camera::clone() const {
 		confidence.clone(),
 		intrinsicsMatrix.clone(),
 		projectionMatrix.clone(),
-		viewMatrix.clone()
+		viewMatrix.clone(),
+		depthStatus,
+		confidenceStatus,
+		// 遅延している行列は展開後に変更されないので共有する
+		lazyDepth,
+		lazyConfidence
 	};
 }
 
+const cv::Mat& Camera::getDepth() const {
+	return lazyDepth ? lazyDepth->get() : depth;
+}
+
+const cv::Mat& Camera::getConfidence() const {
+	return lazyConfidence ? lazyConfidence->get() : confidence;
+}
+
+InflateStatus Camera::getDepthStatus() const {
+	return lazyDepth ? lazyDepth->status() : depthStatus;
+}
+
+InflateStatus Camera::getConfidenceStatus() const {
+	return lazyConfidence ? lazyConfidence->status() : confidenceStatus;
+}
+
 // IMU
 cv::Vec3d Imu::cvGravity() const {
 	return cv::Vec3d(gravityX, gravityY, gravityZ);
@@ -35,93 +58,56 @@ cv::Vec3d Gps::cvGps() const { return cv::Vec3d(latitude, longitude, altitude);
 
 // QuadFrame
 QuadFrame QuadFrame::clone() const {
-	return QuadFrame{ camera.clone(), imu, gps };
+	return QuadFrame{ camera.clone(), imu, gps, imuBatch, interpolatedImu };
 }
 
 // CameraForOrm
-Camera CameraForOrm::toCamera(Description description, cv::Mat color) const {
-	// フレーム番号
-	uint64_t frameNumber = 0;
-	if (colorFrame.has_value()) { frameNumber = colorFrame.value(); }
-
-	// デプスの取得
-	cv::Mat depth;
-	if (
-		depthZlib.has_value() &&
-		description.depthWidth.has_value() &&
-		description.depthHeight.has_value()
-	) do {
-		cv::Mat depth_;
-		const std::vector<char>& depthZlib_ = depthZlib.value();
-		const uint64_t& depthWidth_  = description.depthWidth.value();
-		const uint64_t& depthHeight_ = description.depthHeight.value();
-
-		// cv::Matは行間にアライメントが混入する場合があるが、
-		// cv::Mat::createによって作成された配列は常に連続となる
-		depth_.create(depthHeight_, depthWidth_, CV_32FC1);
-		assert(depth_.isContinuous());
-
-		z_stream stream;
-		memset(&stream, 0, sizeof(z_stream));
-		stream.next_in = (Bytef*)depthZlib_.data();
-		stream.avail_in = depthZlib_.size();
-		stream.next_out = (Bytef*)depth_.ptr<char>(0);
-		stream.avail_out = depth_.total() * depth_.elemSize();
-		inflateInit2(&stream, -15);
-		int result = inflate(&stream, Z_FINISH);
-		if (Z_STREAM_END != result && Z_OK != result) { break; }
-		inflateEnd(&stream);
-		depth = std::move(depth_);
-	} while(false);
+Camera CameraForOrm::toCamera(const Description& description, cv::Mat color) const {
+	Camera camera;
+	camera.color = std::move(color);
+	toCamera(description, camera);
+	return camera;
+}
 
-	// 信頼度の取得
-	cv::Mat confidence;
-	if (
-		confidenceZlib.has_value() &&
-		description.confidenceWidth.has_value() &&
-		description.confidenceHeight.has_value()
-	) do {
-		cv::Mat confidence_;
-		const std::vector<char>& confidenceZlib_ = confidenceZlib.value();
-		const uint64_t& confidenceWidth_  = description.confidenceWidth.value();
-		const uint64_t& confidenceHeight_ = description.confidenceHeight.value();
+void CameraForOrm::toCamera(const Description& description, Camera& into) const {
+	QS_TRACE_SCOPE("CameraForOrm::toCamera");
+	toCameraWithoutBlobs(into);
 
-		// cv::Matは行間にアライメントが混入する場合があるが、
-		// cv::Mat::createによって作成された配列は常に連続となる
-		confidence_.create(confidenceHeight_, confidenceWidth_, CV_8UC1);
-		assert(confidence_.isContinuous());
+	// デプスと信頼度の取得
+	into.lazyDepth.reset();
+	into.lazyConfidence.reset();
+	Inflater inflater;
+	into.depthStatus = inflater.inflate(
+		depthZlib, description.depthWidth, description.depthHeight, CV_32FC1, into.depth
+	);
+	into.confidenceStatus = inflater.inflate(
+		confidenceZlib, description.confidenceWidth, description.confidenceHeight, CV_8UC1, into.confidence
+	);
+}
 
-		z_stream stream;
-		memset(&stream, 0, sizeof(z_stream));
-		stream.next_in = (Bytef*)confidenceZlib_.data();
-		stream.avail_in = confidenceZlib_.size();
-		stream.next_out = (Bytef*)confidence_.ptr<char>(0);
-		stream.avail_out = confidence_.total() * confidence_.elemSize();
-		inflateInit2(&stream, -15);
-		int result = inflate(&stream, Z_FINISH);
-		if (Z_STREAM_END != result && Z_OK != result) { break; }
-		inflateEnd(&stream);
-		confidence = std::move(confidence_);
-	} while(false);
+void CameraForOrm::toCameraWithoutBlobs(Camera& into, bool withMatrices) const {
+	// フレーム番号
+	into.frameNumber = 0;
+	if (colorFrame.has_value()) { into.frameNumber = colorFrame.value(); }
+	into.timestamp = timestamp;
 
 	// ARKitから取得した行列の取得
-	cv::Mat intrinsics, projection, view;
-	if (intrinsicsMatrix.has_value()) {
+	cv::Mat& intrinsics = into.intrinsicsMatrix;
+	cv::Mat& projection = into.projectionMatrix;
+	cv::Mat& view = into.viewMatrix;
+	if (withMatrices && intrinsicsMatrix.has_value()) {
 		intrinsics.create(3, 3, CV_32F);
 		std::memcpy(intrinsics.ptr(0), intrinsicsMatrix->data(), intrinsicsMatrix->size());
 	}
-	if (projectionMatrix.has_value()) {
+	else { intrinsics.release(); }
+	if (withMatrices && projectionMatrix.has_value()) {
 		projection.create(4, 4, CV_32F);
 		std::memcpy(projection.ptr(0), projectionMatrix->data(), projectionMatrix->size());
 	}
-	if (viewMatrix.has_value()) {
+	else { projection.release(); }
+	if (withMatrices && viewMatrix.has_value()) {
 		view.create(4, 4, CV_32F);
 		std::memcpy(view.ptr(0), viewMatrix->data(), viewMatrix->size());
 	}
-
-	return Camera {
-		frameNumber, timestamp,
-		std::move(color), std::move(depth), std::move(confidence),
-		std::move(intrinsics), std::move(projection), std::move(view)
-	};
+	else { view.release(); }
 }
@@ -0,0 +1,248 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "quad_loader.h"
+#include "allocation_counter.h"
+#include "camera_index.h"
+#include "inflate_engine.h"
+#include "sensor_index.h"
+
+/*
+	QuadLoader::next()の読み込み処理を段毎に計測するベンチマーク
+
+	ローダーと同じ部品 (VideoCapture, CameraIndex, Inflater, SensorIndex) を段毎に呼び出し、
+	各段の処理時間とメモリの確保回数を計測する。最後にQuadLoader::next()全体も計測する。
+	--jsonを指定すると結果をJSONで書き出すので、バージョン間で結果を比較できる。
+*/
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// 1つの段の計測結果
+	struct Stage {
+		std::string name;
+		std::vector<double> seconds;
+		size_t allocations = 0;
+
+		// 計測中に確保が発生しないよう、あらかじめ領域を確保しておく
+		Stage(std::string name, size_t frames) : name(std::move(name)) { seconds.reserve(frames); }
+
+		// fnを1回実行して処理時間と確保回数を記録する
+		template<typename F>
+		auto measure(F&& fn) {
+			const size_t before = qs::allocationCount.load();
+			const Clock::time_point begin = Clock::now();
+			auto result = fn();
+			const Clock::time_point end = Clock::now();
+			allocations += qs::allocationCount.load() - before;
+			seconds.push_back(std::chrono::duration<double>(end - begin).count());
+			return result;
+		}
+
+		struct Summary {
+			size_t samples;
+			double total, mean, p50, p99, throughput, allocationsPerFrame;
+		};
+		Summary summarize() const {
+			Summary summary{ seconds.size(), 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+			if (seconds.empty()) { return summary; }
+			std::vector<double> sorted = seconds;
+			std::sort(sorted.begin(), sorted.end());
+			for (double s : sorted) { summary.total += s; }
+			auto percentile = [&sorted](double p) {
+				const size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+				return sorted[std::min(index, sorted.size() - 1)];
+			};
+			summary.mean = summary.total / sorted.size();
+			summary.p50 = percentile(0.50);
+			summary.p99 = percentile(0.99);
+			summary.throughput = (0.0 < summary.total) ? sorted.size() / summary.total : 0.0;
+			summary.allocationsPerFrame = static_cast<double>(allocations) / sorted.size();
+			return summary;
+		}
+	};
+
+	std::string jsonEscape(const std::string& text) {
+		std::string escaped;
+		for (char c : text) {
+			if ('"' == c || '\\' == c) { escaped += '\\'; }
+			escaped += c;
+		}
+		return escaped;
+	}
+}
+
+static void printUsage() {
+	std::cout
+		<< "quadslam_bench version 0.0.1\n"
+		<< "\n"
+		<< "usage: quadslam_bench input_path [options]\n"
+		<< "  input_path   : Directory containing QuadDump recording files\n"
+		<< "  --frames N   : Maximum number of frames to measure (default: all)\n"
+		<< "  --warmup N   : Number of frames to skip before measuring (default: 10)\n"
+		<< "  --prefetch N : Prefetch depth for the end-to-end QuadLoader::next measurement (default: 0)\n"
+		<< "  --json PATH  : Write the results as JSON (\"-\" for stdout, the table then goes to stderr)"
+		<< "\n"
+		<< std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) { printUsage(); return 0; }
+
+	const std::filesystem::path recDir = argv[1];
+	uint64_t maxFrames = std::numeric_limits<uint64_t>::max(), warmup = 10;
+	size_t prefetch = 0;
+	std::string jsonPath;
+	for (int i = 2; i < argc; i++) {
+		const std::string key = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		if ("--frames" == key && value) { maxFrames = std::strtoull(value, nullptr, 10); i++; }
+		else if ("--warmup" == key && value) { warmup = std::strtoull(value, nullptr, 10); i++; }
+		else if ("--prefetch" == key && value) { prefetch = std::strtoull(value, nullptr, 10); i++; }
+		else if ("--json" == key && value) { jsonPath = value; i++; }
+		else { std::cout << "unknown option: " << key << std::endl; printUsage(); return 1; }
+	}
+
+	// ローダーを開いて索引を作成し、フレーム数と解像度を取得する
+	qs::QuadLoader loader;
+	loader.setPrefetch(prefetch);
+	loader.open(recDir, qs::OpenMode::READ_ONLY);
+	if (!loader.isOpened()) { std::cout << "failed to open forder" << std::endl; return 1; }
+	const qs::Description description = loader.getDescription();
+	const uint64_t frameCount = loader.getFrameCount();
+	const uint64_t frames = (frameCount <= warmup) ? 0 : std::min(frameCount - warmup, maxFrames);
+
+	// 段毎に計測するための部品
+	std::filesystem::path videoPath = recDir; videoPath.append("camera.mp4");
+	std::filesystem::path dbPath = recDir; dbPath.append("db.sqlite3");
+	cv::VideoCapture video(videoPath.u8string());
+	qs::SqliteConnection connection;
+	qs::CameraIndex cameraIndex;
+	qs::SensorIndex sensorIndex;
+	if (
+		!video.isOpened() ||
+		!connection.openReadOnly(dbPath.u8string()) ||
+		!cameraIndex.open(connection)
+	) { std::cout << "failed to open forder" << std::endl; return 1; }
+	connection.exec("PRAGMA mmap_size = 268435456");
+	connection.exec("PRAGMA cache_size = -65536");
+	if (!sensorIndex.open(connection)) { std::cout << "failed to open forder" << std::endl; return 1; }
+
+	Stage videoStage("video_decode", frames);
+	Stage fetchStage("row_fetch", frames);
+	Stage depthStage("depth_inflate", frames);
+	Stage confidenceStage("confidence_inflate", frames);
+	Stage matricesStage("matrix_copy", frames);
+	Stage imuStage("imu_query", frames);
+	Stage gpsStage("gps_query", frames);
+	Stage nextStage("loader_next", frames);
+
+	// 各段を順に実行する (ウォームアップ中のフレームは計測しない)
+	qs::Inflater depthInflater, confidenceInflater;
+	qs::CameraForOrm row;
+	qs::QuadFrame quadFrame;
+	quadFrame.imu.reserve(1024);
+	quadFrame.gps.reserve(64);
+	qs::Camera& camera = quadFrame.camera;
+	double preTimestamp = 0.0;
+	uint64_t skipped = 0;
+	for (uint64_t frame = 0; frame < warmup + frames; frame++) {
+		const bool measured = warmup <= frame;
+		auto run = [measured](Stage& stage, auto&& fn) { return measured ? stage.measure(fn) : fn(); };
+
+		if (!run(videoStage, [&]() { return video.read(camera.color); })) { break; }
+		if (!run(fetchStage, [&]() { return cameraIndex.fetch(frame, row); })) { skipped++; continue; }
+		run(depthStage, [&]() {
+			return depthInflater.inflate(row.depthZlib, description.depthWidth, description.depthHeight, CV_32FC1, camera.depth);
+		});
+		run(confidenceStage, [&]() {
+			return confidenceInflater.inflate(
+				row.confidenceZlib, description.confidenceWidth, description.confidenceHeight, CV_8UC1, camera.confidence
+			);
+		});
+		run(matricesStage, [&]() { row.toCameraWithoutBlobs(camera); return true; });
+		run(imuStage, [&]() {
+			qs::SensorSpan<qs::Imu> span = sensorIndex.imu(preTimestamp, camera.timestamp);
+			quadFrame.imu.assign(span.begin(), span.end());
+			return true;
+		});
+		run(gpsStage, [&]() {
+			qs::SensorSpan<qs::Gps> span = sensorIndex.gps(preTimestamp, camera.timestamp);
+			quadFrame.gps.assign(span.begin(), span.end());
+			return true;
+		});
+		preTimestamp = camera.timestamp;
+	}
+
+	// ローダー全体
+	for (uint64_t frame = 0; frame < warmup + frames; frame++) {
+		auto fn = [&]() { return loader.next(quadFrame); };
+		if (!((warmup <= frame) ? nextStage.measure(fn) : fn())) { break; }
+	}
+
+	const std::vector<const Stage*> stages = {
+		&videoStage, &fetchStage, &depthStage, &confidenceStage, &matricesStage, &imuStage, &gpsStage, &nextStage
+	};
+
+	// 表形式で表示 (JSONを標準出力に書き出す場合は、JSONとして読めるように表を標準エラー出力に表示する)
+	std::ostream& report = ("-" == jsonPath) ? std::cerr : std::cout;
+	report
+		<< "recording : " << recDir.u8string() << "\n"
+		<< "frames    : " << frames << " measured, " << warmup << " warmup, " << skipped << " skipped\n"
+		<< "prefetch  : " << prefetch << "\n"
+		<< "\n"
+		<< std::left << std::setw(20) << "stage"
+		<< std::right << std::setw(12) << "fps" << std::setw(12) << "mean[us]"
+		<< std::setw(12) << "p50[us]" << std::setw(12) << "p99[us]" << std::setw(12) << "alloc/frame" << "\n";
+	for (const Stage* stage : stages) {
+		const Stage::Summary summary = stage->summarize();
+		report
+			<< std::left << std::setw(20) << stage->name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(12) << summary.throughput
+			<< std::setw(12) << summary.mean * 1e6
+			<< std::setw(12) << summary.p50 * 1e6
+			<< std::setw(12) << summary.p99 * 1e6
+			<< std::setw(12) << std::setprecision(2) << summary.allocationsPerFrame << "\n";
+	}
+	report << std::flush;
+
+	// JSON
+	if (!jsonPath.empty()) {
+		std::ostringstream json;
+		json << std::setprecision(9)
+			<< "{\n"
+			<< "  \"recording\": \"" << jsonEscape(recDir.u8string()) << "\",\n"
+			<< "  \"color\": [" << description.colorWidth << ", " << description.colorHeight << "],\n"
+			<< "  \"depth\": [" << description.depthWidth.value_or(0) << ", " << description.depthHeight.value_or(0) << "],\n"
+			<< "  \"frames\": " << frames << ",\n"
+			<< "  \"warmup\": " << warmup << ",\n"
+			<< "  \"skipped\": " << skipped << ",\n"
+			<< "  \"prefetch\": " << prefetch << ",\n"
+			<< "  \"stages\": {\n";
+		for (size_t i = 0; i < stages.size(); i++) {
+			const Stage::Summary summary = stages[i]->summarize();
+			json
+				<< "    \"" << stages[i]->name << "\": {"
+				<< "\"samples\": " << summary.samples << ", "
+				<< "\"throughput_fps\": " << summary.throughput << ", "
+				<< "\"mean_us\": " << summary.mean * 1e6 << ", "
+				<< "\"p50_us\": " << summary.p50 * 1e6 << ", "
+				<< "\"p99_us\": " << summary.p99 * 1e6 << ", "
+				<< "\"allocations_per_frame\": " << summary.allocationsPerFrame
+				<< "}" << ((i + 1 < stages.size()) ? "," : "") << "\n";
+		}
+		json << "  }\n}\n";
+
+		if ("-" == jsonPath) { std::cout << json.str(); }
+		else {
+			std::ofstream file(jsonPath);
+			file << json.str();
+			if (!file) { std::cout << "failed to write " << jsonPath << std::endl; return 1; }
+		}
+	}
+
+	return 0;
+}
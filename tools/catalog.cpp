@@ -0,0 +1,80 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include "catalog.h"
+
+/*
+	複数の録画をカタログに登録し、位置と日付で検索するツール
+	検索はカタログのデータベースのみを参照するため、各録画を開かない。
+*/
+
+static void printUsage() {
+	std::cout
+		<< "quadslam_catalog version 0.0.1\n"
+		<< "\n"
+		<< "usage: quadslam_catalog catalog_path scan root_path [workers]\n"
+		<< "       quadslam_catalog catalog_path find [options]\n"
+		<< "  catalog_path                 : Catalog database (created if missing)\n"
+		<< "  root_path                    : Directory to search for QuadDump recordings\n"
+		<< "  workers                      : Number of scanning threads (default: hardware threads)\n"
+		<< "  --area LAT0 LON0 LAT1 LON1   : Recordings whose GPS range intersects this box\n"
+		<< "  --from DATE                  : Recordings on or after DATE (e.g. 2021-06-14)\n"
+		<< "  --to DATE                    : Recordings on or before DATE, matched by prefix (e.g. 2021-06)"
+		<< "\n"
+		<< std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 3) { printUsage(); return 0; }
+
+	qs::Catalog catalog;
+	catalog.open(argv[1]);
+	if (!catalog.isOpened()) { std::cout << "failed to open " << argv[1] << std::endl; return 1; }
+	const std::string command = argv[2];
+
+	if ("scan" == command && (4 == argc || 5 == argc)) {
+		const size_t workers = (5 == argc) ? std::strtoull(argv[4], nullptr, 10) : 0;
+		const auto begin = std::chrono::steady_clock::now();
+		const qs::CatalogScanResult result = catalog.scan(argv[3], workers);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		std::cout
+			<< "found    : " << result.found     << "\n"
+			<< "updated  : " << result.updated   << "\n"
+			<< "unchanged: " << result.unchanged << "\n"
+			<< "invalid  : " << result.invalid   << "\n"
+			<< "removed  : " << result.removed   << "\n"
+			<< "seconds  : " << seconds          << std::endl;
+		return 0;
+	}
+
+	if ("find" == command) {
+		qs::CatalogQuery query;
+		for (int i = 3; i < argc; i++) {
+			const std::string key = argv[i];
+			auto f64 = [](const char* text) { return std::strtod(text, nullptr); };
+			if ("--area" == key && i + 4 < argc) {
+				const double lat0 = f64(argv[i + 1]), lon0 = f64(argv[i + 2]);
+				const double lat1 = f64(argv[i + 3]), lon1 = f64(argv[i + 4]);
+				query.area = qs::GeoBox{ std::min(lat0, lat1), std::max(lat0, lat1), std::min(lon0, lon1), std::max(lon0, lon1) };
+				i += 4;
+			}
+			else if ("--from" == key && i + 1 < argc) { query.dateFrom = argv[++i]; }
+			else if ("--to" == key && i + 1 < argc) { query.dateTo = argv[++i]; }
+			else { std::cout << "unknown option: " << key << std::endl; printUsage(); return 1; }
+		}
+
+		for (const qs::CatalogEntry& entry : catalog.find(query)) {
+			std::cout
+				<< entry.date << "\t"
+				<< entry.frameCount << " frames\t"
+				<< entry.duration << " s\t"
+				<< entry.colorWidth << "x" << entry.colorHeight << "\t"
+				<< entry.path << std::endl;
+		}
+		return 0;
+	}
+
+	printUsage();
+	return 1;
+}
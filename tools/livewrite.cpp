@@ -0,0 +1,183 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include "types.h"
+#include "sqlite_statement.h"
+#include "opencv2/opencv.hpp"
+
+/*
+	既存の録画を、QuadDumpが録画中に書き込むのと同じように少しずつ書き出すツール
+	書き込み中の録画を読み込む処理 (FollowSource) の動作確認に使用する。
+
+	データベースはWALモードで、フレーム毎にカメラの行とそのタイムスタンプまでのIMUとGPSを1つのトランザクションで書き込む。
+	通常のMP4は書き込みが終わるまで読み込めないため、動画は--flushフレーム毎に先頭から書き出し直して置き換える。
+	書き出し直す度に変換元の動画を先頭からデコードするので、短い録画で使用すること。
+*/
+
+static void printUsage() {
+	std::cout
+		<< "quadslam_livewrite version 0.0.1\n"
+		<< "\n"
+		<< "usage: quadslam_livewrite input_path output_path [options]\n"
+		<< "  input_path          : Directory containing QuadDump recording files to replay\n"
+		<< "  output_path         : Directory to write camera.mp4 and db.sqlite3 progressively\n"
+		<< "  --speed S           : Playback speed relative to real time (default: 1)\n"
+		<< "  --flush N           : Rewrite the video every N frames (default: 30)\n"
+		<< "  --order ORDER       : row-first (rows lead the video) or video-first (default: row-first)\n"
+		<< "  --fourcc CODE       : Video codec (default: mp4v)"
+		<< "\n"
+		<< std::endl;
+}
+
+// 変換元の動画の先頭からframesフレームを書き出し、出力先の動画と置き換える
+static bool flushVideo(
+	const std::filesystem::path& srcVideoPath, const std::filesystem::path& dstVideoPath,
+	uint64_t frames, double fps, const cv::Size& size, const std::string& fourcc
+) {
+	cv::VideoCapture src(srcVideoPath.u8string());
+	if (!src.isOpened()) { return false; }
+
+	// 拡張子でコンテナが決まるので、一時ファイルも.mp4にする
+	std::filesystem::path tempPath = dstVideoPath.parent_path() / "camera.tmp.mp4";
+	{
+		cv::VideoWriter writer(
+			tempPath.u8string(), cv::VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]), fps, size
+		);
+		if (!writer.isOpened()) { return false; }
+		cv::Mat color;
+		for (uint64_t i = 0; i < frames && src.read(color); i++) { writer.write(color); }
+		writer.release();
+	}
+
+	// 読み込む側が書き込み途中のファイルを開かないよう、書き終えてから置き換える
+	std::error_code error;
+	std::filesystem::rename(tempPath, dstVideoPath, error);
+	return !error;
+}
+
+int main(int argc, char* argv[]) {
+	using namespace sqlite_orm;
+	if (argc < 3) { printUsage(); return 0; }
+
+	double speed = 1.0;
+	uint64_t flush = 30;
+	bool rowFirst = true;
+	std::string fourcc = "mp4v";
+	for (int i = 3; i < argc; i++) {
+		const std::string key = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		if ("--speed" == key && value) { speed = std::strtod(value, nullptr); i++; }
+		else if ("--flush" == key && value) { flush = std::max<uint64_t>(std::strtoull(value, nullptr, 10), 1); i++; }
+		else if ("--order" == key && value && (std::string("row-first") == value || std::string("video-first") == value)) {
+			rowFirst = (std::string("row-first") == value); i++;
+		}
+		else if ("--fourcc" == key && value && 4 == std::string(value).size()) { fourcc = value; i++; }
+		else { std::cout << "unknown option: " << key << std::endl; printUsage(); return 1; }
+	}
+	if (speed <= 0.0) { std::cout << "speed must be positive" << std::endl; return 1; }
+
+	const std::filesystem::path srcDir = argv[1], dstDir = argv[2];
+	const std::filesystem::path srcVideoPath = srcDir / "camera.mp4", dstVideoPath = dstDir / "camera.mp4";
+	const std::filesystem::path srcDbPath = srcDir / "db.sqlite3", dstDbPath = dstDir / "db.sqlite3";
+
+	// 変換元の録画を全て読み込む
+	std::optional<qs::Description> descriptionOpt;
+	std::vector<qs::CameraForOrm> rows;
+	std::vector<qs::Imu> imus;
+	std::vector<qs::Gps> gpss;
+	try {
+		qs::QSStorage src = qs::makeQSStorage(srcDbPath.u8string());
+		for (auto& desc : src.iterate<qs::Description>()) { descriptionOpt = std::move(desc); break; }
+		rows = src.get_all<qs::CameraForOrm>(
+			where(is_not_null(&qs::CameraForOrm::colorFrame)), order_by(&qs::CameraForOrm::colorFrame).asc()
+		);
+		imus = src.get_all<qs::Imu>(order_by(&qs::Imu::timestamp).asc());
+		gpss = src.get_all<qs::Gps>(order_by(&qs::Gps::timestamp).asc());
+	}
+	catch(const std::system_error&) { std::cout << "failed to read " << srcDbPath.u8string() << std::endl; return 1; }
+	if (!descriptionOpt.has_value() || rows.empty()) { std::cout << "no frames to write" << std::endl; return 1; }
+	const qs::Description& description = descriptionOpt.value();
+
+	double fps;
+	{
+		cv::VideoCapture src(srcVideoPath.u8string());
+		if (!src.isOpened()) { std::cout << "failed to open " << srcVideoPath.u8string() << std::endl; return 1; }
+		fps = src.get(cv::CAP_PROP_FPS);
+		if (fps <= 0.0) { fps = 60.0; }
+	}
+	const cv::Size size(static_cast<int>(description.colorWidth), static_cast<int>(description.colorHeight));
+	const uint64_t totalFrames = rows.back().colorFrame.value() + 1;
+
+	// 以前の出力を削除する
+	std::error_code error;
+	std::filesystem::create_directories(dstDir, error);
+	for (const char* name : { "camera.mp4", "db.sqlite3", "db.sqlite3-wal", "db.sqlite3-shm", "db.sqlite3.qsidx" }) {
+		std::filesystem::remove(dstDir / name, error);
+	}
+
+	// 録画中に読み込まれても書き込みが妨げられないようにWALモードにする (設定はファイルに保存される)
+	{
+		qs::SqliteConnection connection;
+		if (!connection.open(dstDbPath.u8string(), SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) ||
+			!connection.exec("PRAGMA journal_mode = WAL")
+		) { std::cout << "failed to create " << dstDbPath.u8string() << std::endl; return 1; }
+	}
+
+	try {
+		qs::QSStorage dst = qs::makeQSStorage(dstDbPath.u8string());
+		dst.sync_schema();
+		dst.insert(description);
+
+		size_t imuIndex = 0, gpsIndex = 0;
+		uint64_t flushed = 0;
+		const auto begin = std::chrono::steady_clock::now();
+		const double startTimestamp = rows.front().timestamp;
+		for (const qs::CameraForOrm& row : rows) {
+			const uint64_t frameEnd = row.colorFrame.value() + 1;
+
+			// 録画と同じ速さで書き込む
+			std::this_thread::sleep_until(begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>((row.timestamp - startTimestamp) / speed)
+			));
+
+			// 動画を先に書き込む場合は、これから書き込む行より先のフレームまで書き出しておく
+			if (!rowFirst && flushed < frameEnd) {
+				flushed = std::min(frameEnd + flush - 1, totalFrames);
+				if (!flushVideo(srcVideoPath, dstVideoPath, flushed, fps, size, fourcc)) { std::cout << "failed to write video" << std::endl; return 1; }
+			}
+
+			// カメラの行と、そのタイムスタンプまでのIMUとGPSを1つのトランザクションで書き込む
+			dst.transaction([&]() {
+				for (; imuIndex < imus.size() && imus[imuIndex].timestamp <= row.timestamp; imuIndex++) { dst.insert(imus[imuIndex]); }
+				for (; gpsIndex < gpss.size() && gpss[gpsIndex].timestamp <= row.timestamp; gpsIndex++) { dst.insert(gpss[gpsIndex]); }
+				dst.insert(row);
+				return true;
+			});
+
+			// 行を先に書き込む場合は、flushフレーム毎に動画を書き出す
+			if (rowFirst && flushed + flush <= frameEnd) {
+				flushed = frameEnd;
+				if (!flushVideo(srcVideoPath, dstVideoPath, flushed, fps, size, fourcc)) { std::cout << "failed to write video" << std::endl; return 1; }
+			}
+			std::cout << "\rwrote frame " << row.colorFrame.value() << " / " << totalFrames << std::flush;
+		}
+
+		// 残りのIMUとGPSと、全てのフレームを含む動画を書き出す
+		dst.transaction([&]() {
+			for (; imuIndex < imus.size(); imuIndex++) { dst.insert(imus[imuIndex]); }
+			for (; gpsIndex < gpss.size(); gpsIndex++) { dst.insert(gpss[gpsIndex]); }
+			return true;
+		});
+		if (flushed < totalFrames && !flushVideo(srcVideoPath, dstVideoPath, totalFrames, fps, size, fourcc)) {
+			std::cout << "failed to write video" << std::endl;
+			return 1;
+		}
+	}
+	catch(const std::system_error&) { std::cout << "\nfailed to write " << dstDbPath.u8string() << std::endl; return 1; }
+
+	std::cout << "\nfinished" << std::endl;
+	return 0;
+}
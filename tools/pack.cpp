@@ -0,0 +1,42 @@
+#include <iostream>
+#include <chrono>
+#include "packed_recording.h"
+
+/*
+	QuadDumpの録画をメモリにマップして読み込めるpacked形式に変換するツール
+	変換後はPackedLoaderで、zlibの展開とSQLiteの問い合わせを行わずに読み込める。
+*/
+
+int main(int argc, char* argv[]) {
+	if (2 != argc && 3 != argc) {
+		std::cout
+			<< "quadslam_pack version 0.0.1\n"
+			<< "\n"
+			<< "usage: quadslam_pack input_path [output_path]\n"
+			<< "  input_path : Directory containing QuadDump recording files\n"
+			<< "  output_path: Packed file to write (default: input_path/packed.qsp)"
+			<< "\n"
+			<< std::endl;
+		return 0;
+	}
+
+	const std::filesystem::path recDir = argv[1];
+	const std::filesystem::path outputPath = (3 == argc) ? std::filesystem::path(argv[2]) : recDir / "packed.qsp";
+
+	const auto begin = std::chrono::steady_clock::now();
+	if (!qs::convertToPacked(recDir, outputPath)) {
+		std::cout << "failed to convert " << recDir.u8string() << std::endl;
+		return 1;
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	// 書き出したファイルを開けることを確認する
+	qs::PackedLoader loader;
+	loader.open(recDir, outputPath);
+	if (!loader.isOpened()) { std::cout << "failed to open " << outputPath.u8string() << std::endl; return 1; }
+	std::cout
+		<< "wrote " << outputPath.u8string() << "\n"
+		<< "frames : " << loader.getFrameCount() << "\n"
+		<< "seconds: " << seconds << std::endl;
+	return 0;
+}
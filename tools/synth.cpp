@@ -0,0 +1,57 @@
+#include <iostream>
+#include <string>
+#include "synthetic_recording.h"
+
+/*
+	ベンチマークや動作確認のために、合成した録画を書き出すツール
+	実機で録画したデータが無い環境でも、同じ内容の録画を再現できる。
+*/
+
+static void printUsage() {
+	qs::SyntheticOptions defaults;
+	std::cout
+		<< "quadslam_synth version 0.0.1\n"
+		<< "\n"
+		<< "usage: quadslam_synth output_path [options]\n"
+		<< "  output_path           : Directory to write camera.mp4 and db.sqlite3\n"
+		<< "  --frames N            : Number of camera frames (default: " << defaults.frames << ")\n"
+		<< "  --color-size W H      : Color resolution (default: " << defaults.colorWidth << " " << defaults.colorHeight << ")\n"
+		<< "  --depth-size W H      : Depth and confidence resolution, 0 0 to omit (default: " << defaults.depthWidth << " " << defaults.depthHeight << ")\n"
+		<< "  --fps F               : Camera frame rate (default: " << defaults.fps << ")\n"
+		<< "  --imu-rate F          : IMU sampling rate in Hz, 0 to omit (default: " << defaults.imuRate << ")\n"
+		<< "  --gps-rate F          : GPS sampling rate in Hz, 0 to omit (default: " << defaults.gpsRate << ")\n"
+		<< "  --seed N              : Random seed (default: " << defaults.seed << ")\n"
+		<< "  --fourcc CODE         : Video codec (default: " << defaults.fourcc << ")"
+		<< "\n"
+		<< std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) { printUsage(); return 0; }
+
+	qs::SyntheticOptions options;
+	for (int i = 2; i < argc; i++) {
+		const std::string key = argv[i];
+		auto value = [&](int offset) -> const char* {
+			return (i + offset < argc) ? argv[i + offset] : nullptr;
+		};
+		auto u64 = [](const char* text) { return std::strtoull(text, nullptr, 10); };
+		auto f64 = [](const char* text) { return std::strtod(text, nullptr); };
+		if ("--frames" == key && value(1)) { options.frames = u64(value(1)); i += 1; }
+		else if ("--color-size" == key && value(2)) { options.colorWidth = u64(value(1)); options.colorHeight = u64(value(2)); i += 2; }
+		else if ("--depth-size" == key && value(2)) { options.depthWidth = u64(value(1)); options.depthHeight = u64(value(2)); i += 2; }
+		else if ("--fps" == key && value(1)) { options.fps = f64(value(1)); i += 1; }
+		else if ("--imu-rate" == key && value(1)) { options.imuRate = f64(value(1)); i += 1; }
+		else if ("--gps-rate" == key && value(1)) { options.gpsRate = f64(value(1)); i += 1; }
+		else if ("--seed" == key && value(1)) { options.seed = u64(value(1)); i += 1; }
+		else if ("--fourcc" == key && value(1)) { options.fourcc = value(1); i += 1; }
+		else { std::cout << "unknown option: " << key << std::endl; printUsage(); return 1; }
+	}
+
+	if (!qs::writeSyntheticRecording(argv[1], options)) {
+		std::cout << "failed to write recording" << std::endl;
+		return 1;
+	}
+	std::cout << "wrote " << options.frames << " frames to " << argv[1] << std::endl;
+	return 0;
+}